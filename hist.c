@@ -0,0 +1,126 @@
+// hist.c
+#include <string.h>
+#include <math.h>
+#include "hist.h"
+
+static unsigned int hist_index(uint64_t v) {
+    if (v < 2 * HIST_SUB)
+        return v;
+
+    unsigned int msb = 63 - __builtin_clzll(v);
+    if (msb >= HIST_MAX_BITS)
+        return HIST_BUCKETS - 1;
+
+    unsigned int shift = msb - HIST_SUB_BITS;
+    unsigned int sub = (v >> shift) & (HIST_SUB - 1);
+    return (msb - HIST_SUB_BITS + 1) * HIST_SUB + sub;
+}
+
+static uint64_t hist_lower(unsigned int idx) {
+    if (idx < 2 * HIST_SUB)
+        return idx;
+
+    unsigned int msb = idx / HIST_SUB + HIST_SUB_BITS - 1;
+    unsigned int sub = idx % HIST_SUB;
+    return (uint64_t)(HIST_SUB + sub) << (msb - HIST_SUB_BITS);
+}
+
+static uint64_t hist_width(unsigned int idx) {
+    if (idx < 2 * HIST_SUB)
+        return 1;
+    return 1ULL << (idx / HIST_SUB - 1);
+}
+
+void hist_reset(struct hist *h) {
+    memset(h, 0, sizeof(*h));
+    h->min = UINT64_MAX;
+}
+
+void hist_add(struct hist *h, double v) {
+    uint64_t x = v <= 0 ? 0 : (uint64_t)llround(v);
+
+    h->bins[hist_index(x)]++;
+    h->count++;
+    h->sum += v;
+    if (x < h->min)
+        h->min = x;
+    if (x > h->max)
+        h->max = x;
+}
+
+void hist_merge(struct hist *dst, const struct hist *src) {
+    unsigned int i;
+
+    if (!src->count)
+        return;
+    for (i = 0; i < HIST_BUCKETS; i++)
+        dst->bins[i] += src->bins[i];
+    dst->count += src->count;
+    dst->sum += src->sum;
+    if (src->min < dst->min)
+        dst->min = src->min;
+    if (src->max > dst->max)
+        dst->max = src->max;
+}
+
+double hist_mean(const struct hist *h) {
+    return h->count ? h->sum / h->count : 0;
+}
+
+double hist_percentile(const struct hist *h, double p) {
+    uint64_t rank, seen = 0;
+    unsigned int i;
+
+    if (!h->count)
+        return 0;
+
+    rank = (uint64_t)ceil(p / 100.0 * h->count);
+    if (rank < 1)
+        rank = 1;
+
+    for (i = 0; i < HIST_BUCKETS; i++) {
+        seen += h->bins[i];
+        if (seen >= rank) {
+            double mid = hist_lower(i) + (hist_width(i) - 1) / 2.0;
+            // the exact extremes are known, don't report past them
+            if (mid > h->max)
+                mid = h->max;
+            if (mid < h->min)
+                mid = h->min;
+            return mid;
+        }
+    }
+    return h->max;
+}
+
+void hist_print(FILE *out, const struct hist *h, const char *unit) {
+    uint64_t peak = 0;
+    unsigned int i;
+
+    for (i = 0; i < HIST_BUCKETS; i++)
+        if (h->bins[i] > peak)
+            peak = h->bins[i];
+    if (!peak)
+        return;
+
+    for (i = 0; i < HIST_BUCKETS; i++) {
+        char label[48];
+        uint64_t lo, hi;
+        int bar;
+
+        if (!h->bins[i])
+            continue;
+        lo = hist_lower(i);
+        hi = lo + hist_width(i) - 1;
+        if (lo == hi)
+            snprintf(label, sizeof(label), "%llu", (unsigned long long)lo);
+        else
+            snprintf(label, sizeof(label), "%llu-%llu",
+                     (unsigned long long)lo, (unsigned long long)hi);
+        fprintf(out, "    %17s %-3s %10llu %5.1f%% ", label, unit,
+                (unsigned long long)h->bins[i], 100.0 * h->bins[i] / h->count);
+        for (bar = (int)(h->bins[i] * 40 / peak); bar > 0; bar--)
+            fputc('#', out);
+        fputc('\n', out);
+    }
+}
@@ -0,0 +1,37 @@
+// hist.h
+#ifndef HIST_H
+#define HIST_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+ * Fixed size log-linear histogram. Values are non-negative integers in
+ * whatever unit the caller picks (us, ns, bytes). Every power of two is
+ * split into 2^HIST_SUB_BITS buckets, so values below 2^(HIST_SUB_BITS + 1)
+ * are exact and larger ones are within ~3%. Memory use is constant no
+ * matter how many samples are added.
+ */
+#define HIST_SUB_BITS   5
+#define HIST_SUB        (1 << HIST_SUB_BITS)
+#define HIST_MAX_BITS   40                      // values up to 2^40
+#define HIST_BUCKETS    ((HIST_MAX_BITS - HIST_SUB_BITS + 1) * HIST_SUB)
+
+struct hist {
+    uint64_t count;
+    uint64_t min;
+    uint64_t max;
+    double sum;
+    uint64_t bins[HIST_BUCKETS];
+};
+
+void hist_reset(struct hist *h);
+void hist_add(struct hist *h, double v);
+void hist_merge(struct hist *dst, const struct hist *src);
+double hist_mean(const struct hist *h);
+// p in 0..100, returns the midpoint of the bucket holding that rank
+double hist_percentile(const struct hist *h, double p);
+// Non-empty buckets with a bar, values labelled with `unit`
+void hist_print(FILE *out, const struct hist *h, const char *unit);
+
+#endif
@@ -0,0 +1,333 @@
+// load.c
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+
+#include "load.h"
+
+#ifndef TIOCM_LOOP
+#define TIOCM_LOOP          0x8000  // asm-generic/termios.h
+#endif
+
+#define LOAD_THREADS_MAX    256
+#define CPU_BUF_SIZE        (64 * 1024)         // fits in L2
+#define MEM_BUF_SIZE        (64 * 1024 * 1024)  // well past the LLC
+#define IO_BLOCK_SIZE       (1024 * 1024)
+#define IO_FILE_MAX         (256LL * 1024 * 1024)
+#define IO_SYNC_EVERY       8                   // blocks between fdatasync
+#define IRQ_BUF_SIZE        4096
+
+struct load_worker {
+    pthread_t thread;
+    int fd;
+    volatile unsigned long long work;   // iterations, or bytes
+};
+
+static struct load_worker workers[LOAD_THREADS_MAX];
+static int nworkers;
+static volatile int load_stopping;
+static int irq_fd = -1;
+static double load_t0;
+static struct {
+    int first, count;
+} kinds[4];     // cpu, mem, io, irq ranges in workers[]
+
+static double load_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ * Stand in for compression and crypto: table lookups and mixing over a
+ * cache resident buffer, so it contends for the core and not for memory.
+ */
+static void *cpu_worker(void *arg) {
+    struct load_worker *w = arg;
+    uint8_t *buf = malloc(CPU_BUF_SIZE);
+    uint32_t table[256], x = 2463534242u, h = 0;
+    int i;
+
+    if (!buf)
+        return NULL;
+    for (i = 0; i < 256; i++)
+        table[i] = x = x * 1664525u + 1013904223u;
+    for (i = 0; i < CPU_BUF_SIZE; i++)
+        buf[i] = (uint8_t)(x = x * 1664525u + 1013904223u);
+
+    while (!load_stopping) {
+        for (i = 0; i < CPU_BUF_SIZE; i++) {
+            h = (h >> 8) ^ table[(h ^ buf[i]) & 0xff];
+            buf[i] ^= (uint8_t)h;
+        }
+        w->work += CPU_BUF_SIZE;
+    }
+    free(buf);
+    return NULL;
+}
+
+static void *mem_worker(void *arg) {
+    struct load_worker *w = arg;
+    char *a = malloc(MEM_BUF_SIZE), *b = malloc(MEM_BUF_SIZE);
+
+    if (a && b) {
+        memset(a, 1, MEM_BUF_SIZE);
+        memset(b, 2, MEM_BUF_SIZE);
+        while (!load_stopping) {
+            memcpy(b, a, MEM_BUF_SIZE);
+            memcpy(a, b, MEM_BUF_SIZE);
+            w->work += 2ULL * MEM_BUF_SIZE;
+        }
+    }
+    free(a);
+    free(b);
+    return NULL;
+}
+
+// Rewrites the first IO_FILE_MAX bytes of an unlinked scratch file
+static void *io_worker(void *arg) {
+    struct load_worker *w = arg;
+    char *buf = malloc(IO_BLOCK_SIZE);
+    long long off = 0;
+    int n = 0;
+
+    if (!buf)
+        return NULL;
+    memset(buf, 0x5a, IO_BLOCK_SIZE);
+    while (!load_stopping) {
+        if (pwrite(w->fd, buf, IO_BLOCK_SIZE, off) != IO_BLOCK_SIZE)
+            break;
+        w->work += IO_BLOCK_SIZE;
+        off = (off + IO_BLOCK_SIZE) % IO_FILE_MAX;
+        if (++n % IO_SYNC_EVERY == 0)
+            fdatasync(w->fd);
+    }
+    free(buf);
+    return NULL;
+}
+
+static void *irq_tx_worker(void *arg) {
+    struct load_worker *w = arg;
+    unsigned char buf[IRQ_BUF_SIZE];
+
+    memset(buf, 0x55, sizeof(buf));
+    while (!load_stopping) {
+        ssize_t n = write(w->fd, buf, sizeof(buf));
+        if (n < 0 && errno != EINTR && errno != EAGAIN)
+            break;
+    }
+    return NULL;
+}
+
+static void *irq_rx_worker(void *arg) {
+    struct load_worker *w = arg;
+    unsigned char buf[IRQ_BUF_SIZE];
+
+    while (!load_stopping) {
+        ssize_t n = read(w->fd, buf, sizeof(buf));
+        if (n > 0)
+            w->work += n;
+        else if (n < 0 && errno != EINTR && errno != EAGAIN)
+            break;
+    }
+    return NULL;
+}
+
+static speed_t irq_speed(long baud) {
+    switch (baud) {
+    case 115200:  return B115200;
+    case 230400:  return B230400;
+    case 460800:  return B460800;
+    case 921600:  return B921600;
+    case 1500000: return B1500000;
+    case 3000000: return B3000000;
+    case 4000000: return B4000000;
+    }
+    return B115200;
+}
+
+// Raw mode, internal loopback, reads time out so the worker sees load_stopping
+static int irq_open(const char *dev, long baud) {
+    struct termios tty;
+    int loop = TIOCM_LOOP;
+    int fd = open(dev, O_RDWR | O_NOCTTY);
+
+    if (fd < 0)
+        return -1;
+    if (tcgetattr(fd, &tty) == 0) {
+        cfmakeraw(&tty);
+        cfsetspeed(&tty, irq_speed(baud));
+        tty.c_cflag |= CLOCAL | CREAD;
+        tty.c_cflag &= ~CRTSCTS;
+        tty.c_cc[VMIN] = 0;
+        tty.c_cc[VTIME] = 1;
+        tcsetattr(fd, TCSANOW, &tty);
+    }
+    if (ioctl(fd, TIOCMBIS, &loop) != 0)
+        fprintf(stderr, "load: %s has no internal loopback, TX only\n", dev);
+    tcflush(fd, TCIOFLUSH);
+    return fd;
+}
+
+int load_parse(const char *spec, struct load_spec *out) {
+    char *copy = strdup(spec), *save = NULL, *tok;
+    int ret = 0;
+
+    memset(out, 0, sizeof(*out));
+    out->io_dir = "/tmp";
+    out->irq_baud = 115200;
+
+    for (tok = strtok_r(copy, ",", &save); tok; tok = strtok_r(NULL, ",", &save)) {
+        char *val = strchr(tok, '=');
+        if (!val) {
+            ret = -1;
+            break;
+        }
+        *val++ = '\0';
+        if (!strcmp(tok, "cpu"))
+            out->cpu = atoi(val);
+        else if (!strcmp(tok, "mem"))
+            out->mem = atoi(val);
+        else if (!strcmp(tok, "io"))
+            out->io = atoi(val);
+        else if (!strcmp(tok, "io_dir"))
+            out->io_dir = strdup(val);
+        else if (!strcmp(tok, "irq"))
+            out->irq_dev = strdup(val);
+        else if (!strcmp(tok, "irq_baud"))
+            out->irq_baud = atol(val);
+        else {
+            ret = -1;
+            break;
+        }
+    }
+    if (ret)
+        fprintf(stderr, "Invalid load spec '%s', expected cpu=N,mem=N,io=N,"
+                "io_dir=DIR,irq=DEV,irq_baud=RATE\n", spec);
+    free(copy);
+    return ret;
+}
+
+void load_describe(const struct load_spec *spec, int level, char *buf, size_t len) {
+    snprintf(buf, len, "level %d: cpu=%d mem=%d io=%d irq=%s", level,
+             spec->cpu * level, spec->mem * level, spec->io * level,
+             (spec->irq_dev && level) ? spec->irq_dev : "off");
+}
+
+static int spawn(void *(*fn)(void *), int fd) {
+    struct load_worker *w;
+
+    if (nworkers >= LOAD_THREADS_MAX)
+        return -1;
+    w = &workers[nworkers];
+    memset(w, 0, sizeof(*w));
+    w->fd = fd;
+    if (pthread_create(&w->thread, NULL, fn, w) != 0)
+        return -1;
+    nworkers++;
+    return 0;
+}
+
+int load_start(const struct load_spec *spec, int level) {
+    int i;
+
+    load_stopping = 0;
+    nworkers = 0;
+    memset(kinds, 0, sizeof(kinds));
+
+    kinds[0].first = nworkers;
+    for (i = 0; i < spec->cpu * level; i++)
+        if (spawn(cpu_worker, -1))
+            goto fail;
+    kinds[0].count = nworkers - kinds[0].first;
+
+    kinds[1].first = nworkers;
+    for (i = 0; i < spec->mem * level; i++)
+        if (spawn(mem_worker, -1))
+            goto fail;
+    kinds[1].count = nworkers - kinds[1].first;
+
+    kinds[2].first = nworkers;
+    for (i = 0; i < spec->io * level; i++) {
+        char path[512];
+        snprintf(path, sizeof(path), "%s/rtt_load.XXXXXX", spec->io_dir);
+        int fd = mkstemp(path);
+        if (fd < 0) {
+            perror("load: mkstemp");
+            goto fail;
+        }
+        unlink(path);
+        if (spawn(io_worker, fd)) {
+            close(fd);
+            goto fail;
+        }
+        // counted as they start, so a later failure closes these files too
+        kinds[2].count++;
+    }
+
+    kinds[3].first = nworkers;
+    if (spec->irq_dev && level > 0) {
+        irq_fd = irq_open(spec->irq_dev, spec->irq_baud);
+        if (irq_fd < 0) {
+            perror("load: open irq port");
+            goto fail;
+        }
+        if (spawn(irq_rx_worker, irq_fd) || spawn(irq_tx_worker, irq_fd))
+            goto fail;
+    }
+    kinds[3].count = nworkers - kinds[3].first;
+
+    load_t0 = load_now();
+    return 0;
+
+fail:
+    load_stop(NULL);
+    return -1;
+}
+
+static double kind_rate(int k, double secs) {
+    unsigned long long sum = 0;
+    int i;
+
+    for (i = kinds[k].first; i < kinds[k].first + kinds[k].count; i++)
+        sum += workers[i].work;
+    return secs > 0 ? sum / secs : 0;
+}
+
+void load_stop(struct load_stats *stats) {
+    double secs = load_now() - load_t0;
+    int i;
+
+    load_stopping = 1;
+    // unblock the irq writer
+    if (irq_fd >= 0)
+        tcflush(irq_fd, TCIOFLUSH);
+    for (i = 0; i < nworkers; i++)
+        pthread_join(workers[i].thread, NULL);
+
+    if (stats) {
+        stats->cpu_mbps = kind_rate(0, secs) / 1e6;
+        stats->mem_mbps = kind_rate(1, secs) / 1e6;
+        stats->io_mbps = kind_rate(2, secs) / 1e6;
+        stats->irq_bps = kind_rate(3, secs);
+    }
+
+    for (i = kinds[2].first; i < kinds[2].first + kinds[2].count; i++)
+        close(workers[i].fd);
+    if (irq_fd >= 0) {
+        int loop = TIOCM_LOOP;
+        ioctl(irq_fd, TIOCMBIC, &loop);
+        close(irq_fd);
+        irq_fd = -1;
+    }
+    nworkers = 0;
+}
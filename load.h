@@ -0,0 +1,36 @@
+// load.h
+#ifndef LOAD_H
+#define LOAD_H
+
+#include <stddef.h>
+
+/*
+ * Background load for latency-under-load runs. Counts are per load level:
+ * at level L, L * cpu busy threads, L * mem streams and L * io writers run,
+ * and the irq port is flooded for any level above 0.
+ */
+struct load_spec {
+    int cpu;                // compute threads, cache resident
+    int mem;                // memcpy streams over buffers larger than the LLC
+    int io;                 // write + fdatasync loops
+    const char *io_dir;     // directory for the io scratch files
+    const char *irq_dev;    // second serial port flooded in internal loopback
+    long irq_baud;
+};
+
+struct load_stats {
+    double cpu_mbps;        // MB/s run through the compute loop
+    double mem_mbps;        // copied MB/s
+    double io_mbps;         // written MB/s
+    double irq_bps;         // bytes/s through the irq port
+};
+
+// "cpu=2,mem=1,io=1,irq=/dev/ttyS1", 0 on success
+int load_parse(const char *spec, struct load_spec *out);
+void load_describe(const struct load_spec *spec, int level, char *buf, size_t len);
+// Start all workers for `level`, level 0 starts nothing
+int load_start(const struct load_spec *spec, int level);
+// Stop and join all workers, fills in achieved rates since load_start
+void load_stop(struct load_stats *stats);
+
+#endif
@@ -0,0 +1,163 @@
+// multiport.c
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+
+#include "hist.h"
+#include "multiport.h"
+#include "serial_port.h"
+
+#define MP_TIMEOUT_MS   1000
+#define MP_FRAME_MAX    4096
+#define MP_FILL_BYTE    0xA5
+
+int mp_open(struct mp_port *p, const char *dev, long baud, int frame,
+            int interval_us, int period_ms) {
+    memset(p, 0, sizeof(*p));
+    snprintf(p->dev, sizeof(p->dev), "%s", dev);
+    if (baud <= 0 || frame < 1 || frame > MP_FRAME_MAX) {
+        errno = EINVAL;
+        return -1;
+    }
+    p->frame = frame;
+    p->interval_us = interval_us;
+    p->period_ms = period_ms;
+    p->fd = open(dev, O_RDWR | O_NOCTTY);
+    if (p->fd < 0)
+        return -1;
+    if (configure_port(p->fd, baud) != 0) {
+        close(p->fd);
+        p->fd = -1;
+        return -1;
+    }
+    tcflush(p->fd, TCIOFLUSH);
+    return 0;
+}
+
+static void publish(struct mp_port *p, const struct mp_stats *s) {
+    __atomic_store_n(&p->seq, p->seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    p->pub = *s;
+    __atomic_store_n(&p->seq, p->seq + 1, __ATOMIC_RELEASE);
+}
+
+void mp_snapshot(struct mp_port *p, struct mp_stats *out) {
+    unsigned int s1, s2;
+
+    do {
+        s1 = __atomic_load_n(&p->seq, __ATOMIC_ACQUIRE);
+        *out = p->pub;
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        s2 = __atomic_load_n(&p->seq, __ATOMIC_RELAXED);
+    } while ((s1 & 1) || s1 != s2);
+}
+
+// Write one frame and wait for all of it to come back, latency in us or -1
+static double round_trip(struct mp_port *p, const unsigned char *tx,
+                         unsigned char *rx) {
+    double t0 = now_us();
+    int got = 0;
+
+    if (write(p->fd, tx, p->frame) != p->frame)
+        return -1;
+    while (got < p->frame) {
+        struct pollfd pfd = { .fd = p->fd, .events = POLLIN };
+        if (poll(&pfd, 1, MP_TIMEOUT_MS) <= 0)
+            return -1;
+        ssize_t n = read(p->fd, rx, MP_FRAME_MAX);
+        if (n < 0 && errno != EINTR && errno != EAGAIN)
+            return -1;
+        if (n > 0)
+            got += n;
+    }
+    return now_us() - t0;
+}
+
+static void *mp_thread(void *arg) {
+    struct mp_port *p = arg;
+    static __thread struct hist win;
+    unsigned char tx[MP_FRAME_MAX], rx[MP_FRAME_MAX];
+    struct mp_stats s;
+    double t_win, t_pub;
+    unsigned long bytes = 0;
+
+    memset(tx, MP_FILL_BYTE, sizeof(tx));
+    memset(&s, 0, sizeof(s));
+    hist_reset(&win);
+    t_win = now_us();
+    t_pub = t_win + p->period_ms * 1e3;
+
+    while (!p->stop) {
+        double us = round_trip(p, tx, rx);
+        if (us < 0) {
+            s.lost++;
+            tcflush(p->fd, TCIOFLUSH);
+        } else {
+            hist_add(&win, us);
+            s.frames++;
+            bytes += p->frame;
+        }
+
+        double now = now_us();
+        if (now >= t_pub) {
+            double secs = (now - t_win) / 1e6;
+            s.rtt_p50_us = hist_percentile(&win, 50);
+            s.rtt_p99_us = hist_percentile(&win, 99);
+            s.bytes_per_sec = bytes / secs;
+            s.total_frames += s.frames;
+            s.total_lost += s.lost;
+            s.total_bytes += bytes;
+            publish(p, &s);
+
+            hist_reset(&win);
+            s.frames = s.lost = 0;
+            bytes = 0;
+            t_win = now;
+            t_pub = now + p->period_ms * 1e3;
+        }
+        if (p->interval_us)
+            usleep(p->interval_us);
+    }
+    return NULL;
+}
+
+int mp_start(struct mp_port *p) {
+    p->stop = 0;
+    return pthread_create(&p->thread, NULL, mp_thread, p);
+}
+
+void mp_stop(struct mp_port *p) {
+    p->stop = 1;
+    pthread_join(p->thread, NULL);
+    mp_close(p);
+}
+
+void mp_close(struct mp_port *p) {
+    if (p->fd >= 0)
+        close(p->fd);
+    p->fd = -1;
+}
+
+int mp_run(struct mp_port *p, int n, struct hist *h) {
+    unsigned char tx[MP_FRAME_MAX], rx[MP_FRAME_MAX];
+    int i, lost = 0;
+
+    memset(tx, MP_FILL_BYTE, p->frame);
+    for (i = 0; i < n; i++) {
+        double us = round_trip(p, tx, rx);
+        if (us < 0) {
+            lost++;
+            tcflush(p->fd, TCIOFLUSH);
+        } else {
+            hist_add(h, us);
+        }
+        if (p->interval_us)
+            usleep(p->interval_us);
+    }
+    return lost;
+}
@@ -0,0 +1,49 @@
+// multiport.h
+#ifndef MULTIPORT_H
+#define MULTIPORT_H
+
+#include <pthread.h>
+
+struct hist;
+
+/*
+ * Loopback round trips on many ports at once, one thread per port. Each
+ * thread owns its histogram and publishes a summary once per period through
+ * a sequence counter, so readers never block the measurement and the
+ * measurement never waits for a reader.
+ */
+struct mp_stats {
+    double rtt_p50_us;          // last period
+    double rtt_p99_us;
+    double bytes_per_sec;       // payload bytes returned per second
+    unsigned long frames;       // completed round trips in the last period
+    unsigned long lost;
+    unsigned long long total_frames;
+    unsigned long long total_lost;
+    unsigned long long total_bytes;
+};
+
+struct mp_port {
+    char dev[64];
+    int fd;
+    int frame;                  // bytes per round trip
+    int interval_us;            // pause between round trips
+    int period_ms;              // publish period
+    pthread_t thread;
+    volatile int stop;
+    unsigned int seq;           // odd while pub is being written
+    struct mp_stats pub;
+};
+
+// Open and configure dev for raw loopback at baud
+int mp_open(struct mp_port *p, const char *dev, long baud, int frame,
+            int interval_us, int period_ms);
+int mp_start(struct mp_port *p);
+void mp_stop(struct mp_port *p);
+void mp_close(struct mp_port *p);
+// n round trips in the calling thread, latencies (us) added to h, returns the number lost
+int mp_run(struct mp_port *p, int n, struct hist *h);
+// Lock free copy of the last published summary
+void mp_snapshot(struct mp_port *p, struct mp_stats *out);
+
+#endif
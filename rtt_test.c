@@ -1,4 +1,5 @@
 // rtt_test.c
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <fcntl.h>
@@ -6,61 +7,102 @@
 #include <unistd.h>
 #include <string.h>
 #include <errno.h>
+#include <signal.h>
+#include <getopt.h>
+#include <poll.h>
+#include <pthread.h>
+#include <time.h>
 #include <sys/time.h>
 #include <sys/types.h>
+#include <sys/resource.h>
+#include <sys/ioctl.h>
+#include <linux/serial.h>
+#include <linux/tty.h>
+
+#include "hist.h"
+#include "serial_port.h"
+#include "load.h"
+#include "serial_stats.h"
+#include "serial_model.h"
 
 #define TEST_BYTE       0xA5
 #define TIMEOUT_SEC     1
 
+#define BAUD_DEFAULT            19200
+#define SWEEP_FRAME_DEFAULT     32
+#define SWEEP_ITER_DEFAULT      100
+#define LIST_MAX                16
+#define READ_SIZE_MAX           4096
+#define STREAM_RING             65536       // per-byte send timestamps
+#define ADAPT_BUDGET_DEFAULT    2000        // us
+#define ADAPT_RATE_DEFAULT      1000        // bytes/s
+#define ADAPT_SECONDS_DEFAULT   10
+#define ADAPT_WINDOW_US         100000      // arrival rate estimation window
+#define TPUT_BLOCK_DEFAULT      256
+#define PASSTHRU_LDISC_DEFAULT  N_DEVELOPMENT   // uart_passthru.ko
+#define LOAD_WARMUP_SEC         1
+#define PROBE_DEBUGFS           "/sys/kernel/debug/uart_probe"
+
+// -M: the port's serial_model.h prediction next to each result
+static const struct serial_model *model;
+
 static double time_diff_us(struct timeval start, struct timeval end) {
     return (end.tv_sec - start.tv_sec) * 1e6 + (end.tv_usec - start.tv_usec);
 }
 
-int main(int argc, char *argv[]) {
-    if (argc < 2) {
-        fprintf(stderr, "Usage: %s <serial-device>\n", argv[0]);
-        return 1;
-    }
-
-    const char *port = argv[1];
-    int fd = open(port, O_RDWR | O_NOCTTY | O_SYNC);
-    if (fd < 0) {
-        perror("open");
-        return 1;
-    }
+// Voluntary context switches of the calling thread, i.e. how often it slept
+// and was woken up again.
+static long thread_wakeups(void) {
+    struct rusage ru;
+    if (getrusage(RUSAGE_THREAD, &ru) != 0)
+        return 0;
+    return ru.ru_nvcsw;
+}
 
-    struct termios tty;
-    if (tcgetattr(fd, &tty) != 0) {
-        perror("tcgetattr");
-        close(fd);
-        return 1;
-    }
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
 
-    cfsetospeed(&tty, B19200);
-    cfsetispeed(&tty, B19200);
+// Sorts v in place and returns the p-th percentile (0..100)
+static double percentile(double *v, size_t n, double p) {
+    if (n == 0)
+        return 0;
+    qsort(v, n, sizeof(*v), cmp_double);
+    size_t idx = (size_t)(p / 100.0 * (n - 1) + 0.5);
+    return v[idx];
+}
 
-    tty.c_cflag = (tty.c_cflag & ~CSIZE) | CS8; // 8-bit chars
-    tty.c_iflag &= ~IGNBRK;                     // disable break processing
-    tty.c_lflag = 0;                            // no signaling chars, no echo
-    tty.c_oflag = 0;                            // no remapping, no delays
-    tty.c_cc[VMIN]  = 0;                        // non-blocking read
-    tty.c_cc[VTIME] = 0;
+// Predicted loopback time to the last byte of a `frame` byte write, us
+static double model_last_us(int frame) {
+    struct model_pred p;
+    model_predict(model, frame, &p);
+    return p.last_byte_ns / 1e3;
+}
 
-    tty.c_iflag &= ~(IXON | IXOFF | IXANY);     // shut off xon/xoff ctrl
-    tty.c_cflag |= (CLOCAL | CREAD);            // ignore modem controls
-    tty.c_cflag &= ~(PARENB | PARODD);          // no parity
-    tty.c_cflag &= ~CSTOPB;
-    tty.c_cflag &= ~CRTSCTS;
+static int parse_int_list(const char *csv, int *out, int max) {
+    char *copy = strdup(csv), *save = NULL, *tok;
+    int n = 0;
 
-    if (tcsetattr(fd, TCSANOW, &tty) != 0) {
-        perror("tcsetattr");
-        close(fd);
-        return 1;
+    for (tok = strtok_r(copy, ",", &save); tok; tok = strtok_r(NULL, ",", &save)) {
+        char *end;
+        long v = strtol(tok, &end, 10);
+        if (*end || v < 0 || n >= max) {
+            fprintf(stderr, "Invalid list value: '%s'\n", tok);
+            free(copy);
+            return -1;
+        }
+        out[n++] = (int)v;
     }
+    free(copy);
+    return n;
+}
 
-    // flush any old data
-    tcflush(fd, TCIOFLUSH);
-
+/*
+ * Single byte round trip, the original test. The output format is parsed
+ * by uart_probe.sh, keep it stable.
+ */
+static int run_rtt(int fd) {
     struct timeval start, end;
     gettimeofday(&start, NULL);
 
@@ -69,11 +111,9 @@ int main(int argc, char *argv[]) {
     ssize_t wlen = write(fd, &tx, 1);
     if (wlen != 1) {
         perror("write");
-        close(fd);
         return 1;
     }
 
-
     fd_set rfds;
     struct timeval timeout;
     FD_ZERO(&rfds);
@@ -85,11 +125,9 @@ int main(int argc, char *argv[]) {
     int ret = select(fd + 1, &rfds, NULL, NULL, &timeout);
     if (ret == -1) {
         perror("select");
-        close(fd);
         return 1;
     } else if (ret == 0) {
         fprintf(stderr, "Timeout waiting for response.\n");
-        close(fd);
         return 1;
     }
 
@@ -99,10 +137,1839 @@ int main(int argc, char *argv[]) {
 
     if (rlen == 1 && rx == TEST_BYTE) {
         printf("RTT: %.2f microseconds\n", time_diff_us(start, end));
+        if (model) {
+            model_header(stdout);
+            model_row(stdout, "rtt", "us", time_diff_us(start, end), model_last_us(1));
+        }
     } else {
         fprintf(stderr, "Received invalid or no byte.\n");
     }
+    return 0;
+}
 
-    close(fd);
+/* ---------------------------------------------------------------------- */
+/* VMIN / VTIME / read size sweep                                         */
+/* ---------------------------------------------------------------------- */
+
+struct sweep_result {
+    double p50_us;
+    double p99_us;
+    double bytes_per_read;
+    double wakeups_per_sec;
+    int timeouts;
+};
+
+/*
+ * Send `iters` frames of `frame_len` bytes and read each one back with the
+ * given VMIN/VTIME and read() size. Latency is measured from the write() to
+ * the read() that completes the frame.
+ */
+static int sweep_one(int fd, long baud, int vmin, int vtime, int rsize,
+                     int frame_len, int iters, struct sweep_result *res) {
+    unsigned char tx[READ_SIZE_MAX], rx[READ_SIZE_MAX];
+    double *lat = calloc(iters, sizeof(*lat));
+    long reads = 0, bytes = 0, wake0;
+    double t_start, t_total;
+    int i, nlat = 0;
+    // a VMIN that never fills stalls the frame, give up after a few frame times
+    int timeout_ms = 10 + 4 * frame_len * 10 * 1000 / baud;
+
+    if (!lat)
+        return -1;
+    if (set_vmin_vtime(fd, vmin, vtime) != 0) {
+        perror("tcsetattr");
+        free(lat);
+        return -1;
+    }
+
+    memset(tx, TEST_BYTE, frame_len);
+    memset(res, 0, sizeof(*res));
+    tcflush(fd, TCIOFLUSH);
+
+    wake0 = thread_wakeups();
+    t_start = now_us();
+
+    for (i = 0; i < iters; i++) {
+        int got = 0;
+        double t0 = now_us();
+
+        if (write(fd, tx, frame_len) != frame_len) {
+            perror("write");
+            free(lat);
+            return -1;
+        }
+
+        while (got < frame_len) {
+            struct pollfd pfd = { .fd = fd, .events = POLLIN };
+            int ret = poll(&pfd, 1, timeout_ms + vtime * 100);
+            if (ret <= 0)
+                break;
+            ssize_t n = read(fd, rx, rsize);
+            if (n < 0) {
+                if (errno == EINTR || errno == EAGAIN)
+                    continue;
+                break;
+            }
+            reads++;
+            got += n;
+        }
+
+        if (got < frame_len) {
+            res->timeouts++;
+            tcflush(fd, TCIOFLUSH);
+            continue;
+        }
+        bytes += got;
+        lat[nlat++] = now_us() - t0;
+    }
+
+    t_total = now_us() - t_start;
+    res->p50_us = percentile(lat, nlat, 50);
+    res->p99_us = percentile(lat, nlat, 99);
+    res->bytes_per_read = reads ? (double)bytes / reads : 0;
+    res->wakeups_per_sec = t_total > 0 ?
+                           (thread_wakeups() - wake0) / (t_total / 1e6) : 0;
+    free(lat);
+    return 0;
+}
+
+static int run_sweep(int fd, long baud, const int *vmins, int nvmin,
+                     const int *vtimes, int nvtime, const int *rsizes,
+                     int nrsize, int frame_len, int iters) {
+    int a, b, c;
+
+    printf("Sweep: frame=%d bytes, %d frames per combination, wire time %.0f us\n",
+           frame_len, iters, frame_len * 10 * 1e6 / baud);
+    printf("%5s %5s %6s %10s %10s %11s %10s %8s",
+           "vmin", "vtime", "rsize", "p50_us", "p99_us", "bytes/read",
+           "wakeups/s", "timeouts");
+    if (model)
+        printf(" %10s %10s", "model_us", "resid_us");
+    printf("\n");
+
+    for (a = 0; a < nvmin; a++) {
+        for (b = 0; b < nvtime; b++) {
+            for (c = 0; c < nrsize; c++) {
+                struct sweep_result res;
+
+                // poll() honours VMIN when VTIME is 0, this would never wake
+                if (vtimes[b] == 0 && vmins[a] > frame_len) {
+                    printf("%5d %5d %6d %10s\n", vmins[a], vtimes[b],
+                           rsizes[c], "skipped (vmin > frame)");
+                    continue;
+                }
+                if (vtimes[b] == 0 && vmins[a] > rsizes[c]) {
+                    printf("%5d %5d %6d %10s\n", vmins[a], vtimes[b],
+                           rsizes[c], "skipped (vmin > rsize)");
+                    continue;
+                }
+                if (sweep_one(fd, baud, vmins[a], vtimes[b], rsizes[c], frame_len,
+                              iters, &res) != 0)
+                    return 1;
+                printf("%5d %5d %6d %10.1f %10.1f %11.2f %10.0f %8d",
+                       vmins[a], vtimes[b], rsizes[c], res.p50_us, res.p99_us,
+                       res.bytes_per_read, res.wakeups_per_sec, res.timeouts);
+                if (model)
+                    printf(" %10.1f %+10.1f", model_last_us(frame_len),
+                           res.p50_us - model_last_us(frame_len));
+                printf("\n");
+            }
+        }
+    }
+    return 0;
+}
+
+/* ---------------------------------------------------------------------- */
+/* Adaptive VMIN policy                                                   */
+/* ---------------------------------------------------------------------- */
+
+struct stream_tx {
+    int fd;
+    double rate;            // bytes per second
+    double start_us;
+    double stop_us;
+    double *ts;             // send time of byte n at ts[n % STREAM_RING]
+    unsigned long sent;
+};
+
+// Paced writer, emits `rate` bytes/s until stop_us
+static void *stream_tx_thread(void *arg) {
+    struct stream_tx *tx = arg;
+    unsigned char buf[256];
+
+    memset(buf, TEST_BYTE, sizeof(buf));
+    for (;;) {
+        double now = now_us();
+        if (now >= tx->stop_us)
+            break;
+
+        unsigned long due = (unsigned long)((now - tx->start_us) * tx->rate / 1e6);
+        unsigned long sent = tx->sent;
+        if (due > sent) {
+            size_t n = due - sent;
+            if (n > sizeof(buf))
+                n = sizeof(buf);
+            for (size_t i = 0; i < n; i++)
+                tx->ts[(sent + i) % STREAM_RING] = now;
+            ssize_t w = write(tx->fd, buf, n);
+            if (w > 0)
+                __atomic_store_n(&tx->sent, sent + w, __ATOMIC_RELEASE);
+        }
+
+        // sleep until the next byte is due
+        double next = tx->start_us + (tx->sent + 1) * 1e6 / tx->rate;
+        double wait = next - now_us();
+        if (wait > 0) {
+            struct timespec ts = { .tv_sec = (time_t)(wait / 1e6),
+                                   .tv_nsec = (long)((long)wait % 1000000) * 1000 };
+            nanosleep(&ts, NULL);
+        }
+    }
+    return NULL;
+}
+
+struct adapt_result {
+    double p50_us;
+    double p99_us;
+    double bytes_per_read;
+    double reads_per_sec;
+    double wakeups_per_sec;
+    int vmin_changes;
+};
+
+/*
+ * Read a paced stream. With `adaptive` set, VMIN follows the observed arrival
+ * rate so that one wakeup collects about `budget_us` worth of bytes, and
+ * the poll() timeout bounds the latency of a partial batch. Otherwise VMIN
+ * stays at 1, one wakeup per byte, which is what a naive reader does.
+ */
+static int run_stream(int fd, double rate, double budget_us, int seconds,
+                      int rsize, int adaptive, int verbose,
+                      struct adapt_result *res) {
+    struct stream_tx tx = { .fd = fd, .rate = rate };
+    unsigned char rx[READ_SIZE_MAX];
+    size_t lat_cap = (size_t)(rate * (seconds + 1)) + 1024, nlat = 0;
+    double *lat = calloc(lat_cap, sizeof(*lat));
+    unsigned long received = 0, win_bytes = 0;
+    long reads = 0, wake0;
+    int vmin = 1, flags;
+    double t_start, win_start, next_report;
+    pthread_t thr;
+
+    tx.ts = calloc(STREAM_RING, sizeof(*tx.ts));
+    if (!lat || !tx.ts) {
+        free(lat);
+        free(tx.ts);
+        return -1;
+    }
+    memset(res, 0, sizeof(*res));
+
+    // Non-blocking reads return what is there regardless of VMIN
+    flags = fcntl(fd, F_GETFL);
+    fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+    set_vmin_vtime(fd, vmin, 0);
+    tcflush(fd, TCIOFLUSH);
+
+    t_start = win_start = now_us();
+    next_report = t_start + 1e6;
+    tx.start_us = t_start;
+    tx.stop_us = t_start + seconds * 1e6;
+    wake0 = thread_wakeups();
+    if (pthread_create(&thr, NULL, stream_tx_thread, &tx) != 0) {
+        fcntl(fd, F_SETFL, flags);
+        free(lat);
+        free(tx.ts);
+        return -1;
+    }
+
+    for (;;) {
+        double now = now_us();
+        unsigned long sent = __atomic_load_n(&tx.sent, __ATOMIC_ACQUIRE);
+        if (now >= tx.stop_us && received >= sent)
+            break;
+        if (now >= tx.stop_us + TIMEOUT_SEC * 1e6)
+            break;  // lost bytes, don't wait forever
+
+        struct timespec to = { .tv_sec = (time_t)(budget_us / 1e6),
+                               .tv_nsec = (long)((long)budget_us % 1000000) * 1000 };
+        struct pollfd pfd = { .fd = fd, .events = POLLIN };
+        ppoll(&pfd, 1, &to, NULL);
+
+        ssize_t n = read(fd, rx, rsize);
+        if (n > 0) {
+            now = now_us();
+            reads++;
+            // latency of the oldest byte in this chunk
+            if (nlat < lat_cap)
+                lat[nlat++] = now - tx.ts[received % STREAM_RING];
+            received += n;
+            win_bytes += n;
+        }
+
+        now = now_us();
+        if (adaptive && now - win_start >= ADAPT_WINDOW_US) {
+            double arrival = win_bytes * 1e6 / (now - win_start);
+            int target = (int)(arrival * budget_us / 1e6);
+            if (target < 1)
+                target = 1;
+            if (target > 255)
+                target = 255;
+            if (target > rsize)
+                target = rsize;
+            // hysteresis, every tcsetattr() is a syscall too
+            if (abs(target - vmin) * 4 > vmin) {
+                vmin = target;
+                set_vmin_vtime(fd, vmin, 0);
+                res->vmin_changes++;
+            }
+            win_start = now;
+            win_bytes = 0;
+        }
+
+        if (verbose && now >= next_report) {
+            printf("  t=%.0fs rx=%lu vmin=%d reads=%ld\n",
+                   (now - t_start) / 1e6, received, vmin, reads);
+            next_report += 1e6;
+        }
+    }
+
+    double t_total = now_us() - t_start;
+    long wakeups = thread_wakeups() - wake0;
+
+    pthread_join(thr, NULL);
+    fcntl(fd, F_SETFL, flags);
+    set_vmin_vtime(fd, 0, 0);
+
+    res->p50_us = percentile(lat, nlat, 50);
+    res->p99_us = percentile(lat, nlat, 99);
+    res->bytes_per_read = reads ? (double)received / reads : 0;
+    res->reads_per_sec = reads / (t_total / 1e6);
+    res->wakeups_per_sec = wakeups / (t_total / 1e6);
+    if (received < tx.sent)
+        fprintf(stderr, "Lost %lu of %lu bytes\n", tx.sent - received, tx.sent);
+
+    free(lat);
+    free(tx.ts);
     return 0;
 }
+
+static int run_adaptive(int fd, double rate, double budget_us, int seconds,
+                        int rsize, int verbose) {
+    struct adapt_result fixed, adapt;
+
+    printf("Stream: %.0f bytes/s for %d s, latency budget %.0f us\n",
+           rate, seconds, budget_us);
+    if (run_stream(fd, rate, budget_us, seconds, rsize, 0, verbose, &fixed) ||
+        run_stream(fd, rate, budget_us, seconds, rsize, 1, verbose, &adapt)) {
+        fprintf(stderr, "Stream test failed\n");
+        return 1;
+    }
+
+    printf("%-9s %10s %10s %11s %8s %10s %7s\n", "policy", "p50_us",
+           "p99_us", "bytes/read", "reads/s", "wakeups/s", "changes");
+    printf("%-9s %10.1f %10.1f %11.2f %8.0f %10.0f %7d\n", "vmin=1",
+           fixed.p50_us, fixed.p99_us, fixed.bytes_per_read,
+           fixed.reads_per_sec, fixed.wakeups_per_sec, fixed.vmin_changes);
+    printf("%-9s %10.1f %10.1f %11.2f %8.0f %10.0f %7d\n", "adaptive",
+           adapt.p50_us, adapt.p99_us, adapt.bytes_per_read,
+           adapt.reads_per_sec, adapt.wakeups_per_sec, adapt.vmin_changes);
+    return 0;
+}
+
+/* ---------------------------------------------------------------------- */
+/* Throughput and ASYNC_LOW_LATENCY comparison                            */
+/* ---------------------------------------------------------------------- */
+
+// One byte round trip in microseconds, or -1 on timeout
+static double rtt_once(int fd) {
+    unsigned char tx = TEST_BYTE, rx;
+    struct pollfd pfd = { .fd = fd, .events = POLLIN };
+    double t0 = now_us();
+
+    if (write(fd, &tx, 1) != 1)
+        return -1;
+    if (poll(&pfd, 1, TIMEOUT_SEC * 1000) <= 0)
+        return -1;
+    if (read(fd, &rx, 1) != 1 || rx != TEST_BYTE)
+        return -1;
+    return now_us() - t0;
+}
+
+struct tput_tx {
+    int fd;
+    int block;
+    double stop_us;             // set before the thread starts
+    volatile int stop;          // ends the run early
+    unsigned long sent;
+    uint64_t cpu_ns;            // this thread's CPU time, updated as it runs
+};
+
+// CPU time of the calling thread in ns
+static uint64_t thread_cpu_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// Unpaced writer, keeps the TX path full until stop_us or stop
+static void *tput_tx_thread(void *arg) {
+    struct tput_tx *tx = arg;
+    unsigned char buf[READ_SIZE_MAX];
+    unsigned int writes = 0;
+
+    memset(buf, TEST_BYTE, sizeof(buf));
+    while (!tx->stop && now_us() < tx->stop_us) {
+        ssize_t w = write(tx->fd, buf, tx->block);
+        if (w < 0 && errno != EINTR && errno != EAGAIN)
+            break;
+        if (w > 0)
+            __atomic_add_fetch(&tx->sent, w, __ATOMIC_RELEASE);
+        if (!(++writes & 63))
+            __atomic_store_n(&tx->cpu_ns, thread_cpu_ns(), __ATOMIC_RELAXED);
+    }
+    __atomic_store_n(&tx->cpu_ns, thread_cpu_ns(), __ATOMIC_RELAXED);
+    return NULL;
+}
+
+/*
+ * CPU spent on a throughput run: the reading thread, the writer thread and
+ * interrupt handling. The threads are counted on their own, so --load
+ * workers in the same process are left out; irq and softirq time is system
+ * wide and includes whatever interrupts the load raises.
+ */
+struct cpu_sample {
+    uint64_t threads_ns;
+    unsigned long long irq;     // irq + softirq clock ticks, all CPUs
+};
+
+// Call from the reading thread
+static int cpu_sample_read(struct cpu_sample *s, const struct tput_tx *tx) {
+    unsigned long long v[7] = { 0 };
+    FILE *f;
+
+    s->threads_ns = thread_cpu_ns() + __atomic_load_n(&tx->cpu_ns, __ATOMIC_RELAXED);
+    s->irq = 0;
+    f = fopen("/proc/stat", "r");
+    if (!f)
+        return -1;
+    int n = fscanf(f, "cpu %llu %llu %llu %llu %llu %llu %llu",
+                   &v[0], &v[1], &v[2], &v[3], &v[4], &v[5], &v[6]);
+    fclose(f);
+    if (n < 7)
+        return -1;
+    // user nice system idle iowait irq softirq
+    s->irq = v[5] + v[6];
+    return 0;
+}
+
+// CPU time in microseconds spent on the run between a and b
+static double cpu_busy_us(const struct cpu_sample *a, const struct cpu_sample *b) {
+    return (b->threads_ns - a->threads_ns) / 1e3 +
+           (b->irq - a->irq) * 1e6 / sysconf(_SC_CLK_TCK);
+}
+
+struct tput_result {
+    unsigned long bytes;        // delivered to userspace
+    long driver_bytes;          // received by the driver, -1 if unknown
+    double bytes_per_sec;
+    double cpu_us_per_byte;
+    double irqs_per_byte;       // on the port's IRQ line, shared or not, -1 if unknown
+};
+
+// The port's IRQ from TIOCGSERIAL, -1 if there is none
+static int port_irq(int fd) {
+    struct serial_struct ss;
+    if (ioctl(fd, TIOCGSERIAL, &ss) != 0 || ss.irq <= 0 || ss.irq >= IRQ_MAX)
+        return -1;
+    return ss.irq;
+}
+
+// Bytes received by the UART driver, independent of the line discipline
+static long icount_rx(int fd) {
+    struct serial_icounter_struct ic;
+    if (ioctl(fd, TIOCGICOUNT, &ic) != 0)
+        return -1;
+    return (unsigned int)ic.rx;
+}
+
+/*
+ * One thread writes `block` sized chunks to tx_fd as fast as the tty accepts
+ * them, the caller reads them back from rx_fd. With `readable` clear (a line
+ * discipline that swallows data, like N_NULL) nothing is read and the
+ * driver's receive counter is used instead. CPU cost is the two threads'
+ * own time plus irq and softirq time from /proc/stat, which covers the
+ * interrupt and flip buffer work in the kernel (see struct cpu_sample).
+ */
+static int run_throughput_pair(int rx_fd, int tx_fd, int readable, int seconds,
+                               int block, struct tput_result *res) {
+    static uint64_t irqs0[IRQ_MAX], irqs1[IRQ_MAX];
+    struct tput_tx tx = { .fd = tx_fd, .block = block };
+    struct cpu_sample c0, c1;
+    unsigned char rx[READ_SIZE_MAX];
+    unsigned long received = 0;
+    long icount0, icount1;
+    double t0, t_last;
+    pthread_t thr;
+    int irq = port_irq(rx_fd), have_irqs;
+
+    memset(res, 0, sizeof(*res));
+    if (readable)
+        set_vmin_vtime(rx_fd, 0, 0);
+    tcflush(rx_fd, TCIOFLUSH);
+    if (tx_fd != rx_fd)
+        tcflush(tx_fd, TCIOFLUSH);
+
+    icount0 = icount_rx(rx_fd);
+    have_irqs = irq >= 0 && irq_counts_read(irqs0, IRQ_MAX) == 0;
+    cpu_sample_read(&c0, &tx);
+    t0 = t_last = now_us();
+    tx.stop_us = t0 + seconds * 1e6;
+    if (pthread_create(&thr, NULL, tput_tx_thread, &tx) != 0)
+        return -1;
+
+    for (;;) {
+        struct pollfd pfd = { .fd = rx_fd, .events = POLLIN };
+        double now;
+
+        if (readable) {
+            int ret = poll(&pfd, 1, 100);
+            now = now_us();
+            if (ret > 0) {
+                ssize_t n = read(rx_fd, rx, sizeof(rx));
+                if (n > 0) {
+                    received += n;
+                    t_last = now;
+                }
+            }
+        } else {
+            long c;
+            usleep(100000);
+            now = now_us();
+            c = icount_rx(rx_fd);
+            if (c >= 0 && (unsigned long)(c - icount0) != received) {
+                received = c - icount0;
+                t_last = now;
+            }
+        }
+        if (now >= tx.stop_us) {
+            unsigned long sent = __atomic_load_n(&tx.sent, __ATOMIC_ACQUIRE);
+            if (received >= sent || now - t_last > TIMEOUT_SEC * 1e6)
+                break;
+        }
+    }
+
+    pthread_join(thr, NULL);
+    cpu_sample_read(&c1, &tx);
+    icount1 = icount_rx(rx_fd);
+    have_irqs = have_irqs && irq_counts_read(irqs1, IRQ_MAX) == 0;
+
+    res->bytes = readable ? received : 0;
+    res->driver_bytes = (icount0 >= 0 && icount1 >= 0) ? icount1 - icount0 : -1;
+    res->bytes_per_sec = t_last > t0 ? received * 1e6 / (t_last - t0) : 0;
+    res->cpu_us_per_byte = received ? cpu_busy_us(&c0, &c1) / received : 0;
+    res->irqs_per_byte = have_irqs && received ?
+        (double)(irqs1[irq] - irqs0[irq]) / received : -1;
+    if (received < tx.sent)
+        fprintf(stderr, "Lost %lu of %lu bytes\n", tx.sent - received, tx.sent);
+    return 0;
+}
+
+// Loopback throughput on a single port
+static int run_throughput(int fd, int seconds, int block, struct tput_result *res) {
+    return run_throughput_pair(fd, fd, 1, seconds, block, res);
+}
+
+static int set_low_latency(int fd, const struct serial_struct *orig, int on) {
+    struct serial_struct ss = *orig;
+
+    if (on)
+        ss.flags |= ASYNC_LOW_LATENCY;
+    else
+        ss.flags &= ~ASYNC_LOW_LATENCY;
+    return ioctl(fd, TIOCSSERIAL, &ss);
+}
+
+/*
+ * Measure RTT and throughput with ASYNC_LOW_LATENCY cleared and then set.
+ * The flag is read back after setting it, kernels that ignore it show up
+ * as "off" in the readback column or as identical numbers.
+ */
+static int run_low_latency(int fd, int iters, int seconds, int block) {
+    struct serial_struct orig, now;
+    double *rtt = calloc(iters, sizeof(*rtt));
+    int mode, ret = 0;
+
+    if (!rtt)
+        return 1;
+    if (ioctl(fd, TIOCGSERIAL, &orig) != 0) {
+        perror("TIOCGSERIAL");
+        free(rtt);
+        return 1;
+    }
+
+    printf("ASYNC_LOW_LATENCY comparison: original flags %#x (low_latency %s)\n",
+           orig.flags, (orig.flags & ASYNC_LOW_LATENCY) ? "on" : "off");
+    printf("%-4s %8s %10s %10s %8s %12s %13s\n", "flag", "readback",
+           "rtt_p50", "rtt_p99", "lost", "bytes/s", "cpu_us/byte");
+
+    for (mode = 0; mode <= 1; mode++) {
+        struct tput_result tput;
+        int i, n = 0, lost = 0;
+
+        if (set_low_latency(fd, &orig, mode) != 0) {
+            perror("TIOCSSERIAL");
+            ret = 1;
+            break;
+        }
+        if (ioctl(fd, TIOCGSERIAL, &now) != 0)
+            now.flags = 0;
+
+        tcflush(fd, TCIOFLUSH);
+        for (i = 0; i < iters; i++) {
+            double us = rtt_once(fd);
+            if (us < 0) {
+                lost++;
+                tcflush(fd, TCIOFLUSH);
+                continue;
+            }
+            rtt[n++] = us;
+        }
+
+        if (run_throughput(fd, seconds, block, &tput) != 0) {
+            ret = 1;
+            break;
+        }
+
+        printf("%-4s %8s %10.1f %10.1f %8d %12.0f %13.3f\n",
+               mode ? "on" : "off",
+               (now.flags & ASYNC_LOW_LATENCY) ? "on" : "off",
+               percentile(rtt, n, 50), percentile(rtt, n, 99), lost,
+               tput.bytes_per_sec, tput.cpu_us_per_byte);
+    }
+
+    if (ioctl(fd, TIOCSSERIAL, &orig) != 0) {
+        perror("TIOCSSERIAL (restore)");
+        ret = 1;
+    }
+    free(rtt);
+    return ret;
+}
+
+/* ---------------------------------------------------------------------- */
+/* FIFO on/off comparison                                                 */
+/* ---------------------------------------------------------------------- */
+
+// Through uart_probe.ko's fifo_disable, which works on an open port
+static int set_fifo_disabled(const char *port, int off) {
+    const char *name = strrchr(port, '/');
+    FILE *f;
+
+    f = fopen(PROBE_DEBUGFS "/select_dev", "w");
+    if (!f)
+        return -1;
+    fprintf(f, "%s\n", name ? name + 1 : port);
+    if (fclose(f) != 0)
+        return -1;
+    f = fopen(PROBE_DEBUGFS "/fifo_disable", "w");
+    if (!f)
+        return -1;
+    fprintf(f, "%d\n", off);
+    return fclose(f) != 0 ? -1 : 0;
+}
+
+/*
+ * Measure RTT, throughput and interrupts per byte with the FIFO on and
+ * then off (16450 mode, one byte per interrupt each way). The FIFO is
+ * turned back on at the end whatever happened.
+ */
+static int run_fifo_compare(int fd, const char *port, int iters, int seconds,
+                            int block) {
+    double *rtt = calloc(iters, sizeof(*rtt));
+    double rtt50[2] = { 0 };
+    struct tput_result tputs[2];
+    int off, ret = 0;
+
+    if (!rtt)
+        return 1;
+    memset(tputs, 0, sizeof(tputs));
+
+    printf("FIFO comparison (uart_probe fifo_disable)\n");
+    printf("%-4s %10s %10s %8s %12s %13s %10s\n", "fifo", "rtt_p50",
+           "rtt_p99", "lost", "bytes/s", "cpu_us/byte", "irqs/byte");
+
+    for (off = 0; off <= 1; off++) {
+        struct tput_result *tput = &tputs[off];
+        int i, n = 0, lost = 0;
+
+        if (set_fifo_disabled(port, off) != 0) {
+            perror(PROBE_DEBUGFS "/fifo_disable");
+            ret = 1;
+            break;
+        }
+
+        tcflush(fd, TCIOFLUSH);
+        for (i = 0; i < iters; i++) {
+            double us = rtt_once(fd);
+            if (us < 0) {
+                lost++;
+                tcflush(fd, TCIOFLUSH);
+                continue;
+            }
+            rtt[n++] = us;
+        }
+
+        if (run_throughput(fd, seconds, block, tput) != 0) {
+            ret = 1;
+            break;
+        }
+
+        rtt50[off] = percentile(rtt, n, 50);
+        printf("%-4s %10.1f %10.1f %8d %12.0f %13.3f %10.3f\n",
+               off ? "off" : "on", rtt50[off],
+               percentile(rtt, n, 99), lost, tput->bytes_per_sec,
+               tput->cpu_us_per_byte, tput->irqs_per_byte);
+    }
+
+    if (model && !ret) {
+        // without the FIFO every byte is its own trigger and THRE
+        struct serial_model m = *model;
+        struct model_pred p1, ps;
+
+        model_header(stdout);
+        for (off = 0; off <= 1; off++) {
+            if (off)
+                m.rx_fifo = m.tx_fifo = m.rx_trig = m.tx_trig = 1;
+            model_predict(&m, 1, &p1);
+            model_predict(&m, 0, &ps);
+            printf("fifo %s\n", off ? "off" : "on");
+            model_row(stdout, "rtt_p50", "us", rtt50[off], p1.last_byte_ns / 1e3);
+            model_row(stdout, "throughput", "bytes/s", tputs[off].bytes_per_sec, ps.max_bps);
+            if (tputs[off].irqs_per_byte >= 0)
+                model_row(stdout, "irqs/byte", "irqs", tputs[off].irqs_per_byte,
+                          ps.irqs_per_byte);
+        }
+    }
+
+    if (set_fifo_disabled(port, 0) != 0) {
+        perror(PROBE_DEBUGFS "/fifo_disable (restore)");
+        ret = 1;
+    }
+    free(rtt);
+    return ret;
+}
+
+/* ---------------------------------------------------------------------- */
+/* Line discipline comparison                                             */
+/* ---------------------------------------------------------------------- */
+
+struct ldisc_case {
+    const char *name;
+    int num;
+    int readable;       // read()/write() work, N_NULL rejects both
+};
+
+/*
+ * Switch the port between n_tty, N_NULL and the uart_passthru ldisc with
+ * TIOCSETD and measure each. Termios is set up under n_tty beforehand since
+ * N_NULL does not handle termios ioctls. Without a peer the port sends to
+ * itself, which N_NULL cannot do; with a peer all cases are fed from it.
+ */
+static int run_ldisc_compare(int fd, int peer_fd, int passthru_num, int iters,
+                             int seconds, int block) {
+    struct ldisc_case cases[] = {
+        { "n_tty",         N_TTY,        1 },
+        { "N_NULL",        N_NULL,       0 },
+        { "uart_passthru", passthru_num, 1 },
+    };
+    double *rtt = calloc(iters, sizeof(*rtt));
+    int orig, ret = 0;
+    size_t c;
+
+    if (!rtt)
+        return 1;
+    if (ioctl(fd, TIOCGETD, &orig) != 0) {
+        perror("TIOCGETD");
+        free(rtt);
+        return 1;
+    }
+
+    printf("Line discipline comparison: sender %s, original ldisc %d\n",
+           peer_fd >= 0 ? "peer" : "loopback", orig);
+    printf("%-14s %10s %10s %12s %12s %13s\n", "ldisc", "rtt_p50",
+           "rtt_p99", "user_B/s", "driver_B", "cpu_us/byte");
+
+    for (c = 0; c < sizeof(cases) / sizeof(cases[0]); c++) {
+        struct ldisc_case *lc = &cases[c];
+        struct tput_result tput;
+        int i, n = 0, num = lc->num;
+
+        if (ioctl(fd, TIOCSETD, &num) != 0) {
+            printf("%-14s unavailable (%s)\n", lc->name, strerror(errno));
+            continue;
+        }
+
+        if (lc->readable) {
+            tcflush(fd, TCIOFLUSH);
+            for (i = 0; i < iters; i++) {
+                double us = rtt_once(fd);
+                if (us >= 0)
+                    rtt[n++] = us;
+            }
+        }
+
+        if (!lc->readable && peer_fd < 0) {
+            printf("%-14s %10s %10s %12s %12s %13s\n", lc->name, "n/a", "n/a",
+                   "n/a", "n/a", "needs --peer");
+            continue;
+        }
+
+        if (run_throughput_pair(fd, peer_fd >= 0 ? peer_fd : fd, lc->readable,
+                                seconds, block, &tput) != 0) {
+            ret = 1;
+            break;
+        }
+
+        char p50[16] = "n/a", p99[16] = "n/a", user[16] = "n/a";
+        if (n) {
+            snprintf(p50, sizeof(p50), "%.1f", percentile(rtt, n, 50));
+            snprintf(p99, sizeof(p99), "%.1f", percentile(rtt, n, 99));
+        }
+        if (lc->readable)
+            snprintf(user, sizeof(user), "%.0f", tput.bytes_per_sec);
+        printf("%-14s %10s %10s %12s %12ld %13.3f\n", lc->name, p50, p99,
+               user, tput.driver_bytes, tput.cpu_us_per_byte);
+    }
+
+    if (ioctl(fd, TIOCSETD, &orig) != 0) {
+        perror("TIOCSETD (restore)");
+        ret = 1;
+    }
+    free(rtt);
+    return ret;
+}
+
+/* ---------------------------------------------------------------------- */
+/* Passive receive: read chunk size and inter-read gap histograms         */
+/* ---------------------------------------------------------------------- */
+
+static volatile sig_atomic_t stop_requested;
+
+static void on_sigint(int sig) {
+    (void)sig;
+    stop_requested = 1;
+}
+
+struct flood_tx {
+    int fd;
+    volatile int stop;
+};
+
+// Keeps the peer's TX path full until told to stop
+static void *flood_tx_thread(void *arg) {
+    struct flood_tx *tx = arg;
+    unsigned char buf[READ_SIZE_MAX];
+
+    memset(buf, TEST_BYTE, sizeof(buf));
+    while (!tx->stop) {
+        if (write(tx->fd, buf, sizeof(buf)) < 0 && errno != EINTR)
+            break;
+    }
+    return NULL;
+}
+
+/*
+ * Read whatever arrives for `seconds`, one blocking read() per wakeup, and
+ * histogram how many bytes each read() returned and the time since the
+ * previous one. With the reader keeping up, chunk sizes follow the RX FIFO
+ * trigger level (one flip buffer push per interrupt), which makes a
+ * trigger change visible from userspace.
+ */
+static int capture_chunks(int fd, int seconds) {
+    static struct hist chunks, gaps;
+    unsigned char rx[READ_SIZE_MAX];
+    unsigned long bytes = 0;
+    double t0, t_prev = 0, t_end;
+
+    hist_reset(&chunks);
+    hist_reset(&gaps);
+    set_vmin_vtime(fd, 1, 0);
+    tcflush(fd, TCIFLUSH);
+
+    t0 = now_us();
+    t_end = t0 + seconds * 1e6;
+    while (!stop_requested && now_us() < t_end) {
+        struct pollfd pfd = { .fd = fd, .events = POLLIN };
+        if (poll(&pfd, 1, 100) <= 0)
+            continue;
+
+        ssize_t n = read(fd, rx, sizeof(rx));
+        double now = now_us();
+        if (n <= 0)
+            continue;
+
+        hist_add(&chunks, n);
+        if (t_prev > 0)
+            hist_add(&gaps, now - t_prev);
+        t_prev = now;
+        bytes += n;
+    }
+
+    double secs = (now_us() - t0) / 1e6;
+    printf("  %lu bytes in %llu reads over %.1f s: %.0f bytes/s, %.2f bytes/read\n",
+           bytes, (unsigned long long)chunks.count, secs, bytes / secs,
+           hist_mean(&chunks));
+    if (!chunks.count)
+        return 0;
+    printf("  chunk size: p50 %.0f  p99 %.0f  max %llu\n",
+           hist_percentile(&chunks, 50), hist_percentile(&chunks, 99),
+           (unsigned long long)chunks.max);
+    hist_print(stdout, &chunks, "B");
+    printf("  inter-read gap: p50 %.0f us  p99 %.0f us  max %llu us\n",
+           hist_percentile(&gaps, 50), hist_percentile(&gaps, 99),
+           (unsigned long long)gaps.max);
+    hist_print(stdout, &gaps, "us");
+    return 0;
+}
+
+/*
+ * Passive receive for each RX trigger in `trigs` (or once with the current
+ * setting). The trigger is written to the fifo_control sysfs attribute after
+ * the port is open, since opening it reprograms the FCR.
+ */
+static int run_passive(int fd, const char *dev, int peer_fd, const int *trigs,
+                       int ntrig, int seconds) {
+    struct flood_tx flood = { .fd = peer_fd };
+    pthread_t thr;
+    char path[256];
+    int i, ret = 0;
+
+    tty_sysfs_path(dev, "rx_trig_bytes", path, sizeof(path));
+    signal(SIGINT, on_sigint);
+
+    if (peer_fd >= 0 && pthread_create(&thr, NULL, flood_tx_thread, &flood) != 0)
+        return 1;
+
+    for (i = 0; i < (ntrig ? ntrig : 1) && !stop_requested; i++) {
+        if (ntrig && sysfs_write_int(path, trigs[i]) != 0) {
+            fprintf(stderr, "Cannot set %s to %d: %s\n", path, trigs[i],
+                    strerror(errno));
+            ret = 1;
+            break;
+        }
+
+        int cur = sysfs_read_int(path);
+        if (cur >= 0)
+            printf("rx_trig_bytes=%d\n", cur);
+        else
+            printf("rx_trig_bytes=unknown (no fifo_control sysfs)\n");
+        capture_chunks(fd, seconds);
+    }
+
+    if (peer_fd >= 0) {
+        flood.stop = 1;
+        tcflush(peer_fd, TCOFLUSH);
+        pthread_join(thr, NULL);
+    }
+    return ret;
+}
+
+/* ---------------------------------------------------------------------- */
+/* Cross-port RTT against an echo responder                               */
+/* ---------------------------------------------------------------------- */
+
+/*
+ * Frames are ECHO_MAGIC, total length, sequence, payload. The responder
+ * sends each frame back as it came, in one write(). Its turnaround runs
+ * from the poll() wakeup that led to the read() completing the frame until
+ * that write() has returned. Once the echo is on the wire it waits
+ * ECHO_GAP_CHARS character times, past the initiator's character timeout,
+ * and then sends the turnaround as a separate ECHO_TRAILER message. That
+ * way the trailer's bytes cannot raise the interrupt that delivers the
+ * end of the frame. The initiator times the round trip up to the last
+ * echoed byte and subtracts the turnaround.
+ */
+#define ECHO_MAGIC          0xE5
+#define ECHO_HDR            3
+#define ECHO_TRAILER        4       // sequence, turnaround in 100 ns units (24 bit LE)
+#define ECHO_TURN_MAX       0xffffff
+#define ECHO_GAP_CHARS      16
+#define ECHO_FRAME_MAX      255
+#define ECHO_TIMEOUT_MS     1000
+
+struct echo_responder {
+    int fd;
+    long baud;
+    int verbose;
+    volatile int stop;
+    unsigned long frames;
+    unsigned long resyncs;          // bytes dropped looking for a frame start
+    double *turn_us;                // last STREAM_RING turnarounds
+};
+
+// Reflect frames until stopped, returns 0 or -1 on a read/write error
+static int echo_serve(struct echo_responder *er) {
+    unsigned char buf[ECHO_FRAME_MAX + ECHO_TRAILER];
+    double t_report = now_us() + 1e6;
+    useconds_t gap_us = ECHO_GAP_CHARS * 10 * 1000000LL / er->baud;
+    unsigned char trailer[ECHO_TRAILER];
+    int got = 0;
+
+    while (!er->stop && !stop_requested) {
+        struct pollfd pfd = { .fd = er->fd, .events = POLLIN };
+        int want = got < 2 ? ECHO_HDR : buf[1];
+
+        if (poll(&pfd, 1, 100) <= 0) {
+            got = 0;                // a partial frame that stalled is gone
+            continue;
+        }
+        double t_wake = now_us();
+        ssize_t n = read(er->fd, buf + got, want - got);
+        if (n < 0) {
+            if (errno == EINTR || errno == EAGAIN)
+                continue;
+            perror("read");
+            return -1;
+        }
+        got += n;
+
+        // drop bytes until a magic byte with a sane length leads the buffer
+        while (got > 0 && (buf[0] != ECHO_MAGIC ||
+                           (got > 1 && buf[1] < ECHO_HDR))) {
+            memmove(buf, buf + 1, --got);
+            er->resyncs++;
+        }
+        if (got < ECHO_HDR || got < buf[1])
+            continue;
+
+        int len = buf[1];
+        if (write(er->fd, buf, len) != len) {
+            perror("write");
+            return -1;
+        }
+        double t_tx = now_us();
+        uint32_t turn = (uint32_t)((t_tx - t_wake) * 10);
+        if (turn > ECHO_TURN_MAX)
+            turn = ECHO_TURN_MAX;
+
+        // the echo has to be delivered on its own before the trailer starts
+        tcdrain(er->fd);
+        usleep(gap_us);
+        trailer[0] = buf[2];
+        trailer[1] = turn;
+        trailer[2] = turn >> 8;
+        trailer[3] = turn >> 16;
+        if (write(er->fd, trailer, ECHO_TRAILER) != ECHO_TRAILER) {
+            perror("write");
+            return -1;
+        }
+        if (er->turn_us)
+            er->turn_us[er->frames % STREAM_RING] = turn / 10.0;
+        er->frames++;
+        got = 0;
+
+        if (er->verbose && t_tx >= t_report) {
+            fprintf(stderr, "  %lu frames, %lu resync bytes\n", er->frames, er->resyncs);
+            t_report = t_tx + 1e6;
+        }
+    }
+    return 0;
+}
+
+static void echo_report(struct echo_responder *er) {
+    size_t n = er->frames < STREAM_RING ? er->frames : STREAM_RING;
+
+    printf("Echo: %lu frames, %lu resync bytes, turnaround p50 %.1f p99 %.1f us\n",
+           er->frames, er->resyncs, percentile(er->turn_us, n, 50),
+           percentile(er->turn_us, n, 99));
+}
+
+// --echo: responder on its own, until SIGINT
+static int run_echo(int fd, long baud, int verbose) {
+    struct echo_responder er = { .fd = fd, .baud = baud, .verbose = verbose };
+    int ret;
+
+    er.turn_us = calloc(STREAM_RING, sizeof(*er.turn_us));
+    if (!er.turn_us)
+        return 1;
+    signal(SIGINT, on_sigint);
+    signal(SIGTERM, on_sigint);
+    printf("Echoing on fd %d, Ctrl-C to stop\n", fd);
+    fflush(stdout);
+    tcflush(fd, TCIOFLUSH);
+    ret = echo_serve(&er) != 0;
+    echo_report(&er);
+    free(er.turn_us);
+    return ret;
+}
+
+static void *echo_thread(void *arg) {
+    echo_serve(arg);
+    return NULL;
+}
+
+/*
+ * One frame out, the echo and then the trailer back. RTT in us, -1 on
+ * timeout. *turn_us is the responder's turnaround, -1 if the trailer did
+ * not arrive or was for another frame.
+ */
+static double echo_once(int fd, int len, unsigned char seq, double *turn_us) {
+    unsigned char tx[ECHO_FRAME_MAX], rx[ECHO_FRAME_MAX + ECHO_TRAILER];
+    int got = 0, need = len + ECHO_TRAILER;
+    double t0, rtt = -1;
+
+    *turn_us = -1;
+
+    tx[0] = ECHO_MAGIC;
+    tx[1] = len;
+    tx[2] = seq;
+    memset(tx + ECHO_HDR, TEST_BYTE, len - ECHO_HDR);
+
+    t0 = now_us();
+    if (write(fd, tx, len) != len)
+        return -1;
+    while (got < need) {
+        struct pollfd pfd = { .fd = fd, .events = POLLIN };
+        if (poll(&pfd, 1, ECHO_TIMEOUT_MS) <= 0)
+            break;
+        ssize_t n = read(fd, rx + got, need - got);
+        if (n < 0) {
+            if (errno == EINTR || errno == EAGAIN)
+                continue;
+            break;
+        }
+        got += n;
+        if (rtt < 0 && got >= len)
+            rtt = now_us() - t0;
+    }
+    if (got < len || memcmp(tx, rx, len) != 0)
+        return -1;
+    if (got == need && rx[len] == seq)
+        *turn_us = (rx[len + 1] | rx[len + 2] << 8 |
+                    (uint32_t)rx[len + 3] << 16) / 10.0;
+    return rtt;
+}
+
+static void cross_row(const char *name, double *v, int n) {
+    double p50 = percentile(v, n, 50), p99 = percentile(v, n, 99);
+    printf("%-12s %10.1f %10.1f %10.1f\n", name, p50, p99, n ? v[n - 1] : 0);
+}
+
+/*
+ * --cross: framed round trips to a responder on another UART, either
+ * another rtt_test --echo or, with --peer, a thread of this one.
+ */
+static int run_cross(int fd, int peer_fd, long baud, int frame_len, int iters) {
+    struct echo_responder er = { .fd = peer_fd, .baud = baud };
+    double *rtt = calloc(iters, sizeof(*rtt));
+    double *turn = calloc(iters, sizeof(*turn));
+    double *net = calloc(iters, sizeof(*net));
+    pthread_t thr;
+    int i, n = 0, nt = 0, lost = 0, ret = 0;
+
+    if (!rtt || !turn || !net) {
+        ret = 1;
+        goto out;
+    }
+    if (frame_len < ECHO_HDR)
+        frame_len = ECHO_HDR;
+    if (frame_len > ECHO_FRAME_MAX)
+        frame_len = ECHO_FRAME_MAX;
+    tcflush(fd, TCIOFLUSH);
+    if (peer_fd >= 0) {
+        tcflush(peer_fd, TCIOFLUSH);
+        if (pthread_create(&thr, NULL, echo_thread, &er) != 0) {
+            ret = 1;
+            goto out;
+        }
+    }
+
+    for (i = 0; i < iters; i++) {
+        double t, us = echo_once(fd, frame_len, i, &t);
+        if (us < 0) {
+            lost++;
+            usleep(ECHO_TIMEOUT_MS * 100);  // let a late echo land, then drop it
+            tcflush(fd, TCIOFLUSH);
+            continue;
+        }
+        rtt[n++] = us;
+        if (t >= 0) {
+            turn[nt] = t;
+            net[nt] = us - t;
+            nt++;
+        }
+    }
+
+    if (peer_fd >= 0) {
+        er.stop = 1;
+        pthread_join(thr, NULL);
+    }
+
+    printf("Cross-port: %d byte frames, %d round trips, %d lost, %s responder\n",
+           frame_len, n, lost, peer_fd >= 0 ? "--peer" : "external");
+    printf("%-12s %10s %10s %10s\n", "", "p50_us", "p99_us", "max_us");
+    cross_row("rtt", rtt, n);
+    cross_row("turnaround", turn, nt);
+    cross_row("rtt - turn", net, nt);
+    printf("%-12s %10.1f\n", "wire", 2.0 * frame_len * 10 * 1e6 / baud);
+    if (model && nt) {
+        // the frame one way and back, both ends alike
+        model_header(stdout);
+        model_row(stdout, "rtt - turn", "us", percentile(net, nt, 50),
+                  2 * model_last_us(frame_len));
+    }
+    ret = n ? 0 : 1;
+out:
+    free(rtt);
+    free(turn);
+    free(net);
+    return ret;
+}
+
+/* ---------------------------------------------------------------------- */
+/* Soak: rolling windows, cumulative counters, drift and step detection   */
+/* ---------------------------------------------------------------------- */
+
+#define SOAK_WINDOW_DEFAULT     60      // s
+#define SOAK_INTERVAL_DEFAULT   10      // ms between round trips
+#define SOAK_BASELINE_WINDOWS   5
+#define SOAK_STEP_PCT           25.0    // window vs. recent average
+#define SOAK_DRIFT_PCT          15.0    // recent average vs. baseline
+#define SOAK_EWMA_ALPHA         0.1
+
+// "90", "90s", "15m", "6h", "2d" to seconds, -1 if invalid
+static long parse_duration(const char *s) {
+    char *end;
+    long v = strtol(s, &end, 10);
+    if (v <= 0)
+        return -1;
+    switch (*end) {
+    case '\0':
+    case 's': return v;
+    case 'm': return v * 60;
+    case 'h': return v * 3600;
+    case 'd': return v * 86400;
+    }
+    return -1;
+}
+
+static void utc_stamp(char *buf, size_t len) {
+    time_t t = time(NULL);
+    struct tm tm;
+    gmtime_r(&t, &tm);
+    strftime(buf, len, "%Y-%m-%dT%H:%M:%SZ", &tm);
+}
+
+/*
+ * Tracks one metric per window. The first SOAK_BASELINE_WINDOWS windows set
+ * the baseline, after that an EWMA follows the recent level. A window that
+ * is far off the EWMA is a step, an EWMA that wandered off the baseline is
+ * drift. Drift is edge triggered so a slow degradation is reported once
+ * when it crosses the threshold and again if it recovers.
+ */
+struct drift_detector {
+    const char *metric;
+    double baseline;
+    double ewma;
+    int windows;
+    int drifting;
+    unsigned long steps;
+    unsigned long drifts;
+};
+
+static void drift_update(struct drift_detector *d, double v) {
+    char stamp[32];
+    double dev;
+
+    d->windows++;
+    if (d->windows <= SOAK_BASELINE_WINDOWS) {
+        d->baseline += (v - d->baseline) / d->windows;
+        d->ewma = d->baseline;
+        return;
+    }
+    if (d->ewma <= 0 || d->baseline <= 0) {
+        d->ewma = v;
+        return;
+    }
+
+    utc_stamp(stamp, sizeof(stamp));
+    dev = 100.0 * (v - d->ewma) / d->ewma;
+    if (dev > SOAK_STEP_PCT || dev < -SOAK_STEP_PCT) {
+        d->steps++;
+        printf("! %s STEP %s %.1f -> %.1f (%+.0f%%)\n", stamp, d->metric,
+               d->ewma, v, dev);
+    }
+
+    d->ewma += SOAK_EWMA_ALPHA * (v - d->ewma);
+    dev = 100.0 * (d->ewma - d->baseline) / d->baseline;
+    if (!d->drifting && (dev > SOAK_DRIFT_PCT || dev < -SOAK_DRIFT_PCT)) {
+        d->drifting = 1;
+        d->drifts++;
+        printf("! %s DRIFT %s baseline %.1f now %.1f (%+.0f%%)\n", stamp,
+               d->metric, d->baseline, d->ewma, dev);
+    } else if (d->drifting && dev < SOAK_DRIFT_PCT / 2 && dev > -SOAK_DRIFT_PCT / 2) {
+        d->drifting = 0;
+        printf("! %s RECOVERED %s baseline %.1f now %.1f (%+.0f%%)\n", stamp,
+               d->metric, d->baseline, d->ewma, dev);
+    }
+}
+
+/*
+ * Round trips every `interval_ms` for `duration` seconds. Each window prints
+ * its own percentiles next to the cumulative ones. Memory use is two
+ * histograms regardless of duration.
+ */
+static int soak_rtt(int fd, long duration, int window, int interval_ms) {
+    static struct hist win, total;
+    struct drift_detector p50 = { .metric = "rtt_p50_us" };
+    struct drift_detector p99 = { .metric = "rtt_p99_us" };
+    unsigned long win_lost = 0, total_lost = 0, nwin = 0;
+    double t_end = now_us() + duration * 1e6, t_win;
+    char stamp[32];
+
+    hist_reset(&win);
+    hist_reset(&total);
+    tcflush(fd, TCIOFLUSH);
+    t_win = now_us() + window * 1e6;
+
+    printf("# soak rtt: %ld s, %d s windows, one round trip every %d ms\n",
+           duration, window, interval_ms);
+    printf("# time window n p50 p90 p99 p99.9 max lost | total_n total_p50 total_p99 total_max total_lost (us)\n");
+
+    while (!stop_requested) {
+        double now = now_us();
+
+        if (now >= t_win || now >= t_end) {
+            nwin++;
+            hist_merge(&total, &win);
+            total_lost += win_lost;
+            utc_stamp(stamp, sizeof(stamp));
+            printf("%s %lu %llu %.1f %.1f %.1f %.1f %llu %lu | %llu %.1f %.1f %llu %lu\n",
+                   stamp, nwin, (unsigned long long)win.count,
+                   hist_percentile(&win, 50), hist_percentile(&win, 90),
+                   hist_percentile(&win, 99), hist_percentile(&win, 99.9),
+                   (unsigned long long)(win.count ? win.max : 0), win_lost,
+                   (unsigned long long)total.count,
+                   hist_percentile(&total, 50), hist_percentile(&total, 99),
+                   (unsigned long long)(total.count ? total.max : 0), total_lost);
+            if (win.count) {
+                drift_update(&p50, hist_percentile(&win, 50));
+                drift_update(&p99, hist_percentile(&win, 99));
+            }
+            fflush(stdout);
+            hist_reset(&win);
+            win_lost = 0;
+            t_win += window * 1e6;
+            if (now >= t_end)
+                break;
+        }
+
+        double us = rtt_once(fd);
+        if (us < 0) {
+            win_lost++;
+            tcflush(fd, TCIOFLUSH);
+        } else {
+            hist_add(&win, us);
+        }
+        usleep(interval_ms * 1000);
+    }
+
+    printf("# done: %llu round trips, %lu lost, p50 %.1f p99 %.1f max %llu us, "
+           "%lu steps, %lu drifts\n",
+           (unsigned long long)total.count, total_lost,
+           hist_percentile(&total, 50), hist_percentile(&total, 99),
+           (unsigned long long)(total.count ? total.max : 0),
+           p50.steps + p99.steps, p50.drifts + p99.drifts);
+    return 0;
+}
+
+/*
+ * Continuous loopback stream for `duration` seconds, reporting bytes/s,
+ * CPU per byte and read() latency spread per window.
+ */
+static int soak_throughput(int fd, long duration, int window, int block) {
+    struct tput_tx tx = { .fd = fd, .block = block };
+    struct drift_detector rate = { .metric = "bytes_per_s" };
+    struct drift_detector cpu = { .metric = "cpu_ns_per_byte" };
+    static struct hist gaps;
+    unsigned char rx[READ_SIZE_MAX];
+    unsigned long long total_rx = 0, win_rx = 0;
+    unsigned long nwin = 0;
+    struct cpu_sample c0, c1;
+    double t0, t_win_start, t_prev = 0;
+    char stamp[32];
+    pthread_t thr;
+
+    hist_reset(&gaps);
+    set_vmin_vtime(fd, 0, 0);
+    tcflush(fd, TCIOFLUSH);
+
+    t0 = t_win_start = now_us();
+    tx.stop_us = t0 + duration * 1e6;
+    cpu_sample_read(&c0, &tx);
+    if (pthread_create(&thr, NULL, tput_tx_thread, &tx) != 0)
+        return 1;
+
+    printf("# soak throughput: %ld s, %d s windows, %d byte writes\n",
+           duration, window, block);
+    printf("# time window bytes_per_s cpu_ns_per_byte gap_p50 gap_p99 gap_max backlog | total_bytes\n");
+
+    for (;;) {
+        struct pollfd pfd = { .fd = fd, .events = POLLIN };
+        double now;
+
+        if (stop_requested)
+            tx.stop = 1;
+        if (poll(&pfd, 1, 100) > 0) {
+            ssize_t n = read(fd, rx, sizeof(rx));
+            now = now_us();
+            if (n > 0) {
+                if (t_prev > 0)
+                    hist_add(&gaps, now - t_prev);
+                t_prev = now;
+                win_rx += n;
+            }
+        }
+        now = now_us();
+
+        int finished = tx.stop || now >= tx.stop_us;
+        if (now - t_win_start >= window * 1e6 || finished) {
+            unsigned long sent = __atomic_load_n(&tx.sent, __ATOMIC_ACQUIRE);
+            double secs = (now - t_win_start) / 1e6;
+            double bps = win_rx / secs;
+            double ns_per_byte;
+            long backlog;
+
+            cpu_sample_read(&c1, &tx);
+            ns_per_byte = win_rx ? cpu_busy_us(&c0, &c1) * 1e3 / win_rx : 0;
+            total_rx += win_rx;
+            // written but not read back yet, grows without bound on loss
+            backlog = (long)(sent - total_rx);
+
+            nwin++;
+            utc_stamp(stamp, sizeof(stamp));
+            printf("%s %lu %.0f %.1f %.0f %.0f %llu %ld | %llu\n", stamp, nwin,
+                   bps, ns_per_byte, hist_percentile(&gaps, 50),
+                   hist_percentile(&gaps, 99),
+                   (unsigned long long)(gaps.count ? gaps.max : 0),
+                   backlog > 0 ? backlog : 0, total_rx);
+            if (win_rx) {
+                drift_update(&rate, bps);
+                drift_update(&cpu, ns_per_byte);
+            }
+            fflush(stdout);
+
+            c0 = c1;
+            win_rx = 0;
+            hist_reset(&gaps);
+            t_win_start = now;
+            if (finished)
+                break;
+        }
+    }
+
+    pthread_join(thr, NULL);
+    printf("# done: %llu bytes in %.0f s, %lu steps, %lu drifts\n", total_rx,
+           (now_us() - t0) / 1e6, rate.steps + cpu.steps, rate.drifts + cpu.drifts);
+    return 0;
+}
+
+/* ---------------------------------------------------------------------- */
+/* Latency under load                                                     */
+/* ---------------------------------------------------------------------- */
+
+struct rtt_series {
+    int n;
+    int lost;
+    double p50_us;
+    double p99_us;
+    double max_us;
+};
+
+static void rtt_series_run(int fd, int iters, struct rtt_series *res) {
+    double *rtt = calloc(iters, sizeof(*rtt));
+    int i;
+
+    memset(res, 0, sizeof(*res));
+    if (!rtt)
+        return;
+    tcflush(fd, TCIOFLUSH);
+    for (i = 0; i < iters; i++) {
+        double us = rtt_once(fd);
+        if (us < 0) {
+            res->lost++;
+            tcflush(fd, TCIOFLUSH);
+            continue;
+        }
+        rtt[res->n++] = us;
+    }
+    res->p50_us = percentile(rtt, res->n, 50);
+    res->p99_us = percentile(rtt, res->n, 99);
+    res->max_us = res->n ? rtt[res->n - 1] : 0;
+    free(rtt);
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+        "Usage: %s [options] <serial-device>\n"
+        "  -b, --baud <rate>         Line rate (default %d)\n"
+        "  -s, --sweep               Sweep VMIN, VTIME and read() size\n"
+        "      --vmin <list>         VMIN values to sweep (default 0,1,4,16,64)\n"
+        "      --vtime <list>        VTIME values to sweep, 1/10 s (default 0,1)\n"
+        "      --rsize <list>        read() sizes to sweep (default 1,16,256)\n"
+        "  -n, --frame <bytes>       Frame size for the sweep (default %d)\n"
+        "  -i, --iterations <n>      Frames per sweep combination (default %d)\n"
+        "  -a, --adaptive            Compare VMIN=1 against the adaptive VMIN policy\n"
+        "      --rate <bytes/s>      Stream arrival rate (default %d)\n"
+        "      --budget <us>         Adaptive latency budget (default %d)\n"
+        "      --seconds <n>         Stream duration per policy (default %d)\n"
+        "  -T, --throughput          Loopback throughput and CPU per byte\n"
+        "      --block <bytes>       write() size for throughput (default %d)\n"
+        "  -l, --low-latency         Compare RTT and throughput with ASYNC_LOW_LATENCY\n"
+        "                            off and on (-i round trips, --seconds stream)\n"
+        "  -F, --fifo                Compare RTT, throughput and interrupts per byte with\n"
+        "                            the FIFO on and off (uart_probe.ko fifo_disable)\n"
+        "  -L, --ldisc               Compare n_tty, N_NULL and the uart_passthru ldisc\n"
+        "      --passthru-ldisc <n>  ldisc number of uart_passthru (default %d)\n"
+        "  -p, --peer <device>       Feed the port from a second port instead of\n"
+        "                            loopback (needed for N_NULL)\n"
+        "  -E, --echo                Echo responder: reflect framed round trips from\n"
+        "                            another port's --cross, until Ctrl-C\n"
+        "  -X, --cross               Framed round trips (-n bytes, -i of them) to an\n"
+        "                            --echo responder, or to --peer in this process,\n"
+        "                            with the responder's turnaround subtracted\n"
+        "  -R, --passive             Histogram read() chunk sizes and inter-read gaps\n"
+        "                            of an incoming stream (from --peer if given)\n"
+        "      --rx-trig <list>      RX trigger levels to capture with (fifo_control sysfs)\n"
+        "  -S, --soak <duration>     Run RTT (or -T throughput) for 90s/15m/6h/2d with\n"
+        "                            per-window percentiles and drift detection\n"
+        "      --window <s>          Soak window length (default %d)\n"
+        "      --interval <ms>       Soak RTT interval (default %d)\n"
+        "      --load <spec>         Background load per level: cpu=N,mem=N,io=N,\n"
+        "                            io_dir=DIR,irq=/dev/ttySX,irq_baud=RATE\n"
+        "      --load-levels <list>  Load levels to run the test at (default 0,1)\n"
+        "  -M, --model               Print serial_model.h predictions and residuals\n"
+        "                            (RTT, sweep, throughput, --fifo, --cross)\n"
+        "  -v, --verbose             Per second progress\n",
+        prog, BAUD_DEFAULT, SWEEP_FRAME_DEFAULT, SWEEP_ITER_DEFAULT,
+        ADAPT_RATE_DEFAULT, ADAPT_BUDGET_DEFAULT, ADAPT_SECONDS_DEFAULT,
+        TPUT_BLOCK_DEFAULT, PASSTHRU_LDISC_DEFAULT, SOAK_WINDOW_DEFAULT,
+        SOAK_INTERVAL_DEFAULT);
+}
+
+enum {
+    OPT_VMIN = 256,
+    OPT_VTIME,
+    OPT_RSIZE,
+    OPT_RATE,
+    OPT_BUDGET,
+    OPT_SECONDS,
+    OPT_BLOCK,
+    OPT_PASSTHRU,
+    OPT_RX_TRIG,
+    OPT_WINDOW,
+    OPT_INTERVAL,
+    OPT_LOAD,
+    OPT_LOAD_LEVELS,
+};
+
+int main(int argc, char *argv[]) {
+    static const struct option long_opts[] = {
+        { "baud",       required_argument, NULL, 'b' },
+        { "sweep",      no_argument,       NULL, 's' },
+        { "vmin",       required_argument, NULL, OPT_VMIN },
+        { "vtime",      required_argument, NULL, OPT_VTIME },
+        { "rsize",      required_argument, NULL, OPT_RSIZE },
+        { "frame",      required_argument, NULL, 'n' },
+        { "iterations", required_argument, NULL, 'i' },
+        { "adaptive",   no_argument,       NULL, 'a' },
+        { "rate",       required_argument, NULL, OPT_RATE },
+        { "budget",     required_argument, NULL, OPT_BUDGET },
+        { "seconds",    required_argument, NULL, OPT_SECONDS },
+        { "throughput", no_argument,       NULL, 'T' },
+        { "block",      required_argument, NULL, OPT_BLOCK },
+        { "low-latency", no_argument,      NULL, 'l' },
+        { "fifo",       no_argument,       NULL, 'F' },
+        { "ldisc",      no_argument,       NULL, 'L' },
+        { "passthru-ldisc", required_argument, NULL, OPT_PASSTHRU },
+        { "peer",       required_argument, NULL, 'p' },
+        { "passive",    no_argument,       NULL, 'R' },
+        { "echo",       no_argument,       NULL, 'E' },
+        { "cross",      no_argument,       NULL, 'X' },
+        { "rx-trig",    required_argument, NULL, OPT_RX_TRIG },
+        { "soak",       required_argument, NULL, 'S' },
+        { "window",     required_argument, NULL, OPT_WINDOW },
+        { "interval",   required_argument, NULL, OPT_INTERVAL },
+        { "load",       required_argument, NULL, OPT_LOAD },
+        { "load-levels", required_argument, NULL, OPT_LOAD_LEVELS },
+        { "model",      no_argument,       NULL, 'M' },
+        { "verbose",    no_argument,       NULL, 'v' },
+        { "help",       no_argument,       NULL, 'h' },
+        { NULL, 0, NULL, 0 }
+    };
+    int vmins[LIST_MAX] = { 0, 1, 4, 16, 64 }, nvmin = 5;
+    int vtimes[LIST_MAX] = { 0, 1 }, nvtime = 2;
+    int rsizes[LIST_MAX] = { 1, 16, 256 }, nrsize = 3;
+    int frame_len = SWEEP_FRAME_DEFAULT, iters = SWEEP_ITER_DEFAULT;
+    int do_sweep = 0, do_adaptive = 0, do_tput = 0, do_lowlat = 0, verbose = 0;
+    int do_fifo = 0, do_echo = 0, do_cross = 0, do_model = 0;
+    struct serial_model port_model;
+    int block = TPUT_BLOCK_DEFAULT;
+    int do_ldisc = 0, passthru_num = PASSTHRU_LDISC_DEFAULT;
+    const char *peer = NULL;
+    int peer_fd = -1;
+    int do_passive = 0, rx_trigs[LIST_MAX], nrx_trig = 0;
+    long soak = 0;
+    int window = SOAK_WINDOW_DEFAULT, interval = SOAK_INTERVAL_DEFAULT;
+    struct load_spec load;
+    int use_load = 0, levels[LIST_MAX] = { 0, 1 }, nlevels = 2, lvl;
+    struct rtt_series rtt_by_level[LIST_MAX];
+    struct tput_result tput_by_level[LIST_MAX];
+    struct load_stats load_by_level[LIST_MAX];
+    int seconds = ADAPT_SECONDS_DEFAULT;
+    double rate = ADAPT_RATE_DEFAULT, budget = ADAPT_BUDGET_DEFAULT;
+    long baud = BAUD_DEFAULT;
+    int opt, ret;
+
+    while ((opt = getopt_long(argc, argv, "b:sn:i:aTlFLp:REXS:Mvh", long_opts, NULL)) != -1) {
+        switch (opt) {
+        case 'b': baud = strtol(optarg, NULL, 10); break;
+        case 's': do_sweep = 1; break;
+        case 'n': frame_len = atoi(optarg); break;
+        case 'i': iters = atoi(optarg); break;
+        case 'a': do_adaptive = 1; break;
+        case 'T': do_tput = 1; break;
+        case 'l': do_lowlat = 1; break;
+        case 'F': do_fifo = 1; break;
+        case OPT_BLOCK: block = atoi(optarg); break;
+        case 'L': do_ldisc = 1; break;
+        case OPT_PASSTHRU: passthru_num = atoi(optarg); break;
+        case 'p': peer = optarg; break;
+        case 'R': do_passive = 1; break;
+        case 'E': do_echo = 1; break;
+        case 'X': do_cross = 1; break;
+        case 'S':
+            if ((soak = parse_duration(optarg)) < 0) {
+                fprintf(stderr, "Invalid soak duration '%s'\n", optarg);
+                return 1;
+            }
+            break;
+        case OPT_WINDOW: window = atoi(optarg); break;
+        case OPT_INTERVAL: interval = atoi(optarg); break;
+        case OPT_LOAD:
+            if (load_parse(optarg, &load) != 0)
+                return 1;
+            use_load = 1;
+            break;
+        case OPT_LOAD_LEVELS:
+            if ((nlevels = parse_int_list(optarg, levels, LIST_MAX)) < 1)
+                return 1;
+            break;
+        case OPT_RX_TRIG:
+            if ((nrx_trig = parse_int_list(optarg, rx_trigs, LIST_MAX)) < 0)
+                return 1;
+            break;
+        case 'M': do_model = 1; break;
+        case 'v': verbose = 1; break;
+        case OPT_VMIN:
+            if ((nvmin = parse_int_list(optarg, vmins, LIST_MAX)) < 0)
+                return 1;
+            break;
+        case OPT_VTIME:
+            if ((nvtime = parse_int_list(optarg, vtimes, LIST_MAX)) < 0)
+                return 1;
+            break;
+        case OPT_RSIZE:
+            if ((nrsize = parse_int_list(optarg, rsizes, LIST_MAX)) < 0)
+                return 1;
+            break;
+        case OPT_RATE: rate = atof(optarg); break;
+        case OPT_BUDGET: budget = atof(optarg); break;
+        case OPT_SECONDS: seconds = atoi(optarg); break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (optind >= argc) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if (baud <= 0) {
+        fprintf(stderr, "Unsupported baud rate %ld\n", baud);
+        return 1;
+    }
+    if (frame_len < 1 || frame_len > READ_SIZE_MAX || iters < 1 ||
+        rate <= 0 || budget <= 0 || seconds < 1 ||
+        block < 1 || block > READ_SIZE_MAX || window < 1 || interval < 0) {
+        fprintf(stderr, "Invalid frame, iteration, rate or duration\n");
+        return 1;
+    }
+    for (int i = 0; i < nrsize; i++) {
+        if (rsizes[i] < 1 || rsizes[i] > READ_SIZE_MAX) {
+            fprintf(stderr, "read size must be 1..%d\n", READ_SIZE_MAX);
+            return 1;
+        }
+    }
+    for (int i = 0; i < nvmin; i++) {
+        if (vmins[i] > 255) {
+            fprintf(stderr, "VMIN must be 0..255\n");
+            return 1;
+        }
+    }
+    for (int i = 0; i < nvtime; i++) {
+        if (vtimes[i] > 255) {
+            fprintf(stderr, "VTIME must be 0..255\n");
+            return 1;
+        }
+    }
+
+    const char *port = argv[optind];
+    int fd = open(port, O_RDWR | O_NOCTTY | O_SYNC);
+    if (fd < 0) {
+        perror("open");
+        return 1;
+    }
+
+    if (configure_port(fd, baud) != 0) {
+        close(fd);
+        return 1;
+    }
+
+    if (do_model) {
+        model_init(&port_model, baud, 16);
+        if (model_from_port(&port_model, fd, port) != 0)
+            perror("TIOCGSERIAL, modelling a 16 byte FIFO");
+        model = &port_model;
+    }
+
+    if (peer) {
+        peer_fd = open(peer, O_RDWR | O_NOCTTY);
+        if (peer_fd < 0) {
+            perror("open peer");
+            close(fd);
+            return 1;
+        }
+        if (configure_port(peer_fd, baud) != 0) {
+            close(peer_fd);
+            close(fd);
+            return 1;
+        }
+    }
+
+    // flush any old data
+    tcflush(fd, TCIOFLUSH);
+
+    if (soak) {
+        signal(SIGINT, on_sigint);
+        signal(SIGTERM, on_sigint);
+    }
+
+    if (!use_load)
+        nlevels = 1;
+
+    for (lvl = 0, ret = 0; lvl < nlevels && !ret; lvl++) {
+        if (use_load) {
+            char desc[256];
+            load_describe(&load, levels[lvl], desc, sizeof(desc));
+            printf("== load %s\n", desc);
+            fflush(stdout);
+            if (load_start(&load, levels[lvl]) != 0) {
+                ret = 1;
+                break;
+            }
+            sleep(LOAD_WARMUP_SEC);
+        }
+
+        if (soak && do_tput)
+            ret = soak_throughput(fd, soak, window, block);
+        else if (soak)
+            ret = soak_rtt(fd, soak, window, interval);
+        else if (do_sweep)
+            ret = run_sweep(fd, baud, vmins, nvmin, vtimes, nvtime, rsizes,
+                            nrsize, frame_len, iters);
+        else if (do_adaptive)
+            ret = run_adaptive(fd, rate, budget, seconds, READ_SIZE_MAX, verbose);
+        else if (do_passive)
+            ret = run_passive(fd, port, peer_fd, rx_trigs, nrx_trig, seconds);
+        else if (do_echo)
+            ret = run_echo(fd, baud, verbose);
+        else if (do_cross)
+            ret = run_cross(fd, peer_fd, baud, frame_len, iters);
+        else if (do_ldisc)
+            ret = run_ldisc_compare(fd, peer_fd, passthru_num, iters, seconds, block);
+        else if (do_lowlat)
+            ret = run_low_latency(fd, iters, seconds, block);
+        else if (do_fifo)
+            ret = run_fifo_compare(fd, port, iters, seconds, block);
+        else if (do_tput) {
+            struct tput_result *tput = &tput_by_level[lvl];
+            ret = run_throughput(fd, seconds, block, tput) != 0;
+            if (!ret && tput->irqs_per_byte >= 0)
+                printf("Throughput: %.0f bytes/s, %lu bytes, %.3f cpu_us/byte, %.3f irqs/byte\n",
+                       tput->bytes_per_sec, tput->bytes, tput->cpu_us_per_byte,
+                       tput->irqs_per_byte);
+            else if (!ret)
+                printf("Throughput: %.0f bytes/s, %lu bytes, %.3f cpu_us/byte\n",
+                       tput->bytes_per_sec, tput->bytes, tput->cpu_us_per_byte);
+            if (!ret && model) {
+                struct model_pred p;
+                model_predict(model, 0, &p);
+                model_header(stdout);
+                model_row(stdout, "throughput", "bytes/s", tput->bytes_per_sec, p.max_bps);
+                if (tput->irqs_per_byte >= 0)
+                    model_row(stdout, "irqs/byte", "irqs", tput->irqs_per_byte,
+                              p.irqs_per_byte);
+            }
+        }
+        else if (use_load) {
+            // a single round trip says nothing under load, take -i of them
+            struct rtt_series *r = &rtt_by_level[lvl];
+            rtt_series_run(fd, iters, r);
+            printf("RTT: p50 %.1f p99 %.1f max %.1f us, %d lost\n",
+                   r->p50_us, r->p99_us, r->max_us, r->lost);
+            if (model) {
+                model_header(stdout);
+                model_row(stdout, "rtt_p50", "us", r->p50_us, model_last_us(1));
+            }
+        }
+        else
+            ret = run_rtt(fd);
+
+        if (use_load) {
+            struct load_stats *ls = &load_by_level[lvl];
+            load_stop(ls);
+            printf("   achieved: cpu %.0f MB/s hashed, mem %.0f MB/s, io %.1f MB/s, irq port %.0f B/s\n",
+                   ls->cpu_mbps, ls->mem_mbps, ls->io_mbps, ls->irq_bps);
+        }
+    }
+
+    // results against load level, for the modes that reduce to one row
+    if (use_load && !ret && !soak && !(do_sweep || do_adaptive || do_passive ||
+        do_echo || do_cross || do_ldisc || do_lowlat || do_fifo)) {
+        printf("\n%5s %8s %8s %8s %12s", "level", "cpu_MB/s", "mem_MB/s",
+               "io_MB/s", "irq_B/s");
+        if (do_tput)
+            printf(" %12s %13s\n", "bytes/s", "cpu_us/byte");
+        else
+            printf(" %10s %10s %10s %6s\n", "rtt_p50", "rtt_p99", "rtt_max", "lost");
+        for (lvl = 0; lvl < nlevels; lvl++) {
+            struct load_stats *ls = &load_by_level[lvl];
+            printf("%5d %8.0f %8.0f %8.1f %12.0f", levels[lvl], ls->cpu_mbps,
+                   ls->mem_mbps, ls->io_mbps, ls->irq_bps);
+            if (do_tput)
+                printf(" %12.0f %13.3f\n", tput_by_level[lvl].bytes_per_sec,
+                       tput_by_level[lvl].cpu_us_per_byte);
+            else
+                printf(" %10.1f %10.1f %10.1f %6d\n", rtt_by_level[lvl].p50_us,
+                       rtt_by_level[lvl].p99_us, rtt_by_level[lvl].max_us,
+                       rtt_by_level[lvl].lost);
+        }
+    }
+
+    if (peer_fd >= 0)
+        close(peer_fd);
+    close(fd);
+    return ret;
+}
@@ -0,0 +1,206 @@
+// serial_model.c
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+#include <sys/ioctl.h>
+#include <linux/serial.h>
+
+#include "serial_model.h"
+#include "serial_port.h"
+
+#define RX_TRIG_16550A      8       // UART_FCR_R_TRIG_10, the driver's default
+
+void model_init(struct serial_model *m, long baud, int fifo) {
+    memset(m, 0, sizeof(*m));
+    m->baud = baud;
+    m->data_bits = 8;
+    m->stop_bits = 1;
+    m->rx_fifo = m->tx_fifo = fifo > 0 ? fifo : 1;
+    m->rx_trig = m->rx_fifo >= 16 ? RX_TRIG_16550A : 1;
+    m->tx_trig = 1;
+    m->timeout_chars = 4;
+}
+
+int model_parse_format(struct serial_model *m, const char *fmt) {
+    char p;
+
+    if (strlen(fmt) != 3 || fmt[0] < '5' || fmt[0] > '8' ||
+        (fmt[2] != '1' && fmt[2] != '2'))
+        return -1;
+    p = toupper((unsigned char)fmt[1]);
+    if (p != 'N' && p != 'E' && p != 'O' && p != 'M' && p != 'S')
+        return -1;
+    m->data_bits = fmt[0] - '0';
+    m->parity = p != 'N';
+    m->stop_bits = fmt[2] - '0';
+    return 0;
+}
+
+void model_format(const struct serial_model *m, char *buf, size_t len) {
+    snprintf(buf, len, "%d%c%d", m->data_bits, m->parity ? 'P' : 'N', m->stop_bits);
+}
+
+int model_char_bits(const struct serial_model *m) {
+    return 1 + m->data_bits + m->parity + m->stop_bits;
+}
+
+void model_predict(const struct serial_model *m, int frame, struct model_pred *p) {
+    int rx_trig = m->rx_trig < 1 ? 1 : m->rx_trig > m->rx_fifo ? m->rx_fifo : m->rx_trig;
+    int tx_trig = m->tx_trig < 1 ? 1 : m->tx_trig > m->tx_fifo ? m->tx_fifo : m->tx_trig;
+    // bytes per THRE refill, and how long the FIFO plus shift register
+    // keep the line busy once THRE fires
+    int refill = m->tx_fifo - tx_trig + 1;
+    double tx_left_ns, tx_gap_ns, rx_per_irq, rx_bps, tx_bps;
+
+    memset(p, 0, sizeof(*p));
+    if (m->baud <= 0)
+        return;
+    p->char_ns = model_char_bits(m) * 1e9 / m->baud;
+    p->line_bps = 1e9 / p->char_ns;
+    tx_left_ns = tx_trig * p->char_ns;
+    tx_gap_ns = m->irq_ns > tx_left_ns ? m->irq_ns - tx_left_ns : 0;
+
+    // a stream drains whatever arrived while the interrupt was pending
+    rx_per_irq = rx_trig + m->irq_ns / p->char_ns;
+    if (rx_per_irq > m->rx_fifo)
+        rx_per_irq = m->rx_fifo;
+    p->headroom_ns = (m->rx_fifo - rx_trig) * p->char_ns - m->irq_ns;
+    rx_bps = p->headroom_ns >= 0 ? p->line_bps :
+             m->rx_fifo * 1e9 / (rx_trig * p->char_ns + m->irq_ns);
+    tx_bps = refill * 1e9 / (refill * p->char_ns + tx_gap_ns);
+    p->max_bps = fmin(p->line_bps, fmin(rx_bps, tx_bps));
+
+    if (frame <= 0) {
+        p->rx_irqs_per_byte = 1.0 / rx_per_irq;
+        p->tx_irqs_per_byte = 1.0 / refill;
+    } else {
+        int refills = frame > m->tx_fifo ? (frame - m->tx_fifo + refill - 1) / refill : 0;
+        int rem = frame % rx_trig;
+
+        p->tx_ns = frame * p->char_ns + refills * tx_gap_ns;
+        p->rx_wait_ns = rem ? m->timeout_chars * p->char_ns : 0;
+        p->last_byte_ns = p->tx_ns + p->rx_wait_ns + m->irq_ns + m->wake_ns;
+        // the last THRE finds nothing to send and stops TX
+        p->tx_irqs_per_byte = (refills + 1.0) / frame;
+        p->rx_irqs_per_byte = (frame / rx_trig + (rem ? 1.0 : 0)) / frame;
+    }
+    p->irqs_per_byte = p->rx_irqs_per_byte + p->tx_irqs_per_byte;
+}
+
+// Interrupts and drains due at or before `until`
+struct sim_state {
+    const struct serial_model *m;
+    double char_ns, svc_at, last_rx;
+    int level, nq;
+    int *q_msg;                 // messages whose last byte is in the FIFO
+    double *q_at;
+    double *latency_ns;
+    struct model_sim *res;
+};
+
+static void sim_advance(struct sim_state *st, double until) {
+    for (;;) {
+        if (st->svc_at >= 0 && st->svc_at <= until) {
+            int i;
+            for (i = 0; i < st->nq; i++)
+                st->latency_ns[st->q_msg[i]] = st->svc_at - st->q_at[i] + st->m->wake_ns;
+            st->nq = 0;
+            st->level = 0;
+            st->svc_at = -1;
+        } else if (st->svc_at < 0 && st->level > 0 &&
+                   st->last_rx + st->m->timeout_chars * st->char_ns <= until) {
+            st->res->irqs++;
+            st->svc_at = st->last_rx + st->m->timeout_chars * st->char_ns + st->m->irq_ns;
+        } else {
+            break;
+        }
+    }
+}
+
+int model_simulate_rx(const struct serial_model *m, const int *sizes,
+                      const double *gaps_ns, int n, double *latency_ns,
+                      struct model_sim *res) {
+    struct sim_state st = { .m = m, .svc_at = -1, .latency_ns = latency_ns, .res = res };
+    int trig = m->rx_trig < 1 ? 1 : m->rx_trig > m->rx_fifo ? m->rx_fifo : m->rx_trig;
+    double t = 0;
+    int i, k;
+
+    memset(res, 0, sizeof(*res));
+    if (m->baud <= 0 || m->rx_fifo < 1)
+        return -1;
+    st.char_ns = model_char_bits(m) * 1e9 / m->baud;
+    st.q_msg = calloc(m->rx_fifo, sizeof(*st.q_msg));
+    st.q_at = calloc(m->rx_fifo, sizeof(*st.q_at));
+    if (!st.q_msg || !st.q_at) {
+        free(st.q_msg);
+        free(st.q_at);
+        return -1;
+    }
+
+    for (i = 0; i < n; i++) {
+        if (i)
+            t += gaps_ns[i] > 0 ? gaps_ns[i] : 0;
+        latency_ns[i] = -1;
+        for (k = 0; k < sizes[i]; k++) {
+            t += st.char_ns;            // the byte is in the FIFO at its stop bit
+            sim_advance(&st, t);
+            st.last_rx = t;
+            if (st.level >= m->rx_fifo) {
+                res->overruns++;
+                if (k == sizes[i] - 1)
+                    res->lost++;
+                continue;
+            }
+            st.level++;
+            if (k == sizes[i] - 1) {
+                st.q_msg[st.nq] = i;
+                st.q_at[st.nq++] = t;
+            }
+            if (st.level >= trig && st.svc_at < 0) {
+                res->irqs++;
+                st.svc_at = t + m->irq_ns;
+            }
+        }
+    }
+    res->duration_ns = t;
+    sim_advance(&st, INFINITY);
+    free(st.q_msg);
+    free(st.q_at);
+    return 0;
+}
+
+int model_from_port(struct serial_model *m, int fd, const char *dev) {
+    struct serial_struct ss;
+    char path[256];
+    int v;
+
+    if (ioctl(fd, TIOCGSERIAL, &ss) != 0)
+        return -1;
+    m->rx_fifo = m->tx_fifo = ss.xmit_fifo_size > 0 ? ss.xmit_fifo_size : 1;
+    tty_sysfs_path(dev, "rx_trig_bytes", path, sizeof(path));
+    v = sysfs_read_int(path);
+    m->rx_trig = v > 0 ? v : m->rx_fifo >= 16 ? RX_TRIG_16550A : 1;
+    tty_sysfs_path(dev, "tx_trig_bytes", path, sizeof(path));
+    v = sysfs_read_int(path);
+    m->tx_trig = v > 0 ? v : 1;
+    return 0;
+}
+
+void model_header(FILE *out) {
+    fprintf(out, "%-14s %-8s %12s %12s %12s %8s\n", "model", "unit", "measured",
+            "predicted", "residual", "resid%");
+}
+
+void model_row(FILE *out, const char *name, const char *unit, double measured,
+               double predicted) {
+    double resid = measured - predicted;
+
+    fprintf(out, "%-14s %-8s %12.3f %12.3f %+12.3f", name, unit, measured,
+            predicted, resid);
+    if (predicted != 0)
+        fprintf(out, " %+7.1f%%\n", 100.0 * resid / predicted);
+    else
+        fprintf(out, " %8s\n", "-");
+}
@@ -0,0 +1,93 @@
+// serial_model.h
+#ifndef SERIAL_MODEL_H
+#define SERIAL_MODEL_H
+
+#include <stdio.h>
+
+/*
+ * First order model of a FIFO UART behind the 8250 driver. Predictions
+ * are lower bounds for ideal hardware unless irq_ns and wake_ns are set.
+ * The gap between a measurement and its prediction (the residual) is the
+ * part the wire and the FIFO rules do not explain: driver, scheduler or
+ * hardware cost.
+ *
+ *   RX: an interrupt at every rx_trig bytes; a remainder below the
+ *       trigger waits for the character timeout, timeout_chars character
+ *       times after the last byte (4 on a 16550).
+ *   TX: write() fills the FIFO, THRE fires when fewer than tx_trig bytes
+ *       are left (1 = empty, the 16550 rule) and the handler refills it.
+ *       A refill slower than the bytes left in the FIFO leaves the line
+ *       idle.
+ *   irq_ns is the time from an interrupt to the FIFO being serviced,
+ *   wake_ns from the flip buffer push to read() returning.
+ */
+struct serial_model {
+    long baud;
+    int data_bits;              // 5..8
+    int parity;                 // 0 none, 1 odd or even (one bit either way)
+    int stop_bits;              // 1 or 2
+    int rx_fifo, tx_fifo;       // bytes, 1 without a FIFO
+    int rx_trig;                // RX interrupt level, bytes
+    int tx_trig;                // THRE when fewer than this are left
+    double timeout_chars;       // character timeout
+    double irq_ns;
+    double wake_ns;
+};
+
+struct model_pred {
+    double char_ns;             // one character on the wire
+    double line_bps;            // line rate, bytes/s
+    double tx_ns;               // write() to the last stop bit
+    double rx_wait_ns;          // last byte in the FIFO to its interrupt
+    double last_byte_ns;        // write() to the last byte out of read()
+    double rx_irqs_per_byte;
+    double tx_irqs_per_byte;
+    double irqs_per_byte;       // both directions, loopback on one line
+    double headroom_ns;         // RX trigger to overrun, minus irq_ns
+    double max_bps;             // sustained stream, bytes/s
+};
+
+// 8N1, no latency terms, rx_trig 8 and tx_trig 1 on a 16 byte FIFO
+void model_init(struct serial_model *m, long baud, int fifo);
+// "8N1", "7E2", ... into data_bits, parity, stop_bits. 0 on success
+int model_parse_format(struct serial_model *m, const char *fmt);
+void model_format(const struct serial_model *m, char *buf, size_t len);
+// Bits per character: start, data, parity, stop
+int model_char_bits(const struct serial_model *m);
+// Loopback of one frame of `frame` bytes on a single port; for streams
+// (frame 0) only the per-byte and rate terms are filled in
+void model_predict(const struct serial_model *m, int frame, struct model_pred *p);
+
+/*
+ * Message by message RX simulation for traffic that does not fit a single
+ * frame size: message i of sizes[i] bytes starts gaps_ns[i] after the
+ * previous one ended. Trigger and timeout interrupts are serviced irq_ns
+ * later and drain whatever has arrived by then; a byte that finds the
+ * FIFO full is an overrun. latency_ns[i] is the last byte on the wire to
+ * read() (with wake_ns), -1 if that byte was lost. 0 on success.
+ */
+struct model_sim {
+    unsigned long irqs;
+    unsigned long overruns;     // bytes
+    unsigned long lost;         // messages whose last byte overran
+    double duration_ns;         // first start bit to last stop bit
+};
+
+int model_simulate_rx(const struct serial_model *m, const int *sizes,
+                      const double *gaps_ns, int n, double *latency_ns,
+                      struct model_sim *res);
+
+/*
+ * Fill in the FIFO depth and trigger levels of an open port: depth from
+ * TIOCGSERIAL, triggers from the rx_trig_bytes/tx_trig_bytes sysfs
+ * attributes, the 8250 defaults where those are missing. dev is the
+ * /dev path or tty name. 0 on success.
+ */
+int model_from_port(struct serial_model *m, int fd, const char *dev);
+
+// Measured against predicted, residual = measured - predicted
+void model_header(FILE *out);
+void model_row(FILE *out, const char *name, const char *unit, double measured,
+               double predicted);
+
+#endif
@@ -0,0 +1,141 @@
+// serial_port.c
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <termios.h>
+#include <sys/ioctl.h>
+
+#include "serial_port.h"
+
+// <asm/termbits.h> clashes with <termios.h>, so only what TCSETS2 needs
+struct termios2 {
+    tcflag_t c_iflag, c_oflag, c_cflag, c_lflag;
+    cc_t c_line;
+    cc_t c_cc[19];
+    speed_t c_ispeed, c_ospeed;
+};
+
+#ifndef BOTHER
+#define BOTHER  0010000
+#endif
+#ifndef IBSHIFT
+#define IBSHIFT 16
+#endif
+
+double now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+speed_t baud_to_speed(long baud) {
+    switch (baud) {
+    case 9600:    return B9600;
+    case 19200:   return B19200;
+    case 38400:   return B38400;
+    case 57600:   return B57600;
+    case 115200:  return B115200;
+    case 230400:  return B230400;
+    case 460800:  return B460800;
+    case 500000:  return B500000;
+    case 576000:  return B576000;
+    case 921600:  return B921600;
+    case 1000000: return B1000000;
+    case 1152000: return B1152000;
+    case 1500000: return B1500000;
+    case 2000000: return B2000000;
+    case 3000000: return B3000000;
+    case 4000000: return B4000000;
+    }
+    return B0;
+}
+
+// Rates without a B* constant, e.g. a 16C950 or Exar port above 4 Mbaud
+static int set_custom_baud(int fd, long baud) {
+    struct termios2 tio;
+
+    if (ioctl(fd, TCGETS2, &tio) != 0) {
+        perror("TCGETS2");
+        return -1;
+    }
+    tio.c_cflag &= ~(CBAUD | (CBAUD << IBSHIFT));
+    tio.c_cflag |= BOTHER | (BOTHER << IBSHIFT);
+    tio.c_ispeed = tio.c_ospeed = baud;
+    if (ioctl(fd, TCSETS2, &tio) != 0 || ioctl(fd, TCGETS2, &tio) != 0) {
+        perror("TCSETS2");
+        return -1;
+    }
+    // the driver writes back the rate its divisor gives
+    if (labs((long)tio.c_ospeed - baud) * 50 > baud)
+        fprintf(stderr, "%ld baud set as %u\n", baud, tio.c_ospeed);
+    return 0;
+}
+
+int configure_port(int fd, long baud) {
+    speed_t speed = baud_to_speed(baud);
+    struct termios tty;
+    if (tcgetattr(fd, &tty) != 0) {
+        perror("tcgetattr");
+        return -1;
+    }
+
+    // B38400 until TCSETS2 replaces it
+    cfsetospeed(&tty, speed == B0 ? B38400 : speed);
+    cfsetispeed(&tty, speed == B0 ? B38400 : speed);
+
+    tty.c_cflag = (tty.c_cflag & ~CSIZE) | CS8; // 8-bit chars
+    tty.c_iflag &= ~IGNBRK;                     // disable break processing
+    tty.c_lflag = 0;                            // no signaling chars, no echo
+    tty.c_oflag = 0;                            // no remapping, no delays
+    tty.c_cc[VMIN]  = 0;                        // non-blocking read
+    tty.c_cc[VTIME] = 0;
+
+    tty.c_iflag &= ~(IXON | IXOFF | IXANY);     // shut off xon/xoff ctrl
+    tty.c_cflag |= (CLOCAL | CREAD);            // ignore modem controls
+    tty.c_cflag &= ~(PARENB | PARODD);          // no parity
+    tty.c_cflag &= ~CSTOPB;
+    tty.c_cflag &= ~CRTSCTS;
+
+    if (tcsetattr(fd, TCSANOW, &tty) != 0) {
+        perror("tcsetattr");
+        return -1;
+    }
+    return speed == B0 ? set_custom_baud(fd, baud) : 0;
+}
+
+int set_vmin_vtime(int fd, int vmin, int vtime) {
+    struct termios tty;
+    if (tcgetattr(fd, &tty) != 0)
+        return -1;
+    tty.c_cc[VMIN]  = vmin;
+    tty.c_cc[VTIME] = vtime;
+    return tcsetattr(fd, TCSANOW, &tty);
+}
+
+// /sys/class/tty/<name>/<attr> for a /dev path
+void tty_sysfs_path(const char *dev, const char *attr, char *out, size_t len) {
+    const char *name = strrchr(dev, '/');
+    snprintf(out, len, "/sys/class/tty/%s/%s", name ? name + 1 : dev, attr);
+}
+
+int sysfs_read_int(const char *path) {
+    FILE *f = fopen(path, "r");
+    int v = -1;
+    if (!f)
+        return -1;
+    if (fscanf(f, "%d", &v) != 1)
+        v = -1;
+    fclose(f);
+    return v;
+}
+
+int sysfs_write_int(const char *path, int v) {
+    FILE *f = fopen(path, "w");
+    if (!f)
+        return -1;
+    int ret = fprintf(f, "%d\n", v) < 0 ? -1 : 0;
+    if (fclose(f) != 0)
+        ret = -1;
+    return ret;
+}
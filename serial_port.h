@@ -0,0 +1,23 @@
+// serial_port.h
+#ifndef SERIAL_PORT_H
+#define SERIAL_PORT_H
+
+#include <stddef.h>
+#include <termios.h>
+
+// CLOCK_MONOTONIC in microseconds
+double now_us(void);
+// B* constant for a numeric rate, B0 if unsupported
+speed_t baud_to_speed(long baud);
+// Raw 8N1, no flow control, VMIN=0/VTIME=0; rates without a B* constant
+// go through termios2 BOTHER and the driver picks the closest it can do
+int configure_port(int fd, long baud);
+int set_vmin_vtime(int fd, int vmin, int vtime);
+
+// /sys/class/tty/<name>/<attr> for a /dev path or a bare tty name
+void tty_sysfs_path(const char *dev, const char *attr, char *out, size_t len);
+// -1 if missing or unreadable
+int sysfs_read_int(const char *path);
+int sysfs_write_int(const char *path, int v);
+
+#endif
@@ -0,0 +1,173 @@
+// serial_stats.c
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <dirent.h>
+#include <limits.h>
+#include <unistd.h>
+
+#include "serial_stats.h"
+
+static int parse_line(const char *buf, struct serial_line *sl) {
+    char copy[512], *tok, *save = NULL;
+
+    memset(sl, 0, sizeof(*sl));
+    if (sscanf(buf, "%d:", &sl->line) != 1)
+        return -1;
+
+    snprintf(copy, sizeof(copy), "%s", buf);
+    for (tok = strtok_r(copy, " \t\n", &save); tok; tok = strtok_r(NULL, " \t\n", &save)) {
+        char *val = strchr(tok, ':');
+        if (!val)
+            continue;
+        *val++ = '\0';
+        if (!strcmp(tok, "uart"))
+            snprintf(sl->uart, sizeof(sl->uart), "%s", val);
+        else if (!strcmp(tok, "port"))
+            sl->port = strtoul(val, NULL, 16);
+        else if (!strcmp(tok, "mmio"))
+            sl->mmio = 1;
+        else if (!strcmp(tok, "irq"))
+            sl->irq = atoi(val);
+        else if (!strcmp(tok, "tx"))
+            sl->tx = strtoull(val, NULL, 10);
+        else if (!strcmp(tok, "rx"))
+            sl->rx = strtoull(val, NULL, 10);
+        else if (!strcmp(tok, "fe"))
+            sl->fe = strtoull(val, NULL, 10);
+        else if (!strcmp(tok, "pe"))
+            sl->pe = strtoull(val, NULL, 10);
+        else if (!strcmp(tok, "brk"))
+            sl->brk = strtoull(val, NULL, 10);
+        else if (!strcmp(tok, "oe"))
+            sl->oe = strtoull(val, NULL, 10);
+        else if (!strcmp(tok, "bo"))
+            sl->bo = strtoull(val, NULL, 10);
+    }
+    return 0;
+}
+
+static int read_lines(struct serial_line *out, int max, int all) {
+    FILE *f = fopen("/proc/tty/driver/serial", "r");
+    char buf[512];
+    int n = 0;
+
+    if (!f)
+        return -1;
+    while (n < max && fgets(buf, sizeof(buf), f)) {
+        struct serial_line sl;
+        if (!isdigit((unsigned char)buf[0]) || parse_line(buf, &sl) != 0)
+            continue;
+        // same acceptance rule as uart_probe.sh
+        if (!all && (!strcmp(sl.uart, "unknown") || sl.irq <= 0 ||
+                     (sl.port == 0 && !sl.mmio)))
+            continue;
+        out[n++] = sl;
+    }
+    fclose(f);
+    return n;
+}
+
+int serial_lines_read(struct serial_line *out, int max) {
+    return read_lines(out, max, 0);
+}
+
+int serial_lines_read_all(struct serial_line *out, int max) {
+    return read_lines(out, max, 1);
+}
+
+int irq_counts_read(uint64_t *counts, int max_irq) {
+    FILE *f = fopen("/proc/interrupts", "r");
+    char buf[4096];
+
+    if (!f)
+        return -1;
+    memset(counts, 0, max_irq * sizeof(*counts));
+    while (fgets(buf, sizeof(buf), f)) {
+        char *p = buf, *end;
+        long irq = strtol(p, &end, 10);
+        uint64_t sum = 0;
+
+        if (end == p || *end != ':' || irq < 0 || irq >= max_irq)
+            continue;
+        p = end + 1;
+        for (;;) {
+            unsigned long long v = strtoull(p, &end, 10);
+            if (end == p)
+                break;
+            sum += v;
+            p = end;
+        }
+        counts[irq] = sum;
+    }
+    fclose(f);
+    return 0;
+}
+
+int irq_share_count(int irq) {
+    FILE *f = fopen("/proc/interrupts", "r");
+    char buf[4096];
+    int n = 0;
+
+    if (!f)
+        return 0;
+    while (fgets(buf, sizeof(buf), f)) {
+        char *end;
+        long v = strtol(buf, &end, 10);
+        if (end == buf || *end != ':' || v != irq)
+            continue;
+        // actions are the comma separated names at the end of the line
+        n = 1;
+        for (char *c = buf; *c; c++)
+            if (*c == ',')
+                n++;
+        break;
+    }
+    fclose(f);
+    return n;
+}
+
+static int pid_has_open(const char *pid, const char *target) {
+    char dir[300], link[PATH_MAX], path[PATH_MAX + 64];
+    struct dirent *de;
+    DIR *d;
+    int found = 0;
+
+    snprintf(dir, sizeof(dir), "/proc/%s/fd", pid);
+    d = opendir(dir);
+    if (!d)
+        return 0;
+    while (!found && (de = readdir(d))) {
+        ssize_t n;
+        snprintf(path, sizeof(path), "%s/%s", dir, de->d_name);
+        n = readlink(path, link, sizeof(link) - 1);
+        if (n <= 0)
+            continue;
+        link[n] = '\0';
+        found = !strcmp(link, target);
+    }
+    closedir(d);
+    return found;
+}
+
+int tty_in_use(const char *dev) {
+    char target[PATH_MAX], self[16];
+    struct dirent *de;
+    DIR *d;
+    int used = 0;
+
+    if (!realpath(dev, target))
+        return 0;
+    snprintf(self, sizeof(self), "%d", (int)getpid());
+    d = opendir("/proc");
+    if (!d)
+        return 0;
+    while (!used && (de = readdir(d))) {
+        if (!isdigit((unsigned char)de->d_name[0]) || !strcmp(de->d_name, self))
+            continue;
+        used = pid_has_open(de->d_name, target);
+    }
+    closedir(d);
+    return used;
+}
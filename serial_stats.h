@@ -0,0 +1,38 @@
+// serial_stats.h
+#ifndef SERIAL_STATS_H
+#define SERIAL_STATS_H
+
+#include <stdint.h>
+
+#define SERIAL_LINES_MAX    64
+#define IRQ_MAX             1024
+
+/*
+ * One row of /proc/tty/driver/serial. The counters are the driver's own
+ * icount, readable without opening (and thereby reprogramming) the port.
+ * Reading the file needs root.
+ */
+struct serial_line {
+    int line;                   // ttyS<line>
+    char uart[24];              // "16550A", "unknown", ...
+    unsigned long port;         // I/O port, 0 for MMIO
+    int mmio;
+    int irq;
+    uint64_t tx, rx;
+    uint64_t fe, pe, brk, oe, bo;
+};
+
+// Initialized lines only (uart known, irq set, I/O or MMIO resource), -1 on error
+int serial_lines_read(struct serial_line *out, int max);
+// Every line, including unknown ones, -1 on error
+int serial_lines_read_all(struct serial_line *out, int max);
+
+// Per IRQ totals over all CPUs from /proc/interrupts, 0 on success
+int irq_counts_read(uint64_t *counts, int max_irq);
+// Number of handlers sharing an IRQ, from the action list in /proc/interrupts
+int irq_share_count(int irq);
+
+// 1 if a process other than this one has dev open, from /proc/<pid>/fd
+int tty_in_use(const char *dev);
+
+#endif
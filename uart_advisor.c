@@ -0,0 +1,723 @@
+// uart_advisor.c
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <math.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/serial.h>
+
+#include "serial_model.h"
+#include "serial_port.h"
+
+#define BAUD_DEFAULT        115200
+#define FIFO_DEFAULT        16
+#define MESSAGES_DEFAULT    20000
+#define SLO_DEFAULT         2000        // us, p99 on top of the wire time
+#define IRQ_DEFAULT         20          // us
+#define SECONDS_DEFAULT     10
+#define LEVELS_MAX          256
+#define BINS_MAX            4096
+#define PROBE_DEBUGFS       "/sys/kernel/debug/uart_probe"
+
+/*
+ * Recommends RX and TX trigger levels for a traffic profile: the level
+ * with the fewest interrupts per second whose p99 latency stays within
+ * the SLO and whose FIFO headroom at the trigger covers the interrupt
+ * latency plus the margin. RX runs the profile through
+ * model_simulate_rx(), TX takes each message as one write() through
+ * model_predict(). Latency is what the trigger adds on top of the wire
+ * time: last byte on the wire to read() for RX, idle line between
+ * refills for TX.
+ *
+ * A profile is either described on the command line or a file:
+ *
+ *   # comment
+ *   msg <bytes> <count>        message size distribution
+ *   gap <us> <count>           idle time before a message
+ *
+ * --capture writes one from live traffic.
+ */
+struct dist {
+    int kind;                   // DIST_*
+    double a, b;
+    int n;
+    double v[BINS_MAX], w[BINS_MAX], wsum;
+};
+
+enum { DIST_FIXED, DIST_UNIFORM, DIST_EXP, DIST_TABLE };
+
+struct profile {
+    struct dist size, gap;      // bytes, us
+};
+
+struct candidate {
+    int level;
+    double p50_us, p99_us, irqs_per_sec, margin_us;
+    unsigned long overruns;
+    const char *verdict;
+};
+
+static volatile sig_atomic_t stop_requested;
+
+static void on_signal(int sig) {
+    (void)sig;
+    stop_requested = 1;
+}
+
+// xorshift64*, the same sequence for every candidate
+static uint64_t rng_state;
+
+static double rng_uniform(void) {
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return ((rng_state * 0x2545F4914F6CDD1DULL) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static double dist_sample(const struct dist *d) {
+    double u = rng_uniform(), acc = 0;
+    int i;
+
+    switch (d->kind) {
+    case DIST_UNIFORM:
+        return d->a + u * (d->b - d->a);
+    case DIST_EXP:
+        return -d->a * log(1 - u);
+    case DIST_TABLE:
+        u *= d->wsum;
+        for (i = 0; i < d->n - 1; i++) {
+            acc += d->w[i];
+            if (u < acc)
+                break;
+        }
+        return d->v[i];
+    default:
+        return d->a;
+    }
+}
+
+static double dist_mean(const struct dist *d) {
+    double sum = 0;
+    int i;
+
+    switch (d->kind) {
+    case DIST_UNIFORM:
+        return (d->a + d->b) / 2;
+    case DIST_TABLE:
+        for (i = 0; i < d->n; i++)
+            sum += d->v[i] * d->w[i];
+        return d->wsum ? sum / d->wsum : 0;
+    default:
+        return d->a;
+    }
+}
+
+static int dist_add(struct dist *d, double v, double w) {
+    int i;
+
+    if (v < 0 || w <= 0)
+        return -1;
+    d->kind = DIST_TABLE;
+    for (i = 0; i < d->n; i++) {
+        if (d->v[i] == v) {
+            d->w[i] += w;
+            d->wsum += w;
+            return 0;
+        }
+    }
+    if (d->n >= BINS_MAX)
+        return -1;
+    d->v[d->n] = v;
+    d->w[d->n++] = w;
+    d->wsum += w;
+    return 0;
+}
+
+// "X", "A-B" (uniform), "exp:X" (exponential, mean X) or "a,b,c"
+static int dist_parse(const char *s, struct dist *d) {
+    char *end;
+
+    memset(d, 0, sizeof(*d));
+    if (!strncmp(s, "exp:", 4)) {
+        d->kind = DIST_EXP;
+        d->a = strtod(s + 4, &end);
+        return *end || d->a <= 0 ? -1 : 0;
+    }
+    if (strchr(s, ',')) {
+        char *copy = strdup(s), *save = NULL, *tok;
+        int ret = 0;
+        for (tok = strtok_r(copy, ",", &save); tok && !ret; tok = strtok_r(NULL, ",", &save)) {
+            double v = strtod(tok, &end);
+            ret = *end ? -1 : dist_add(d, v, 1);
+        }
+        free(copy);
+        return ret;
+    }
+    d->a = strtod(s, &end);
+    if (*end == '-') {
+        d->kind = DIST_UNIFORM;
+        d->b = strtod(end + 1, &end);
+        return *end || d->a < 0 || d->b < d->a ? -1 : 0;
+    }
+    d->kind = DIST_FIXED;
+    return *end || d->a < 0 ? -1 : 0;
+}
+
+static int profile_load(const char *path, struct profile *p) {
+    FILE *f = fopen(path, "r");
+    char buf[256], key[16];
+    int lineno = 0;
+    double v, w;
+
+    if (!f) {
+        perror(path);
+        return -1;
+    }
+    memset(p, 0, sizeof(*p));
+    while (fgets(buf, sizeof(buf), f)) {
+        char *hash = strchr(buf, '#');
+        int n;
+
+        lineno++;
+        if (hash)
+            *hash = '\0';
+        n = sscanf(buf, "%15s %lf %lf", key, &v, &w);
+        if (n <= 0)
+            continue;
+        if (n == 2)
+            w = 1;
+        if (n < 2 || (strcmp(key, "msg") && strcmp(key, "gap")) ||
+            dist_add(!strcmp(key, "msg") ? &p->size : &p->gap, v, w) != 0) {
+            fprintf(stderr, "%s:%d: cannot parse\n", path, lineno);
+            fclose(f);
+            return -1;
+        }
+    }
+    fclose(f);
+    if (!p->size.n) {
+        fprintf(stderr, "%s: no msg lines\n", path);
+        return -1;
+    }
+    if (!p->gap.n)
+        dist_add(&p->gap, 0, 1);
+    return 0;
+}
+
+/*
+ * Live traffic into a profile. With the RX trigger at 1 every byte is its
+ * own interrupt, so the read() timestamps are close to the line; a quiet
+ * period longer than split_us ends a message.
+ */
+static int capture(const char *dev, long baud, int seconds, double split_us, FILE *out) {
+    static struct profile p;
+    char path[256];
+    unsigned char buf[4096];
+    double char_us = 10 * 1e6 / baud, t_end, last = -1, msg_end = 0;
+    int fd, old_trig, msg = 0, nmsg = 0, i;
+
+    fd = open(dev, O_RDWR | O_NOCTTY);
+    if (fd < 0 || configure_port(fd, baud) != 0) {
+        perror(dev);
+        if (fd >= 0)
+            close(fd);
+        return -1;
+    }
+    tty_sysfs_path(dev, "rx_trig_bytes", path, sizeof(path));
+    old_trig = sysfs_read_int(path);
+    if (old_trig > 1 && sysfs_write_int(path, 1) != 0)
+        fprintf(stderr, "%s: cannot set 1, message edges blur by the trigger\n", path);
+
+    memset(&p, 0, sizeof(p));
+    signal(SIGINT, on_signal);
+    tcflush(fd, TCIFLUSH);
+    t_end = now_us() + seconds * 1e6;
+    while (!stop_requested && now_us() < t_end) {
+        struct pollfd pfd = { .fd = fd, .events = POLLIN };
+        int ret = poll(&pfd, 1, 100);
+        double now = now_us();
+        ssize_t n;
+
+        if (msg && now - last > split_us) {
+            dist_add(&p.size, msg, 1);
+            msg_end = last;
+            msg = 0;
+            nmsg++;
+        }
+        if (ret <= 0)
+            continue;
+        n = read(fd, buf, sizeof(buf));
+        if (n <= 0)
+            continue;
+        if (!msg && nmsg) {
+            // the first chunk's bytes were on the wire before the read
+            double gap = now - n * char_us - msg_end;
+            char q[32];
+
+            // two significant digits keep the table short
+            snprintf(q, sizeof(q), "%.2g", gap > 0 ? gap : 0);
+            dist_add(&p.gap, atof(q), 1);
+        }
+        msg += n;
+        last = now;
+    }
+    if (msg) {
+        dist_add(&p.size, msg, 1);
+        nmsg++;
+    }
+    if (old_trig > 1)
+        sysfs_write_int(path, old_trig);
+    close(fd);
+
+    fprintf(out, "# %s, %ld baud, %d s, %d messages, split at %.0f us\n",
+            dev, baud, seconds, nmsg, split_us);
+    for (i = 0; i < p.size.n; i++)
+        fprintf(out, "msg %.0f %.0f\n", p.size.v[i], p.size.w[i]);
+    for (i = 0; i < p.gap.n; i++)
+        fprintf(out, "gap %.0f %.0f\n", p.gap.v[i], p.gap.w[i]);
+    return nmsg ? 0 : -1;
+}
+
+/*
+ * The FCR/TCR trigger tables of the chips with fixed levels, by the names
+ * uart_probe's fingerprint uses. 16C950 and Exar levels are programmable
+ * byte by byte and fall through to the spread for the FIFO depth.
+ */
+static const struct chip_levels {
+    const char *chip;
+    int rx[4], tx[4];           // tx[0] == 0: no TX trigger, THRE at empty
+} chip_levels[] = {
+    { "16550a", { 1, 4, 8, 14 },   { 0 } },
+    { "16650",  { 8, 16, 24, 28 }, { 8, 16, 24, 30 } },
+    { "16654",  { 8, 16, 56, 60 }, { 8, 16, 32, 56 } },
+    { "16750",  { 1, 16, 32, 56 }, { 0 } },
+    { "16850",  { 8, 16, 56, 60 }, { 8, 16, 32, 56 } },
+};
+
+// uart_probe's chip name for a TIOCGSERIAL port type, NULL if it has none
+static const char *chip_from_type(int type) {
+    switch (type) {
+    case PORT_16550A:   return "16550a";
+    case PORT_16650:
+    case PORT_16650V2:  return "16650";
+    case PORT_16654:    return "16654";
+    case PORT_16750:    return "16750";
+    case PORT_16850:    return "16850";
+    case PORT_16C950:   return "16c950";
+    }
+    return NULL;
+}
+
+// The "chip:" line of uart_probe's fingerprint for the selected port
+static int chip_from_probe(char *chip, size_t len) {
+    FILE *f = fopen(PROBE_DEBUGFS "/fingerprint", "r");
+    char line[128], name[32];
+    int ret = -1;
+
+    if (!f)
+        return -1;
+    while (fgets(line, sizeof(line), f))
+        if (sscanf(line, "chip: %31s", name) == 1) {
+            snprintf(chip, len, "%s", name);
+            ret = 0;
+            break;
+        }
+    fclose(f);
+    return ret;
+}
+
+/*
+ * The levels the chip's FCR/TCR table offers, or without a known chip the
+ * usual choices for the FIFO depth. Nothing is written to the port.
+ */
+static int levels_default(int fifo, int rx, const char *chip, int *out) {
+    static const int l16[] = { 1, 4, 8, 14 }, l32[] = { 8, 16, 24, 28 },
+                     l64[] = { 1, 16, 32, 56 };
+    const int *src = fifo == 16 ? l16 : fifo == 32 ? l32 : fifo == 64 ? l64 : NULL;
+    int i, n;
+
+    for (i = 0; chip && i < (int)(sizeof(chip_levels) / sizeof(chip_levels[0])); i++) {
+        const int *l = rx ? chip_levels[i].rx : chip_levels[i].tx;
+
+        if (strcmp(chip, chip_levels[i].chip))
+            continue;
+        if (!l[0]) {
+            out[0] = 1;
+            return 1;
+        }
+        for (n = 0; n < 4 && l[n] <= fifo; n++)
+            out[n] = l[n];
+        if (n)
+            return n;
+        break;
+    }
+
+    if (fifo <= 1 || (!rx && fifo == 16)) {
+        out[0] = 1;
+        return 1;
+    }
+    if (src && rx) {
+        for (i = 0; i < 4; i++)
+            out[i] = src[i];
+        return 4;
+    }
+    out[0] = 1;
+    out[1] = fifo / 4;
+    out[2] = fifo / 2;
+    out[3] = fifo * 3 / 4;
+    if (!rx)
+        return 4;
+    out[4] = fifo - fifo / 8;
+    return 5;
+}
+
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return x < y ? -1 : x > y;
+}
+
+// p-th percentile of the non-negative entries, which are sorted first
+static double percentile(double *v, int n, double p) {
+    int i, k = 0;
+
+    for (i = 0; i < n; i++)
+        if (v[i] >= 0)
+            v[k++] = v[i];
+    if (!k)
+        return 0;
+    qsort(v, k, sizeof(*v), cmp_double);
+    return v[(int)((k - 1) * p / 100.0 + 0.5)];
+}
+
+// The passing candidate with the fewest interrupts, the lowest p99 if none pass
+static int pick(const struct candidate *c, int n) {
+    int i, best = -1;
+
+    for (i = 0; i < n; i++)
+        if (!strcmp(c[i].verdict, "ok") &&
+            (best < 0 || c[i].irqs_per_sec < c[best].irqs_per_sec ||
+             (c[i].irqs_per_sec == c[best].irqs_per_sec && c[i].p99_us < c[best].p99_us)))
+            best = i;
+    if (best >= 0)
+        return best;
+    for (i = 0; i < n; i++)
+        if (!c[i].overruns && strcmp(c[i].verdict, "not possible") &&
+            (best < 0 || c[i].p99_us < c[best].p99_us))
+            best = i;
+    return best;
+}
+
+static void print_candidates(const char *dir, const struct candidate *c, int n, int best,
+                             const char *dev) {
+    int i;
+
+    printf("%s\n%5s %10s %10s %10s %10s %9s  %s\n", dir, "trig", "p50_us", "p99_us",
+           "irqs/s", "margin_us", "overruns", "verdict");
+    for (i = 0; i < n; i++)
+        printf("%5d %10.1f %10.1f %10.0f %10.1f %9lu  %s%s\n", c[i].level, c[i].p50_us,
+               c[i].p99_us, c[i].irqs_per_sec, c[i].margin_us, c[i].overruns,
+               c[i].verdict, i == best ? " <=" : "");
+    if (best < 0) {
+        printf("no %s level avoids overruns\n\n", dir);
+        return;
+    }
+    printf("recommended %s_trig_bytes: %d%s\n", dir, c[best].level,
+           strcmp(c[best].verdict, "ok") ? " (misses the SLO or margin, lowest p99)" : "");
+    if (dev)
+        printf("  echo %d > /sys/class/tty/%s/%s_trig_bytes\n", c[best].level, dev, dir);
+    printf("\n");
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+        "Usage: %s [options] (--profile <file> | --size <spec> [--gap <spec>])\n"
+        "       %s --capture <dev> [-b rate] [--seconds n] [--split-us us]\n"
+        "  -p, --profile <file>      msg/gap profile, as written by --capture\n"
+        "  -s, --size <spec>         Message bytes: X, A-B, a,b,c\n"
+        "  -g, --gap <spec>          Idle us before a message: X, A-B, exp:X, a,b,c (default 0)\n"
+        "  -d, --device <dev>        FIFO depth and chip type from the port (TIOCGSERIAL)\n"
+        "  -P, --probe               With -d, FIFO depths and chip from uart_probe (root)\n"
+        "  -F, --fifo <bytes>        FIFO depth without -d (default %d)\n"
+        "      --rx-levels <list>    RX trigger levels to consider\n"
+        "      --tx-levels <list>    TX trigger levels to consider\n"
+        "  -b, --baud <rate>         Line rate (default %d)\n"
+        "  -f, --format <8N1>        Frame format\n"
+        "  -S, --slo-us <us>         p99 latency on top of the wire time (default %d)\n"
+        "  -m, --margin-us <us>      FIFO headroom beyond the interrupt latency (default 0)\n"
+        "  -I, --irq-us <us>         Interrupt to FIFO serviced (default %d)\n"
+        "  -W, --wake-us <us>        Flip buffer push to read() returning (default 0)\n"
+        "  -c, --timeout <chars>     Character timeout (default 4)\n"
+        "  -n, --messages <n>        Messages to simulate (default %d)\n"
+        "  -C, --capture <dev>       Write a profile of the traffic arriving on dev\n"
+        "      --seconds <n>         Capture length (default %d)\n"
+        "      --split-us <us>       Quiet time that ends a message (default 5 chars)\n",
+        prog, prog, FIFO_DEFAULT, BAUD_DEFAULT, SLO_DEFAULT, IRQ_DEFAULT,
+        MESSAGES_DEFAULT, SECONDS_DEFAULT);
+}
+
+enum {
+    OPT_RX_LEVELS = 256,
+    OPT_TX_LEVELS,
+    OPT_SECONDS,
+    OPT_SPLIT,
+};
+
+static int parse_levels(const char *csv, int *out) {
+    struct dist d;
+    int i;
+
+    if (dist_parse(csv, &d) != 0)
+        return -1;
+    if (d.kind == DIST_FIXED) {
+        out[0] = d.a;
+        return out[0] >= 1 ? 1 : -1;
+    }
+    if (d.kind != DIST_TABLE)
+        return -1;
+    for (i = 0; i < d.n && i < LEVELS_MAX; i++)
+        if ((out[i] = d.v[i]) < 1)
+            return -1;
+    return i;
+}
+
+int main(int argc, char *argv[]) {
+    static const struct option long_opts[] = {
+        { "profile",   required_argument, NULL, 'p' },
+        { "size",      required_argument, NULL, 's' },
+        { "gap",       required_argument, NULL, 'g' },
+        { "device",    required_argument, NULL, 'd' },
+        { "probe",     no_argument,       NULL, 'P' },
+        { "fifo",      required_argument, NULL, 'F' },
+        { "rx-levels", required_argument, NULL, OPT_RX_LEVELS },
+        { "tx-levels", required_argument, NULL, OPT_TX_LEVELS },
+        { "baud",      required_argument, NULL, 'b' },
+        { "format",    required_argument, NULL, 'f' },
+        { "slo-us",    required_argument, NULL, 'S' },
+        { "margin-us", required_argument, NULL, 'm' },
+        { "irq-us",    required_argument, NULL, 'I' },
+        { "wake-us",   required_argument, NULL, 'W' },
+        { "timeout",   required_argument, NULL, 'c' },
+        { "messages",  required_argument, NULL, 'n' },
+        { "capture",   required_argument, NULL, 'C' },
+        { "seconds",   required_argument, NULL, OPT_SECONDS },
+        { "split-us",  required_argument, NULL, OPT_SPLIT },
+        { "help",      no_argument,       NULL, 'h' },
+        { NULL, 0, NULL, 0 }
+    };
+    static struct profile prof;
+    static struct candidate rx[LEVELS_MAX], tx[LEVELS_MAX];
+    int rx_levels[LEVELS_MAX], tx_levels[LEVELS_MAX], nrx = 0, ntx = 0;
+    const char *profile = NULL, *size = NULL, *gap = "0", *dev = NULL, *cap = NULL;
+    const char *format = "8N1";
+    int fifo = FIFO_DEFAULT, rx_fifo, tx_fifo, probe = 0, messages = MESSAGES_DEFAULT;
+    int seconds = SECONDS_DEFAULT, opt, i, j;
+    double slo = SLO_DEFAULT, margin = 0, irq_us = IRQ_DEFAULT, wake_us = 0, timeout = 4;
+    double split_us = 0;
+    long baud = BAUD_DEFAULT;
+    struct serial_model m;
+    struct model_pred pred;
+    int *sizes;
+    double *gaps, *lat;
+    char fmt[8], probe_chip[32];
+    const char *chip = NULL;
+
+    while ((opt = getopt_long(argc, argv, "p:s:g:d:PF:b:f:S:m:I:W:c:n:C:h",
+                              long_opts, NULL)) != -1) {
+        switch (opt) {
+        case 'p': profile = optarg; break;
+        case 's': size = optarg; break;
+        case 'g': gap = optarg; break;
+        case 'd': dev = optarg; break;
+        case 'P': probe = 1; break;
+        case 'F': fifo = atoi(optarg); break;
+        case OPT_RX_LEVELS:
+            if ((nrx = parse_levels(optarg, rx_levels)) < 1) {
+                fprintf(stderr, "Invalid level list '%s'\n", optarg);
+                return 1;
+            }
+            break;
+        case OPT_TX_LEVELS:
+            if ((ntx = parse_levels(optarg, tx_levels)) < 1) {
+                fprintf(stderr, "Invalid level list '%s'\n", optarg);
+                return 1;
+            }
+            break;
+        case 'b': baud = strtol(optarg, NULL, 10); break;
+        case 'f': format = optarg; break;
+        case 'S': slo = atof(optarg); break;
+        case 'm': margin = atof(optarg); break;
+        case 'I': irq_us = atof(optarg); break;
+        case 'W': wake_us = atof(optarg); break;
+        case 'c': timeout = atof(optarg); break;
+        case 'n': messages = atoi(optarg); break;
+        case 'C': cap = optarg; break;
+        case OPT_SECONDS: seconds = atoi(optarg); break;
+        case OPT_SPLIT: split_us = atof(optarg); break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (baud <= 0 || fifo < 1 || slo <= 0 || margin < 0 || irq_us < 0 || wake_us < 0 ||
+        timeout < 0 || messages < 1 || seconds < 1 || split_us < 0 ||
+        (!cap && !profile == !size)) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if (cap) {
+        if (!split_us)
+            split_us = 5 * 10 * 1e6 / baud;
+        return capture(cap, baud, seconds, split_us, stdout) ? 1 : 0;
+    }
+
+    if (profile) {
+        if (profile_load(profile, &prof) != 0)
+            return 1;
+    } else if (dist_parse(size, &prof.size) != 0 || dist_parse(gap, &prof.gap) != 0) {
+        fprintf(stderr, "Invalid --size or --gap\n");
+        return 1;
+    }
+
+    model_init(&m, baud, fifo);
+    if (model_parse_format(&m, format) != 0) {
+        fprintf(stderr, "Invalid format '%s'\n", format);
+        return 1;
+    }
+    m.timeout_chars = timeout;
+    m.irq_ns = irq_us * 1e3;
+    m.wake_ns = wake_us * 1e3;
+
+    if (dev) {
+        struct serial_struct ss;
+        char path[64];
+        int fd;
+
+        if (!strchr(dev, '/')) {
+            snprintf(path, sizeof(path), "/dev/%.58s", dev);
+            dev = path;
+        }
+        fd = open(dev, O_RDWR | O_NOCTTY | O_NONBLOCK);
+        if (fd < 0 || model_from_port(&m, fd, dev) != 0) {
+            fprintf(stderr, "%s: %s\n", dev, strerror(errno));
+            return 1;
+        }
+        if (ioctl(fd, TIOCGSERIAL, &ss) == 0)
+            chip = chip_from_type(ss.type);
+        close(fd);
+
+        if (probe) {
+            // uart_probe needs the port closed; it measures past the FIFO
+            // depth the driver was told
+            const char *name = strrchr(dev, '/') + 1;
+            FILE *f = fopen(PROBE_DEBUGFS "/select_dev", "w");
+            int v;
+
+            if (!f || fprintf(f, "%s\n", name) < 0 || fclose(f) != 0) {
+                perror(PROBE_DEBUGFS "/select_dev");
+                return 1;
+            }
+            if ((v = sysfs_read_int(PROBE_DEBUGFS "/rx_fifo_size")) > 0)
+                m.rx_fifo = v;
+            if ((v = sysfs_read_int(PROBE_DEBUGFS "/tx_fifo_size")) > 0)
+                m.tx_fifo = v;
+            if (chip_from_probe(probe_chip, sizeof(probe_chip)) == 0)
+                chip = probe_chip;
+        }
+    }
+    rx_fifo = m.rx_fifo;
+    tx_fifo = m.tx_fifo;
+    if (!nrx)
+        nrx = levels_default(rx_fifo, 1, chip, rx_levels);
+    if (!ntx)
+        ntx = levels_default(tx_fifo, 0, chip, tx_levels);
+
+    sizes = calloc(messages, sizeof(*sizes));
+    gaps = calloc(messages, sizeof(*gaps));
+    lat = calloc(messages, sizeof(*lat));
+    if (!sizes || !gaps || !lat) {
+        perror("calloc");
+        return 1;
+    }
+    rng_state = 0x9E3779B97F4A7C15ULL;
+    for (i = 0; i < messages; i++) {
+        sizes[i] = lround(dist_sample(&prof.size));
+        if (sizes[i] < 1)
+            sizes[i] = 1;
+        gaps[i] = dist_sample(&prof.gap) * 1e3;
+    }
+
+    model_predict(&m, 0, &pred);
+    model_format(&m, fmt, sizeof(fmt));
+    {
+        double msg = dist_mean(&prof.size), idle = dist_mean(&prof.gap);
+        double rate = msg * 1e6 / (msg * pred.char_ns / 1e3 + idle);
+        printf("# profile: mean %.1f bytes per message, mean gap %.0f us, %.0f bytes/s "
+               "(%.0f%% of line)\n", msg, idle, rate, 100 * rate / pred.line_bps);
+    }
+    printf("# %ld baud %s, fifo rx %d tx %d, irq %.1f us, wake %.1f us, timeout %.1f chars\n"
+           "# p99 SLO %.0f us on top of the wire time, margin %.1f us, %d messages\n\n",
+           baud, fmt, rx_fifo, tx_fifo, irq_us, wake_us, timeout, slo, margin, messages);
+
+    for (i = 0; i < nrx; i++) {
+        struct candidate *c = &rx[i];
+        struct model_sim sim;
+
+        m.rx_trig = c->level = rx_levels[i];
+        if (c->level > rx_fifo || model_simulate_rx(&m, sizes, gaps, messages, lat, &sim) != 0) {
+            c->verdict = "not possible";
+            continue;
+        }
+        // lost messages count against the latency as a miss
+        for (j = 0; j < messages; j++)
+            if (lat[j] < 0)
+                lat[j] = INFINITY;
+        c->p50_us = percentile(lat, messages, 50) / 1e3;
+        c->p99_us = percentile(lat, messages, 99) / 1e3;
+        c->irqs_per_sec = sim.duration_ns ? sim.irqs * 1e9 / sim.duration_ns : 0;
+        c->margin_us = ((rx_fifo - c->level) * pred.char_ns - m.irq_ns) / 1e3;
+        c->overruns = sim.overruns;
+        c->verdict = sim.overruns ? "overruns" : c->margin_us < margin ? "margin" :
+                     c->p99_us > slo ? "slo" : "ok";
+    }
+
+    // TX: each message is one write(), refilled at every THRE
+    m.rx_trig = 1;
+    for (i = 0; i < ntx; i++) {
+        struct candidate *c = &tx[i];
+        double irqs = 0, t = 0;
+
+        m.tx_trig = c->level = tx_levels[i];
+        if (c->level > tx_fifo) {
+            c->verdict = "not possible";
+            continue;
+        }
+        for (j = 0; j < messages; j++) {
+            struct model_pred p;
+            model_predict(&m, sizes[j], &p);
+            lat[j] = p.tx_ns - sizes[j] * p.char_ns;
+            irqs += p.tx_irqs_per_byte * sizes[j];
+            // the same timeline for every level, so ties stay ties
+            t += sizes[j] * p.char_ns + (j ? gaps[j] : 0);
+        }
+        c->p50_us = percentile(lat, messages, 50) / 1e3;
+        c->p99_us = percentile(lat, messages, 99) / 1e3;
+        c->irqs_per_sec = t ? irqs * 1e9 / t : 0;
+        c->margin_us = (c->level * pred.char_ns - m.irq_ns) / 1e3;
+        c->verdict = c->p99_us > slo ? "slo" : "ok";
+    }
+
+    print_candidates("rx", rx, nrx, pick(rx, nrx), dev ? strrchr(dev, '/') + 1 : NULL);
+    print_candidates("tx", tx, ntx, pick(tx, ntx), dev ? strrchr(dev, '/') + 1 : NULL);
+    free(sizes);
+    free(gaps);
+    free(lat);
+    return 0;
+}
@@ -0,0 +1,698 @@
+// uart_exporter.c
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <poll.h>
+#include <signal.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <linux/serial.h>
+
+#include "hist.h"
+#include "multiport.h"
+#include "serial_port.h"
+#include "serial_stats.h"
+#include "uart_probe_ioctl.h"
+
+#ifndef TIOCM_LOOP
+#define TIOCM_LOOP          0x8000  // asm-generic/termios.h
+#endif
+
+#define PORTS_MAX           SERIAL_LINES_MAX
+#define INTERVAL_DEFAULT    15
+#define RTT_BAUD_DEFAULT    115200
+#define RTT_COUNT_DEFAULT   50
+#define PROBE_DEBUGFS       "/sys/kernel/debug/uart_probe"
+#define PROBE_MISC_DEV      "/dev/uart_probe"
+#define PROBE_CLAIM_MS      60000
+#define OUT_SIZE            (256 * 1024)
+
+#define PROBE_COUNT         UART_PROBE_COUNT
+
+static const char *const probe_files[PROBE_COUNT] = {
+    [UART_PROBE_RX_TRIG] = "rx_trig_level",
+    [UART_PROBE_RX_FIFO] = "rx_fifo_size",
+    [UART_PROBE_TX_FIFO] = "tx_fifo_size",
+    [UART_PROBE_TX_TRIG] = "tx_trig_level",
+    [UART_PROBE_RTS_OFF] = "rts_off_level",
+    [UART_PROBE_RTS_ON] = "rts_on_level",
+};
+
+struct exp_port {
+    char name[32];              // ttyS<N>
+    char dev[64];
+    int line;
+    int have_counts;
+    struct serial_line prev;
+    struct serial_line cur;
+    int shared;
+    double oe_rate;             // per second over the last interval
+    double irq_rate;
+    int idle;                   // no traffic and nobody else has it open
+
+    // short loopback RTT probes
+    double rtt_next;
+    int rtt_valid;
+    double rtt_p50_us, rtt_p99_us, rtt_max_us;
+    double rtt_stamp;
+    unsigned long long rtt_probes, rtt_lost;
+
+    // uart_probe module results, -1 when unknown
+    double probe_next;
+    int probe[PROBE_COUNT];
+    double probe_stamp;
+};
+
+static struct exp_port ports[PORTS_MAX];
+static int nports;
+static int use_proc;
+static int icount_open;
+static uint64_t irq_prev[IRQ_MAX], irq_cur[IRQ_MAX];
+static volatile sig_atomic_t stop_requested;
+
+static char outbuf[OUT_SIZE];
+static size_t out_len;
+
+static void on_signal(int sig) {
+    (void)sig;
+    stop_requested = 1;
+}
+
+static void out(const char *fmt, ...) {
+    va_list ap;
+    int n;
+
+    if (out_len >= sizeof(outbuf))
+        return;
+    va_start(ap, fmt);
+    n = vsnprintf(outbuf + out_len, sizeof(outbuf) - out_len, fmt, ap);
+    va_end(ap);
+    if (n > 0)
+        out_len += n;
+    if (out_len > sizeof(outbuf))
+        out_len = sizeof(outbuf);
+}
+
+static double wall_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void add_port(const char *name) {
+    struct exp_port *ep;
+    const char *base = strrchr(name, '/');
+    int i;
+
+    if (nports >= PORTS_MAX)
+        return;
+    ep = &ports[nports++];
+    memset(ep, 0, sizeof(*ep));
+    snprintf(ep->name, sizeof(ep->name), "%s", base ? base + 1 : name);
+    if (base)
+        snprintf(ep->dev, sizeof(ep->dev), "%s", name);
+    else
+        snprintf(ep->dev, sizeof(ep->dev), "/dev/%.58s", name);
+    if (sscanf(ep->name, "ttyS%d", &ep->line) != 1)
+        ep->line = -1;
+    for (i = 0; i < PROBE_COUNT; i++)
+        ep->probe[i] = -1;
+}
+
+/*
+ * Counters come from /proc/tty/driver/serial when it is readable (root),
+ * which does not touch the ports at all. With --icount-open each port is
+ * opened for TIOCGICOUNT instead and closed again right away. Every open
+ * and close runs the driver's startup and shutdown: the FIFOs are reset,
+ * DTR/RTS drop on close with HUPCL, and a uart_probe run at that moment
+ * fails with -EBUSY. So it is only done when asked for. The counters live
+ * in the uart_port, so they carry over from one open to the next.
+ */
+static int icount_read(struct exp_port *ep, struct serial_line *sl) {
+    struct serial_icounter_struct ic;
+    char path[256];
+    int fd, ret;
+
+    fd = open(ep->dev, O_RDONLY | O_NOCTTY | O_NONBLOCK);
+    if (fd < 0)
+        return -1;
+    ret = ioctl(fd, TIOCGICOUNT, &ic);
+    close(fd);
+    if (ret != 0)
+        return -1;
+
+    memset(sl, 0, sizeof(*sl));
+    sl->line = ep->line;
+    snprintf(sl->uart, sizeof(sl->uart), "unknown");
+    tty_sysfs_path(ep->name, "irq", path, sizeof(path));
+    sl->irq = sysfs_read_int(path);
+    sl->tx = (unsigned int)ic.tx;
+    sl->rx = (unsigned int)ic.rx;
+    sl->fe = (unsigned int)ic.frame;
+    sl->pe = (unsigned int)ic.parity;
+    sl->brk = (unsigned int)ic.brk;
+    sl->oe = (unsigned int)ic.overrun;
+    sl->bo = (unsigned int)ic.buf_overrun;
+    return 0;
+}
+
+static void sample(double secs) {
+    static struct serial_line lines[SERIAL_LINES_MAX];
+    int n = use_proc ? serial_lines_read_all(lines, SERIAL_LINES_MAX) : 0;
+    int i, j;
+
+    memcpy(irq_prev, irq_cur, sizeof(irq_cur));
+    irq_counts_read(irq_cur, IRQ_MAX);
+
+    for (i = 0; i < nports; i++) {
+        struct exp_port *ep = &ports[i];
+        struct serial_line sl;
+        int found = 0;
+
+        if (use_proc) {
+            for (j = 0; j < n && !found; j++)
+                if (lines[j].line == ep->line) {
+                    sl = lines[j];
+                    found = 1;
+                }
+        } else if (icount_open) {
+            found = icount_read(ep, &sl) == 0;
+        }
+        if (!found) {
+            ep->have_counts = 0;
+            ep->idle = 0;
+            continue;
+        }
+
+        ep->prev = ep->have_counts ? ep->cur : sl;
+        ep->cur = sl;
+        if (!ep->have_counts)
+            ep->shared = irq_share_count(sl.irq);
+        ep->have_counts = 1;
+
+        ep->oe_rate = ep->irq_rate = 0;
+        if (secs > 0) {
+            ep->oe_rate = (ep->cur.oe - ep->prev.oe) / secs;
+            if (sl.irq > 0 && sl.irq < IRQ_MAX)
+                ep->irq_rate = (irq_cur[sl.irq] - irq_prev[sl.irq]) / secs;
+        }
+        ep->idle = ep->cur.rx == ep->prev.rx && ep->cur.tx == ep->prev.tx &&
+                   !tty_in_use(ep->dev);
+    }
+}
+
+/*
+ * A handful of round trips in internal loopback. A second descriptor keeps
+ * the tty open across the probe so the original termios can be put back.
+ */
+static void rtt_probe(struct exp_port *ep, long baud, int count) {
+    static struct hist h;
+    struct termios saved;
+    struct mp_port mp;
+    int keep, loop = TIOCM_LOOP, lost;
+
+    keep = open(ep->dev, O_RDONLY | O_NOCTTY | O_NONBLOCK);
+    if (keep < 0)
+        return;
+    if (tcgetattr(keep, &saved) != 0 || mp_open(&mp, ep->dev, baud, 1, 0, 0) != 0) {
+        close(keep);
+        return;
+    }
+    if (ioctl(mp.fd, TIOCMBIS, &loop) == 0) {
+        hist_reset(&h);
+        lost = mp_run(&mp, count, &h);
+        ioctl(mp.fd, TIOCMBIC, &loop);
+
+        ep->rtt_probes++;
+        ep->rtt_lost += lost;
+        ep->rtt_valid = h.count > 0;
+        if (ep->rtt_valid) {
+            ep->rtt_p50_us = hist_percentile(&h, 50);
+            ep->rtt_p99_us = hist_percentile(&h, 99);
+            ep->rtt_max_us = h.max;
+        }
+        ep->rtt_stamp = wall_sec();
+    }
+    mp_close(&mp);
+    tcsetattr(keep, TCSANOW, &saved);
+    close(keep);
+}
+
+/*
+ * All probes of all the given ports in one ioctl on /dev/uart_probe.
+ * Ports that cannot be claimed, because a probe session or another
+ * claim holds them, are left out until the next round. Returns -1 when
+ * the device is not there so the caller can use debugfs.
+ */
+static int module_probe_batch(struct exp_port **due, int ndue) {
+    static struct uart_probe_cmd cmds[UART_PROBE_BATCH_MAX];
+    static struct uart_probe_result res[UART_PROBE_BATCH_MAX];
+    struct exp_port *eps[PORTS_MAX];
+    struct uart_probe_batch batch = {
+        .cmds = (uintptr_t)cmds,
+        .results = (uintptr_t)res,
+    };
+    int fd, i, k, n = 0, done;
+
+    fd = open(PROBE_MISC_DEV, O_RDWR | O_CLOEXEC);
+    if (fd < 0)
+        return -1;
+    // hold the ports so nothing opens them between probes; close releases
+    for (i = 0; i < ndue; i++) {
+        struct uart_probe_claim claim = { .timeout_ms = PROBE_CLAIM_MS };
+        snprintf(claim.port, sizeof(claim.port), "%.15s", due[i]->name);
+        if (n < UART_PROBE_BATCH_MAX / PROBE_COUNT &&
+            ioctl(fd, UART_PROBE_IOC_CLAIM, &claim) == 0)
+            eps[n++] = due[i];
+        else
+            due[i]->probe_next = 0;     // due again at the next sample
+    }
+    if (!n) {
+        close(fd);
+        return 0;
+    }
+
+    memset(cmds, 0, sizeof(cmds));
+    for (i = 0; i < n; i++)
+        for (k = 0; k < PROBE_COUNT; k++) {
+            struct uart_probe_cmd *c = &cmds[i * PROBE_COUNT + k];
+            snprintf(c->port, sizeof(c->port), "%.15s", eps[i]->name);
+            c->probe = k;
+        }
+    batch.count = n * PROBE_COUNT;
+    done = ioctl(fd, UART_PROBE_IOC_BATCH, &batch);
+    close(fd);
+    if (done < 0)
+        return -1;
+
+    for (i = 0; i < done; i++) {
+        struct exp_port *ep = eps[i / PROBE_COUNT];
+        if (res[i].probe >= PROBE_COUNT)
+            continue;
+        ep->probe[res[i].probe] = res[i].value >= 0 ? res[i].value : -1;
+        ep->probe_stamp = wall_sec();
+    }
+    return 0;
+}
+
+// Runs the module's probes, each read of a debugfs file is one probe
+static void module_probe(struct exp_port *ep) {
+    char path[128], buf[64];
+    FILE *f;
+    int i;
+
+    snprintf(path, sizeof(path), PROBE_DEBUGFS "/select_dev");
+    f = fopen(path, "w");
+    if (!f)
+        return;
+    fprintf(f, "%s\n", ep->name);
+    if (fclose(f) != 0)
+        return;
+
+    for (i = 0; i < PROBE_COUNT; i++) {
+        int v;
+        snprintf(path, sizeof(path), PROBE_DEBUGFS "/%s", probe_files[i]);
+        ep->probe[i] = -1;
+        f = fopen(path, "r");
+        if (!f)
+            continue;
+        if (fgets(buf, sizeof(buf), f) && sscanf(buf, "%d", &v) == 1)
+            ep->probe[i] = v;
+        fclose(f);
+    }
+    ep->probe_stamp = wall_sec();
+}
+
+static void family(const char *name, const char *type, const char *unit,
+                   const char *help) {
+    out("# TYPE %s %s\n", name, type);
+    if (unit)
+        out("# UNIT %s %s\n", name, unit);
+    out("# HELP %s %s\n", name, help);
+}
+
+static void port_sample(const char *name, const char *suffix,
+                        const struct exp_port *ep, double v) {
+    out("%s%s{port=\"%s\"} %.17g\n", name, suffix, ep->name, v);
+}
+
+static void counter(const char *name, const char *unit, const char *help,
+                    size_t field) {
+    int i;
+
+    family(name, "counter", unit, help);
+    for (i = 0; i < nports; i++) {
+        const struct exp_port *ep = &ports[i];
+        if (ep->have_counts)
+            port_sample(name, "_total", ep,
+                        *(const uint64_t *)((const char *)&ep->cur + field));
+    }
+}
+
+// OpenMetrics text, samples of one family kept together as the format requires
+static void render(double sample_secs) {
+    int i, k;
+
+    out_len = 0;
+
+    family("serial", "info", NULL, "UART type and IRQ of each port");
+    for (i = 0; i < nports; i++) {
+        const struct exp_port *ep = &ports[i];
+        if (ep->have_counts)
+            out("serial_info{port=\"%s\",uart=\"%s\",irq=\"%d\",irq_shared=\"%d\"} 1\n",
+                ep->name, ep->cur.uart, ep->cur.irq, ep->shared > 1);
+    }
+
+    counter("serial_tx_bytes", "bytes", "Bytes sent by the driver",
+            offsetof(struct serial_line, tx));
+    counter("serial_rx_bytes", "bytes", "Bytes received by the driver",
+            offsetof(struct serial_line, rx));
+    counter("serial_frame_errors", NULL, "Framing errors",
+            offsetof(struct serial_line, fe));
+    counter("serial_parity_errors", NULL, "Parity errors",
+            offsetof(struct serial_line, pe));
+    counter("serial_breaks", NULL, "Break conditions received",
+            offsetof(struct serial_line, brk));
+    counter("serial_overruns", NULL, "Hardware FIFO overruns",
+            offsetof(struct serial_line, oe));
+    counter("serial_buffer_overruns", NULL, "Flip buffer overruns",
+            offsetof(struct serial_line, bo));
+
+    family("serial_overrun_rate", "gauge", NULL,
+           "Overruns per second over the last sample interval");
+    for (i = 0; i < nports; i++)
+        if (ports[i].have_counts)
+            port_sample("serial_overrun_rate", "", &ports[i], ports[i].oe_rate);
+
+    family("serial_irq_interrupts", "counter", NULL,
+           "Interrupts on the port's IRQ line, all handlers on a shared line included");
+    for (i = 0; i < nports; i++) {
+        int irq = ports[i].cur.irq;
+        if (ports[i].have_counts && irq > 0 && irq < IRQ_MAX)
+            port_sample("serial_irq_interrupts", "_total", &ports[i], irq_cur[irq]);
+    }
+    family("serial_irq_rate", "gauge", NULL,
+           "Interrupts per second over the last sample interval");
+    for (i = 0; i < nports; i++)
+        if (ports[i].have_counts)
+            port_sample("serial_irq_rate", "", &ports[i], ports[i].irq_rate);
+
+    family("serial_rx_trigger_bytes", "gauge", "bytes", "Rx FIFO trigger level from sysfs");
+    for (i = 0; i < nports; i++) {
+        char path[256];
+        int v;
+        tty_sysfs_path(ports[i].name, "rx_trig_bytes", path, sizeof(path));
+        if ((v = sysfs_read_int(path)) >= 0)
+            port_sample("serial_rx_trigger_bytes", "", &ports[i], v);
+    }
+    family("serial_tx_trigger_bytes", "gauge", "bytes", "Tx FIFO trigger level from sysfs");
+    for (i = 0; i < nports; i++) {
+        char path[256];
+        int v;
+        tty_sysfs_path(ports[i].name, "tx_trig_bytes", path, sizeof(path));
+        if ((v = sysfs_read_int(path)) >= 0)
+            port_sample("serial_tx_trigger_bytes", "", &ports[i], v);
+    }
+
+    family("serial_rtt_seconds", "gauge", "seconds",
+           "Single byte loopback round trip from the last probe of an idle port");
+    for (i = 0; i < nports; i++) {
+        const struct exp_port *ep = &ports[i];
+        if (!ep->rtt_valid)
+            continue;
+        out("serial_rtt_seconds{port=\"%s\",stat=\"p50\"} %.9f\n", ep->name, ep->rtt_p50_us / 1e6);
+        out("serial_rtt_seconds{port=\"%s\",stat=\"p99\"} %.9f\n", ep->name, ep->rtt_p99_us / 1e6);
+        out("serial_rtt_seconds{port=\"%s\",stat=\"max\"} %.9f\n", ep->name, ep->rtt_max_us / 1e6);
+    }
+    family("serial_rtt_probes", "counter", NULL, "RTT probes run");
+    for (i = 0; i < nports; i++)
+        if (ports[i].rtt_probes)
+            port_sample("serial_rtt_probes", "_total", &ports[i], ports[i].rtt_probes);
+    family("serial_rtt_lost_frames", "counter", NULL, "RTT probe frames that did not come back");
+    for (i = 0; i < nports; i++)
+        if (ports[i].rtt_probes)
+            port_sample("serial_rtt_lost_frames", "_total", &ports[i], ports[i].rtt_lost);
+    family("serial_rtt_probe_timestamp_seconds", "gauge", "seconds", "Time of the last RTT probe");
+    for (i = 0; i < nports; i++)
+        if (ports[i].rtt_probes)
+            port_sample("serial_rtt_probe_timestamp_seconds", "", &ports[i], ports[i].rtt_stamp);
+
+    for (k = 0; k < PROBE_COUNT; k++) {
+        static const char *const names[PROBE_COUNT] = {
+            [UART_PROBE_RX_TRIG] = "uart_probe_rx_trigger_bytes",
+            [UART_PROBE_RX_FIFO] = "uart_probe_rx_fifo_bytes",
+            [UART_PROBE_TX_FIFO] = "uart_probe_tx_fifo_bytes",
+            [UART_PROBE_TX_TRIG] = "uart_probe_tx_trigger_bytes",
+            [UART_PROBE_RTS_OFF] = "uart_probe_rts_off_bytes",
+            [UART_PROBE_RTS_ON] = "uart_probe_rts_on_bytes",
+        };
+        family(names[k], "gauge", "bytes", "Measured by the uart_probe module");
+        for (i = 0; i < nports; i++)
+            if (ports[i].probe[k] >= 0)
+                port_sample(names[k], "", &ports[i], ports[i].probe[k]);
+    }
+    family("uart_probe_timestamp_seconds", "gauge", "seconds", "Time of the last uart_probe run");
+    for (i = 0; i < nports; i++)
+        if (ports[i].probe_stamp > 0)
+            port_sample("uart_probe_timestamp_seconds", "", &ports[i], ports[i].probe_stamp);
+
+    family("serial_exporter_sample_seconds", "gauge", "seconds",
+           "Time spent sampling, probes included");
+    out("serial_exporter_sample_seconds %.6f\n", sample_secs);
+    out("# EOF\n");
+}
+
+// Atomic replace, so a collector never reads a half written file
+static int write_file(const char *path) {
+    char tmp[4096];
+    int fd;
+
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+        return -1;
+    if (write(fd, outbuf, out_len) != (ssize_t)out_len || fsync(fd) != 0) {
+        close(fd);
+        unlink(tmp);
+        return -1;
+    }
+    close(fd);
+    return rename(tmp, path);
+}
+
+static int listen_unix(const char *path) {
+    struct sockaddr_un sa = { .sun_family = AF_UNIX };
+    int fd;
+
+    if (strlen(path) >= sizeof(sa.sun_path)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    strcpy(sa.sun_path, path);
+    unlink(path);
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        return -1;
+    if (bind(fd, (struct sockaddr *)&sa, sizeof(sa)) != 0 || listen(fd, 8) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Every connection gets the latest exposition and is closed
+static void serve_one(int lfd) {
+    struct timeval tv = { .tv_sec = 1 };
+    size_t off = 0;
+    int c = accept4(lfd, NULL, NULL, SOCK_CLOEXEC);
+
+    if (c < 0)
+        return;
+    setsockopt(c, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+    while (off < out_len) {
+        ssize_t n = send(c, outbuf + off, out_len - off, MSG_NOSIGNAL);
+        if (n <= 0)
+            break;
+        off += n;
+    }
+    close(c);
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+        "Usage: %s [options]\n"
+        "  -d, --device <list>      Comma separated ports (default: all initialized ttyS)\n"
+        "  -i, --interval <s>       Sample interval (default %d)\n"
+        "  -o, --output <file>      Write the exposition to file, replaced atomically\n"
+        "  -s, --socket <path>      Serve the exposition on a Unix socket\n"
+        "  -r, --rtt-every <s>      Loopback RTT probe of each idle port every s seconds\n"
+        "  -c, --rtt-count <n>      Round trips per RTT probe (default %d)\n"
+        "  -B, --baud <rate>        RTT probe line rate (default %d)\n"
+        "  -P, --probe <s>          uart_probe module probes of idle ports at start\n"
+        "                           and every s seconds (0: at start only)\n"
+        "  -O, --icount-open        Without /proc/tty/driver/serial, open each port\n"
+        "                           for its counters on every sample\n"
+        "  -1, --once               Sample once, write and exit\n"
+        "Without -o or -s the exposition goes to stdout.\n",
+        prog, INTERVAL_DEFAULT, RTT_COUNT_DEFAULT, RTT_BAUD_DEFAULT);
+}
+
+int main(int argc, char *argv[]) {
+    static const struct option long_opts[] = {
+        { "device",    required_argument, NULL, 'd' },
+        { "interval",  required_argument, NULL, 'i' },
+        { "output",    required_argument, NULL, 'o' },
+        { "socket",    required_argument, NULL, 's' },
+        { "rtt-every", required_argument, NULL, 'r' },
+        { "rtt-count", required_argument, NULL, 'c' },
+        { "baud",      required_argument, NULL, 'B' },
+        { "probe",     required_argument, NULL, 'P' },
+        { "icount-open", no_argument,     NULL, 'O' },
+        { "once",      no_argument,       NULL, '1' },
+        { "help",      no_argument,       NULL, 'h' },
+        { NULL, 0, NULL, 0 }
+    };
+    const char *devices = NULL, *output = NULL, *sock_path = NULL;
+    int interval = INTERVAL_DEFAULT, rtt_every = 0, rtt_count = RTT_COUNT_DEFAULT;
+    int probe_every = -1, once = 0, lfd = -1, opt, i, ndue;
+    long baud = RTT_BAUD_DEFAULT;
+    double t_prev;
+
+    while ((opt = getopt_long(argc, argv, "d:i:o:s:r:c:B:P:O1h", long_opts, NULL)) != -1) {
+        switch (opt) {
+        case 'd': devices = optarg; break;
+        case 'i': interval = atoi(optarg); break;
+        case 'o': output = optarg; break;
+        case 's': sock_path = optarg; break;
+        case 'r': rtt_every = atoi(optarg); break;
+        case 'c': rtt_count = atoi(optarg); break;
+        case 'B': baud = strtol(optarg, NULL, 10); break;
+        case 'P': probe_every = atoi(optarg); break;
+        case 'O': icount_open = 1; break;
+        case '1': once = 1; break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (interval < 1 || rtt_count < 1) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (rtt_every && baud <= 0) {
+        fprintf(stderr, "Unsupported baud rate %ld\n", baud);
+        return 1;
+    }
+
+    use_proc = access("/proc/tty/driver/serial", R_OK) == 0;
+    if (devices) {
+        char *copy = strdup(devices), *save = NULL, *tok;
+        for (tok = strtok_r(copy, ",", &save); tok; tok = strtok_r(NULL, ",", &save))
+            add_port(tok);
+        free(copy);
+    } else {
+        static struct serial_line lines[SERIAL_LINES_MAX];
+        int n = serial_lines_read(lines, SERIAL_LINES_MAX);
+        if (n < 0) {
+            fprintf(stderr, "Cannot read /proc/tty/driver/serial (needs root), use -d\n");
+            return 1;
+        }
+        for (i = 0; i < n; i++) {
+            char name[32];
+            snprintf(name, sizeof(name), "ttyS%d", lines[i].line);
+            add_port(name);
+        }
+    }
+    if (!nports) {
+        fprintf(stderr, "No ports to watch\n");
+        return 1;
+    }
+    if (!use_proc && !icount_open)
+        fprintf(stderr, "Cannot read /proc/tty/driver/serial, no counters (see --icount-open)\n");
+
+    if (sock_path) {
+        lfd = listen_unix(sock_path);
+        if (lfd < 0) {
+            fprintf(stderr, "%s: %s\n", sock_path, strerror(errno));
+            return 1;
+        }
+    }
+
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+    signal(SIGPIPE, SIG_IGN);
+
+    // baseline for the rates, the first exposition then covers one interval
+    sample(0);
+    t_prev = now_us();
+    if (!once)
+        sleep(interval);
+
+    while (!stop_requested) {
+        struct exp_port *due[PORTS_MAX];
+        double t0 = now_us(), deadline;
+
+        sample((t0 - t_prev) / 1e6);
+        t_prev = t0;
+
+        ndue = 0;
+        for (i = 0; i < nports && probe_every >= 0; i++)
+            if (ports[i].idle && t0 >= ports[i].probe_next) {
+                due[ndue++] = &ports[i];
+                ports[i].probe_next = probe_every ? t0 + probe_every * 1e6 : 1e300;
+            }
+        if (ndue && module_probe_batch(due, ndue) != 0)
+            for (i = 0; i < ndue && !stop_requested; i++)
+                module_probe(due[i]);
+
+        for (i = 0; i < nports && !stop_requested; i++) {
+            struct exp_port *ep = &ports[i];
+            if (!ep->idle)
+                continue;
+            if (rtt_every > 0 && t0 >= ep->rtt_next) {
+                rtt_probe(ep, baud, rtt_count);
+                ep->rtt_next = t0 + rtt_every * 1e6;
+            }
+        }
+        render((now_us() - t0) / 1e6);
+
+        if (output && write_file(output) != 0)
+            fprintf(stderr, "%s: %s\n", output, strerror(errno));
+        if (!output && !sock_path && write(STDOUT_FILENO, outbuf, out_len) < 0)
+            break;
+        if (once)
+            break;
+
+        // serve the socket until the next sample is due
+        deadline = t0 + interval * 1e6;
+        while (!stop_requested) {
+            double left = deadline - now_us();
+            if (left <= 0)
+                break;
+            if (lfd < 0) {
+                usleep(left > 1e6 ? 1000000 : (useconds_t)left);
+                continue;
+            }
+            struct pollfd pfd = { .fd = lfd, .events = POLLIN };
+            if (poll(&pfd, 1, (int)(left / 1000) + 1) > 0)
+                serve_one(lfd);
+        }
+    }
+
+    if (lfd >= 0) {
+        close(lfd);
+        unlink(sock_path);
+    }
+    return 0;
+}
@@ -0,0 +1,287 @@
+// uart_model.c
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/serial.h>
+
+#include "serial_model.h"
+#include "serial_port.h"
+
+#define BAUD_DEFAULT        115200
+#define FIFO_DEFAULT        16
+#define LIST_MAX            16
+#define PROBE_DEBUGFS       "/sys/kernel/debug/uart_probe"
+
+/*
+ * Prints what serial_model.h predicts for a port configuration: per RX
+ * trigger level, the loopback time to the last byte of each frame size
+ * and a continuous stream's interrupt rate and sustainable throughput.
+ * With -d the FIFO and trigger levels come from the port, and with
+ * --probe the uart_probe measurements of that port are set against the
+ * model's inputs.
+ */
+static int parse_list(const char *csv, int *out, int max) {
+    char *copy = strdup(csv), *save = NULL, *tok;
+    int n = 0;
+
+    for (tok = strtok_r(copy, ",", &save); tok; tok = strtok_r(NULL, ",", &save)) {
+        char *end;
+        long v = strtol(tok, &end, 10);
+        if (*end || v < 1 || n >= max) {
+            fprintf(stderr, "Invalid list '%s'\n", csv);
+            free(copy);
+            return -1;
+        }
+        out[n++] = v;
+    }
+    free(copy);
+    return n;
+}
+
+static void print_model(const struct serial_model *base, const int *trigs, int ntrig,
+                        const int *frames, int nframe) {
+    struct serial_model m = *base;
+    struct model_pred p;
+    char fmt[8];
+    int a, b;
+
+    model_format(&m, fmt, sizeof(fmt));
+    model_predict(&m, 0, &p);
+    printf("# %ld baud %s, %.1f us/char, line %.0f bytes/s, fifo rx %d tx %d, tx_trig %d,\n"
+           "# timeout %.1f chars, irq %.1f us, wake %.1f us\n",
+           m.baud, fmt, p.char_ns / 1e3, p.line_bps, m.rx_fifo, m.tx_fifo,
+           m.tx_trig, m.timeout_chars, m.irq_ns / 1e3, m.wake_ns / 1e3);
+    printf("%5s %7s %10s %10s %10s %9s %12s %10s %10s\n", "rxt", "frame",
+           "tx_us", "wait_us", "last_us", "irqs/B", "max_B/s", "irqs/s",
+           "margin_us");
+
+    for (a = 0; a < ntrig; a++) {
+        m.rx_trig = trigs[a];
+        for (b = 0; b < nframe; b++) {
+            model_predict(&m, frames[b], &p);
+            printf("%5d %7d %10.1f %10.1f %10.1f %9.3f\n", trigs[a], frames[b],
+                   p.tx_ns / 1e3, p.rx_wait_ns / 1e3, p.last_byte_ns / 1e3,
+                   p.irqs_per_byte);
+        }
+        model_predict(&m, 0, &p);
+        printf("%5d %7s %10s %10s %10s %9.3f %12.0f %10.0f %10.1f%s\n", trigs[a],
+               "stream", "-", "-", "-", p.irqs_per_byte, p.max_bps,
+               p.irqs_per_byte * p.max_bps, p.headroom_ns / 1e3,
+               p.headroom_ns < 0 ? " overrun" : "");
+    }
+}
+
+// A number from one of uart_probe's probe files in dir, -1 if it failed
+static long probe_value(const char *dir, const char *name) {
+    char path[160], buf[64];
+    FILE *f;
+    long v = -1;
+
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    f = fopen(path, "r");
+    if (!f)
+        return -1;
+    if (!fgets(buf, sizeof(buf), f) || sscanf(buf, "%ld", &v) != 1)
+        v = -1;
+    fclose(f);
+    return v;
+}
+
+static long probe_max_baud(void) {
+    FILE *f = fopen(PROBE_DEBUGFS "/max_baud", "r");
+    char buf[256];
+    long v = -1;
+
+    if (!f)
+        return -1;
+    while (fgets(buf, sizeof(buf), f))
+        if (sscanf(buf, "max_baud: %ld", &v) == 1)
+            break;
+    fclose(f);
+    return v;
+}
+
+/*
+ * The port's uart_probe results against what the model was given. The
+ * probes run in loopback on the closed port, so this comes after the
+ * port's own settings were read. The port's own directory under ports/
+ * is used when the module has one, so runs on other ports can go on at
+ * the same time; max_baud only exists for select_dev.
+ */
+static int probe_compare(const char *dev, const struct serial_model *m, long baud_base,
+                         int max_baud) {
+    static const char *const names[] = {
+        "rx_fifo_size", "rx_trig_level", "tx_fifo_size", "tx_trig_level",
+    };
+    const int predicted[] = { m->rx_fifo, m->rx_trig, m->tx_fifo, m->tx_trig };
+    const char *name = strrchr(dev, '/');
+    char dir[128];
+    size_t i;
+
+    name = name ? name + 1 : dev;
+    snprintf(dir, sizeof(dir), "%s/ports/%.32s", PROBE_DEBUGFS, name);
+    if (max_baud || access(dir, R_OK) != 0) {
+        FILE *f = fopen(PROBE_DEBUGFS "/select_dev", "w");
+
+        if (!f || fprintf(f, "%s\n", name) < 0 || fclose(f) != 0) {
+            perror(PROBE_DEBUGFS "/select_dev");
+            return -1;
+        }
+        if (access(dir, R_OK) != 0)
+            snprintf(dir, sizeof(dir), "%s", PROBE_DEBUGFS);
+    }
+
+    printf("\n");
+    model_header(stdout);
+    for (i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+        long v = probe_value(dir, names[i]);
+        if (v < 0)
+            printf("%-14s %-8s %12s\n", names[i], "bytes", "failed");
+        else
+            model_row(stdout, names[i], "bytes", v, predicted[i]);
+    }
+    if (max_baud) {
+        // baud_base is uartclk / 16, the fastest a 16x sampled divisor of 1 gives
+        long v = probe_max_baud();
+        if (v < 0)
+            printf("%-14s %-8s %12s\n", "max_baud", "baud", "failed");
+        else
+            model_row(stdout, "max_baud", "baud", v, baud_base);
+    }
+    return 0;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+        "Usage: %s [options]\n"
+        "  -b, --baud <rate>         Line rate (default %d)\n"
+        "  -f, --format <8N1>        Data bits, parity, stop bits (default 8N1)\n"
+        "  -F, --fifo <bytes>        RX and TX FIFO depth (default %d)\n"
+        "      --rx-fifo <bytes>     RX FIFO depth\n"
+        "      --tx-fifo <bytes>     TX FIFO depth\n"
+        "  -r, --rx-trig <list>      RX trigger levels (default: the port's, or 8)\n"
+        "  -t, --tx-trig <bytes>     THRE when fewer than this are left (default 1)\n"
+        "  -n, --frame <list>        Frame sizes (default 1,16,64,256)\n"
+        "  -c, --timeout <chars>     Character timeout (default 4)\n"
+        "  -I, --irq-us <us>         Interrupt to FIFO serviced\n"
+        "  -W, --wake-us <us>        Flip buffer push to read() returning\n"
+        "  -d, --device <dev>        Take FIFO depth and trigger levels from the port\n"
+        "  -P, --probe               With -d, compare the uart_probe results (root)\n"
+        "  -B, --max-baud            With --probe, also run the max_baud PRBS sweep\n",
+        prog, BAUD_DEFAULT, FIFO_DEFAULT);
+}
+
+enum {
+    OPT_RX_FIFO = 256,
+    OPT_TX_FIFO,
+};
+
+int main(int argc, char *argv[]) {
+    static const struct option long_opts[] = {
+        { "baud",     required_argument, NULL, 'b' },
+        { "format",   required_argument, NULL, 'f' },
+        { "fifo",     required_argument, NULL, 'F' },
+        { "rx-fifo",  required_argument, NULL, OPT_RX_FIFO },
+        { "tx-fifo",  required_argument, NULL, OPT_TX_FIFO },
+        { "rx-trig",  required_argument, NULL, 'r' },
+        { "tx-trig",  required_argument, NULL, 't' },
+        { "frame",    required_argument, NULL, 'n' },
+        { "timeout",  required_argument, NULL, 'c' },
+        { "irq-us",   required_argument, NULL, 'I' },
+        { "wake-us",  required_argument, NULL, 'W' },
+        { "device",   required_argument, NULL, 'd' },
+        { "probe",    no_argument,       NULL, 'P' },
+        { "max-baud", no_argument,       NULL, 'B' },
+        { "help",     no_argument,       NULL, 'h' },
+        { NULL, 0, NULL, 0 }
+    };
+    struct serial_model m;
+    int trigs[LIST_MAX], ntrig = 0, frames[LIST_MAX] = { 1, 16, 64, 256 }, nframe = 4;
+    int fifo = FIFO_DEFAULT, rx_fifo = 0, tx_fifo = 0, tx_trig = 0;
+    int probe = 0, max_baud = 0, opt;
+    const char *format = "8N1", *dev = NULL;
+    double timeout = 4, irq_us = 0, wake_us = 0;
+    long baud = BAUD_DEFAULT, baud_base = 0;
+
+    while ((opt = getopt_long(argc, argv, "b:f:F:r:t:n:c:I:W:d:PBh", long_opts, NULL)) != -1) {
+        switch (opt) {
+        case 'b': baud = strtol(optarg, NULL, 10); break;
+        case 'f': format = optarg; break;
+        case 'F': fifo = atoi(optarg); break;
+        case OPT_RX_FIFO: rx_fifo = atoi(optarg); break;
+        case OPT_TX_FIFO: tx_fifo = atoi(optarg); break;
+        case 'r':
+            if ((ntrig = parse_list(optarg, trigs, LIST_MAX)) < 0)
+                return 1;
+            break;
+        case 't': tx_trig = atoi(optarg); break;
+        case 'n':
+            if ((nframe = parse_list(optarg, frames, LIST_MAX)) < 0)
+                return 1;
+            break;
+        case 'c': timeout = atof(optarg); break;
+        case 'I': irq_us = atof(optarg); break;
+        case 'W': wake_us = atof(optarg); break;
+        case 'd': dev = optarg; break;
+        case 'P': probe = 1; break;
+        case 'B': max_baud = 1; break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (baud <= 0 || fifo < 1 || rx_fifo < 0 || tx_fifo < 0 || tx_trig < 0 ||
+        timeout < 0 || irq_us < 0 || wake_us < 0 || (probe && !dev)) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    model_init(&m, baud, fifo);
+    if (model_parse_format(&m, format) != 0) {
+        fprintf(stderr, "Invalid format '%s'\n", format);
+        return 1;
+    }
+    if (dev) {
+        char path[64];
+        struct serial_struct ss;
+        int fd;
+
+        if (!strchr(dev, '/')) {
+            snprintf(path, sizeof(path), "/dev/%.58s", dev);
+            dev = path;
+        }
+        // no configure_port(), only the settings are read
+        fd = open(dev, O_RDWR | O_NOCTTY | O_NONBLOCK);
+        if (fd < 0 || model_from_port(&m, fd, dev) != 0) {
+            fprintf(stderr, "%s: %s\n", dev, strerror(errno));
+            return 1;
+        }
+        if (ioctl(fd, TIOCGSERIAL, &ss) == 0)
+            baud_base = ss.baud_base;
+        close(fd);
+    }
+    if (rx_fifo)
+        m.rx_fifo = rx_fifo;
+    if (tx_fifo)
+        m.tx_fifo = tx_fifo;
+    if (tx_trig)
+        m.tx_trig = tx_trig;
+    if (!ntrig) {
+        trigs[0] = m.rx_fifo >= m.rx_trig ? m.rx_trig : m.rx_fifo;
+        ntrig = 1;
+    }
+    m.timeout_chars = timeout;
+    m.irq_ns = irq_us * 1e3;
+    m.wake_ns = wake_us * 1e3;
+
+    print_model(&m, trigs, ntrig, frames, nframe);
+    if (probe && probe_compare(dev, &m, baud_base, max_baud) != 0)
+        return 1;
+    return 0;
+}
@@ -0,0 +1,219 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * uart_passthru.c - Minimal pass-through line discipline
+ *
+ * Copyright (C) 2025 Kyle L. Bader
+ *
+ * Hands received bytes to userspace as they arrive and sends writes
+ * straight to the driver, without any of the n_tty processing (canonical
+ * mode, echo, signal characters, VMIN/VTIME). It is the "custom protocol
+ * ldisc" data point for rtt_test --ldisc, between n_tty in raw mode and
+ * N_NULL. Bytes that do not fit the receive buffer are dropped and counted.
+ */
+#include <linux/module.h>
+#include <linux/init.h>
+#include <linux/tty.h>
+#include <linux/tty_ldisc.h>
+#include <linux/kfifo.h>
+#include <linux/poll.h>
+#include <linux/sched/signal.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+#include <linux/wait.h>
+
+#define PASSTHRU_BUF_SIZE 65536
+
+static int ldisc_num = N_DEVELOPMENT;
+module_param(ldisc_num, int, 0444);
+MODULE_PARM_DESC(ldisc_num, "Line discipline number to register (default N_DEVELOPMENT)");
+
+struct passthru {
+	DECLARE_KFIFO(fifo, u8, PASSTHRU_BUF_SIZE);
+	spinlock_t lock;		/* serializes readers and flush */
+	unsigned long dropped;
+};
+
+static int passthru_open(struct tty_struct *tty)
+{
+	struct passthru *pt;
+
+	/* 64 KB of FIFO: let it come from vmalloc when memory is fragmented */
+	pt = kvzalloc(sizeof(*pt), GFP_KERNEL);
+	if (!pt)
+		return -ENOMEM;
+
+	INIT_KFIFO(pt->fifo);
+	spin_lock_init(&pt->lock);
+	tty->disc_data = pt;
+	return 0;
+}
+
+static void passthru_close(struct tty_struct *tty)
+{
+	struct passthru *pt = tty->disc_data;
+
+	if (pt->dropped)
+		pr_info("uart_passthru: %s dropped %lu bytes\n",
+			tty->name, pt->dropped);
+	kvfree(pt);
+	tty->disc_data = NULL;
+}
+
+static void passthru_flush_buffer(struct tty_struct *tty)
+{
+	struct passthru *pt = tty->disc_data;
+	unsigned long flags;
+
+	spin_lock_irqsave(&pt->lock, flags);
+	kfifo_reset_out(&pt->fifo);
+	spin_unlock_irqrestore(&pt->lock, flags);
+}
+
+static size_t passthru_receive_buf2(struct tty_struct *tty, const u8 *cp,
+				    const u8 *fp, size_t count)
+{
+	struct passthru *pt = tty->disc_data;
+	unsigned int copied;
+
+	/* flip buffer work is the only producer, no lock needed for kfifo_in */
+	copied = kfifo_in(&pt->fifo, cp, count);
+	pt->dropped += count - copied;
+
+	if (copied)
+		wake_up_interruptible_poll(&tty->read_wait, EPOLLIN | EPOLLRDNORM);
+
+	/* consume everything, overflow is accounted in ->dropped */
+	return count;
+}
+
+static ssize_t passthru_read(struct tty_struct *tty, struct file *file,
+			     u8 *buf, size_t nr, void **cookie,
+			     unsigned long offset)
+{
+	struct passthru *pt = tty->disc_data;
+	unsigned int copied;
+	int ret;
+
+	while (kfifo_is_empty(&pt->fifo)) {
+		if (tty_hung_up_p(file))
+			return 0;
+		if (tty_io_nonblock(tty, file))
+			return -EAGAIN;
+
+		ret = wait_event_interruptible(tty->read_wait,
+				!kfifo_is_empty(&pt->fifo) ||
+				tty_hung_up_p(file));
+		if (ret)
+			return -ERESTARTSYS;
+	}
+
+	copied = kfifo_out_spinlocked(&pt->fifo, buf, nr, &pt->lock);
+	return copied;
+}
+
+static ssize_t passthru_write(struct tty_struct *tty, struct file *file,
+			      const u8 *buf, size_t nr)
+{
+	size_t written = 0;
+	ssize_t c;
+	int ret;
+
+	while (written < nr) {
+		if (tty_hung_up_p(file))
+			return written ? written : -EIO;
+
+		c = tty->ops->write(tty, buf + written, nr - written);
+		if (c < 0)
+			return written ? written : c;
+		written += c;
+		if (written == nr)
+			break;
+
+		if (tty_io_nonblock(tty, file))
+			return written ? written : -EAGAIN;
+
+		ret = wait_event_interruptible(tty->write_wait,
+				tty_write_room(tty) > 0 ||
+				tty_hung_up_p(file));
+		if (ret)
+			return written ? written : -ERESTARTSYS;
+	}
+
+	return written;
+}
+
+static __poll_t passthru_poll(struct tty_struct *tty, struct file *file,
+			      struct poll_table_struct *wait)
+{
+	struct passthru *pt = tty->disc_data;
+	__poll_t mask = 0;
+
+	poll_wait(file, &tty->read_wait, wait);
+	poll_wait(file, &tty->write_wait, wait);
+
+	if (!kfifo_is_empty(&pt->fifo))
+		mask |= EPOLLIN | EPOLLRDNORM;
+	if (tty_write_room(tty) > 0)
+		mask |= EPOLLOUT | EPOLLWRNORM;
+	if (tty_hung_up_p(file))
+		mask |= EPOLLHUP;
+
+	return mask;
+}
+
+static int passthru_ioctl(struct tty_struct *tty, unsigned int cmd,
+			  unsigned long arg)
+{
+	struct passthru *pt = tty->disc_data;
+
+	switch (cmd) {
+	case TIOCINQ:
+		return put_user(kfifo_len(&pt->fifo), (unsigned int __user *)arg);
+	default:
+		/* termios, TCFLSH and friends */
+		return n_tty_ioctl_helper(tty, cmd, arg);
+	}
+}
+
+static struct tty_ldisc_ops passthru_ldisc = {
+	.owner		= THIS_MODULE,
+	.num		= N_DEVELOPMENT,
+	.name		= "uart_passthru",
+	.open		= passthru_open,
+	.close		= passthru_close,
+	.flush_buffer	= passthru_flush_buffer,
+	.read		= passthru_read,
+	.write		= passthru_write,
+	.ioctl		= passthru_ioctl,
+	.poll		= passthru_poll,
+	.receive_buf2	= passthru_receive_buf2,
+};
+
+static int __init uart_passthru_init(void)
+{
+	int ret;
+
+	passthru_ldisc.num = ldisc_num;
+	ret = tty_register_ldisc(&passthru_ldisc);
+	if (ret) {
+		pr_err("uart_passthru: cannot register ldisc %d: %d\n", ldisc_num, ret);
+		return ret;
+	}
+
+	pr_info("uart_passthru: registered as ldisc %d\n", ldisc_num);
+	return 0;
+}
+
+static void __exit uart_passthru_exit(void)
+{
+	tty_unregister_ldisc(&passthru_ldisc);
+	pr_info("uart_passthru: unloaded\n");
+}
+
+module_init(uart_passthru_init);
+module_exit(uart_passthru_exit);
+
+MODULE_LICENSE("GPL");
+MODULE_AUTHOR("Kyle L. Bader");
+MODULE_DESCRIPTION("Minimal pass-through line discipline for serial benchmarks");
+MODULE_VERSION("1");
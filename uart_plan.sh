@@ -0,0 +1,323 @@
+#!/bin/bash
+set -euo pipefail
+
+# Runs a benchmark plan: a matrix of ports x baud x RX/TX trigger x payload
+# x read engine x load, each point repeated until its p50 is known well
+# enough. Results go to a TSV file, one line per run; runs already in it
+# are not repeated, so an interrupted plan picks up where it stopped.
+
+RTT_TEST=./rtt_test
+RESULTS=""
+DRY_RUN=false
+
+DIMS=(port rx_trig tx_trig baud load payload engine)
+KEYS=(name ports baud rx_trig tx_trig payload engine load repeat max_repeat iterations confidence)
+COLUMNS="port	baud	rx_trig	tx_trig	payload	engine	load	rep	rx_actual	tx_actual	p50_us	p99_us	bytes_per_read	wakeups_per_s	timeouts	time"
+
+usage() {
+    echo "Usage: $0 [options] <plan>"
+    echo "  -o, --results <FILE>  Results file (default: the plan's name with .results)"
+    echo "  -n, --dry-run         List the runs in order, with the trigger writes"
+    echo "                        and the runs already in the results file"
+    echo "      --rtt-test <PATH> rtt_test binary (default ./rtt_test)"
+    echo
+    echo "Plan lines are 'key: values', whitespace separated, # starts a comment:"
+    echo "  name        label for the results (default: the file name)"
+    echo "  ports       ttyS4 ttyS5 ...                 (required)"
+    echo "  baud        line rates                      (default 115200)"
+    echo "  rx_trig     RX trigger levels, - to leave   (default -)"
+    echo "  tx_trig     TX trigger levels, - to leave   (default -)"
+    echo "  payload     frame sizes in bytes            (default 32)"
+    echo "  engine      byte vmin1 frame nonblock       (default vmin1)"
+    echo "  load        idle or rtt_test --load specs   (default idle)"
+    echo "  repeat      runs per point, at least        (default 1)"
+    echo "  max_repeat  runs per point, at most         (default: repeat)"
+    echo "  iterations  frames per run                  (default 100)"
+    echo "  confidence  repeat until the 95% CI of p50 is within this many"
+    echo "              percent of the mean, up to max_repeat (default 0: off)"
+    exit 1
+}
+
+OPTS=$(getopt -o ho:n --long help,results:,dry-run,rtt-test: -n "$0" -- "$@")
+eval set -- "$OPTS"
+
+while true; do
+    case "$1" in
+        -o|--results) RESULTS="$2"; shift 2 ;;
+        -n|--dry-run) DRY_RUN=true; shift ;;
+        --rtt-test) RTT_TEST="$2"; shift 2 ;;
+        -h|--help) usage ;;
+        --) shift; break ;;
+    esac
+done
+(( $# == 1 )) || usage
+PLAN_FILE="$1"
+[[ -r "$PLAN_FILE" ]] || { echo "Cannot read plan '$PLAN_FILE'" >&2; exit 1; }
+[[ -n "$RESULTS" ]] || RESULTS="${PLAN_FILE%.plan}.results"
+
+# Helpers
+is_uint() { [[ "$1" =~ ^[0-9]+$ ]]; }
+trim() { local s="$1"; s="${s#"${s%%[![:space:]]*}"}"; echo "${s%"${s##*[![:space:]]}"}"; }
+die() { echo "$PLAN_FILE: $*" >&2; exit 2; }
+
+# --- Plan ---
+declare -A PLAN=(
+    [name]="$(basename "${PLAN_FILE%.plan}")"
+    [baud]=115200 [rx_trig]=- [tx_trig]=- [payload]=32 [engine]=vmin1
+    [load]=idle [repeat]=1 [max_repeat]="" [iterations]=100 [confidence]=0
+)
+lineno=0
+while IFS= read -r line || [[ -n "$line" ]]; do
+    lineno=$((lineno + 1))
+    line="$(trim "${line%%#*}")"
+    [[ -z "$line" ]] && continue
+    [[ "$line" =~ ^([a-z_]+):[[:space:]]*(.*)$ ]] || die "line $lineno: expected 'key: values'"
+    key="${BASH_REMATCH[1]}"
+    [[ " ${KEYS[*]} " == *" $key "* ]] || die "line $lineno: unknown key '$key'"
+    PLAN[$key]="$(trim "${BASH_REMATCH[2]}")"
+done < "$PLAN_FILE"
+
+[[ -n "${PLAN[ports]:-}" ]] || die "no ports"
+[[ -n "${PLAN[max_repeat]}" ]] || PLAN[max_repeat]="${PLAN[repeat]}"
+PLAN[port]="${PLAN[ports]}"
+
+for key in baud payload; do
+    for v in ${PLAN[$key]}; do
+        is_uint "$v" && (( v > 0 )) || die "$key: invalid value '$v'"
+    done
+done
+for key in rx_trig tx_trig; do
+    for v in ${PLAN[$key]}; do
+        [[ "$v" == - ]] || { is_uint "$v" && (( v > 0 )); } || die "$key: invalid value '$v'"
+    done
+done
+for v in ${PLAN[payload]}; do
+    (( v <= 4096 )) || die "payload: $v is more than rtt_test reads at once (4096)"
+done
+for v in ${PLAN[engine]}; do
+    case "$v" in byte|vmin1|frame|nonblock) ;; *) die "engine: unknown '$v'" ;; esac
+done
+for key in repeat max_repeat iterations confidence; do
+    is_uint "${PLAN[$key]}" || die "$key: invalid value '${PLAN[$key]}'"
+done
+(( PLAN[repeat] >= 1 && PLAN[max_repeat] >= PLAN[repeat] && PLAN[iterations] >= 1 )) ||
+    die "need 1 <= repeat <= max_repeat and iterations >= 1"
+
+# VMIN, VTIME and read() size for an engine at a payload
+engine_args() {
+    local engine="$1" payload="$2"
+    case "$engine" in
+        byte)     echo "--vmin 1 --vtime 0 --rsize 1" ;;
+        vmin1)    echo "--vmin 1 --vtime 0 --rsize 4096" ;;
+        frame)    echo "--vmin $(( payload < 255 ? payload : 255 )) --vtime 0 --rsize $payload" ;;
+        nonblock) echo "--vmin 0 --vtime 0 --rsize 4096" ;;
+    esac
+}
+
+# --- Expansion ---
+# Nested loops in DIMS order, outermost first. Each inner loop runs its
+# values in the other direction from the last time (serpentine), so two
+# runs in a row differ in one setting wherever the matrix allows and a
+# trigger level is only written when it really changes.
+RUNS=()
+FLIP=()
+expand() {
+    local d=$1 prefix=$2 vals=() v i
+    if (( d == ${#DIMS[@]} )); then
+        RUNS+=("$prefix")
+        return
+    fi
+    read -ra vals <<< "${PLAN[${DIMS[$d]}]}"
+    if (( ${FLIP[$d]:-0} )); then
+        for (( i = ${#vals[@]} - 1; i >= 0; i-- )); do
+            expand $((d + 1)) "$prefix${prefix:+	}${vals[$i]}"
+        done
+    else
+        for v in "${vals[@]}"; do
+            expand $((d + 1)) "$prefix${prefix:+	}$v"
+        done
+    fi
+    FLIP[$d]=$(( ! ${FLIP[$d]:-0} ))
+}
+expand 0 ""
+
+# run fields (DIMS order) to the results key order
+run_key() {
+    local port rx tx baud load payload engine
+    IFS=$'\t' read -r port rx tx baud load payload engine <<< "$1"
+    printf '%s\t%s\t%s\t%s\t%s\t%s\t%s' "$port" "$baud" "$rx" "$tx" "$payload" "$engine" "$load"
+}
+
+# --- Results so far ---
+declare -A DONE=()
+if [[ -f "$RESULTS" ]]; then
+    while IFS= read -r key; do
+        DONE[$key]=$(( ${DONE[$key]:-0} + 1 ))
+    done < <(awk -F'\t' '!/^#/ && $1 != "port" && $11 ~ /^[0-9.]+$/ {
+        print $1 "\t" $2 "\t" $3 "\t" $4 "\t" $5 "\t" $6 "\t" $7 }' "$RESULTS")
+fi
+
+# 0 if the p50s of key in the results file have a 95% CI within confidence %
+ci_ok() {
+    local key="$1"
+    (( PLAN[confidence] > 0 )) || return 0
+    awk -F'\t' -v key="$key" -v target="${PLAN[confidence]}" '
+        function t95(df) {
+            split("12.71 4.30 3.18 2.78 2.57 2.45 2.36 2.31 2.26 2.23", t, " ")
+            return df <= 10 ? t[df] : df <= 20 ? 2.09 : df <= 30 ? 2.04 : 1.96
+        }
+        !/^#/ && $11 ~ /^[0-9.]+$/ &&
+        ($1 "\t" $2 "\t" $3 "\t" $4 "\t" $5 "\t" $6 "\t" $7) == key {
+            n++; s += $11; ss += $11 * $11
+        }
+        END {
+            if (n < 2) exit 1
+            mean = s / n
+            var = (ss - n * mean * mean) / (n - 1)
+            half = t95(n - 1) * sqrt(var > 0 ? var : 0) / sqrt(n)
+            exit !(mean > 0 && 100 * half / mean <= target)
+        }' "$RESULTS"
+}
+
+# --- Dry run ---
+if $DRY_RUN; then
+    declare -A cur=()
+    writes=0; pending=0
+    printf '%-8s %8s %4s %4s %-16s %7s %-8s %s\n' port baud rx tx load payload engine status
+    for run in "${RUNS[@]}"; do
+        IFS=$'\t' read -r port rx tx baud load payload engine <<< "$run"
+        mark=""
+        if [[ "$rx" != - && "${cur[$port.rx]:-}" != "$rx" ]]; then
+            cur[$port.rx]=$rx; writes=$((writes + 1)); mark+=" rx_trig"
+        fi
+        if [[ "$tx" != - && "${cur[$port.tx]:-}" != "$tx" ]]; then
+            cur[$port.tx]=$tx; writes=$((writes + 1)); mark+=" tx_trig"
+        fi
+        done_n=${DONE[$(run_key "$run")]:-0}
+        if (( done_n >= PLAN[repeat] )); then
+            status="done ($done_n)"
+        else
+            status="$((PLAN[repeat] - done_n)) to run"
+            pending=$((pending + PLAN[repeat] - done_n))
+        fi
+        printf '%-8s %8s %4s %4s %-16s %7s %-8s %s%s\n' "$port" "$baud" "$rx" "$tx" \
+            "$load" "$payload" "$engine" "$status" "${mark:+, set$mark}"
+    done
+    echo "# ${#RUNS[@]} points, $pending runs to go (more with confidence), $writes trigger writes"
+    exit 0
+fi
+
+# --- Port configuration, put back on exit ---
+declare -A CUR=() SAVED=()
+trig_path() { echo "/sys/class/tty/$1/$2_trig_bytes"; }
+
+set_trig() {
+    local port="$1" dir="$2" level="$3" path
+    [[ "$level" == - ]] && return 0
+    [[ "${CUR[$port.$dir]:-}" == "$level" ]] && return 0
+    path="$(trig_path "$port" "$dir")"
+    if ! sudo test -w "$path"; then
+        echo "  ! $port: $path not writable" >&2
+        return 1
+    fi
+    [[ -n "${SAVED[$port.$dir]:-}" ]] || SAVED[$port.$dir]="$(sudo cat "$path")"
+    echo "$level" | sudo tee "$path" >/dev/null
+    CUR[$port.$dir]="$level"
+}
+
+restore() {
+    local k port dir
+    for k in "${!SAVED[@]}"; do
+        port="${k%.*}"; dir="${k##*.}"
+        echo "${SAVED[$k]}" | sudo tee "$(trig_path "$port" "$dir")" >/dev/null || true
+    done
+}
+trap restore EXIT
+trap 'echo; echo "[!] Interrupted, rerun to resume"; exit 130' INT TERM
+
+# --- Run ---
+[[ -x "$RTT_TEST" ]] || { echo "$RTT_TEST not found, run make first" >&2; exit 1; }
+[[ -f "$RESULTS" ]] || printf '# plan %s\n%s\n' "${PLAN[name]}" "$COLUMNS" > "$RESULTS"
+
+echo "[+] Plan ${PLAN[name]}: ${#RUNS[@]} points, results in $RESULTS"
+T_START=$EPOCHREALTIME
+ran=0; skipped=0; failed=0
+
+for run in "${RUNS[@]}"; do
+    IFS=$'\t' read -r port rx tx baud load payload engine <<< "$run"
+    key="$(run_key "$run")"
+    n=${DONE[$key]:-0}
+
+    if (( n >= PLAN[max_repeat] )) || { (( n >= PLAN[repeat] )) && ci_ok "$key"; }; then
+        skipped=$((skipped + 1))
+        continue
+    fi
+    if ! set_trig "$port" rx "$rx" || ! set_trig "$port" tx "$tx"; then
+        failed=$((failed + 1))
+        continue
+    fi
+    rx_actual="$(sudo cat "$(trig_path "$port" rx)" 2>/dev/null || echo -)"
+    tx_actual="$(sudo cat "$(trig_path "$port" tx)" 2>/dev/null || echo -)"
+
+    load_args=()
+    [[ "$load" != idle ]] && load_args=(--load "$load" --load-levels 1)
+    read -ra eng_args <<< "$(engine_args "$engine" "$payload")"
+
+    while (( n < PLAN[max_repeat] )); do
+        (( n >= PLAN[repeat] )) && ci_ok "$key" && break
+        n=$((n + 1))
+        printf '  * %s baud=%s rx=%s tx=%s load=%s payload=%s engine=%s rep=%d\n' \
+            "$port" "$baud" "$rx_actual" "$tx_actual" "$load" "$payload" "$engine" "$n"
+        if ! out=$(sudo "$RTT_TEST" -b "$baud" -s "${eng_args[@]}" -n "$payload" \
+                        -i "${PLAN[iterations]}" "${load_args[@]}" "/dev/$port" 2>&1); then
+            echo "     [error] $(tail -n 1 <<< "$out")"
+            failed=$((failed + 1))
+            break
+        fi
+        # the sweep row: vmin vtime rsize p50 p99 bytes/read wakeups/s timeouts
+        row=$(awk '$1 ~ /^[0-9]+$/ && $2 ~ /^[0-9]+$/ && $4 ~ /^[0-9.]+$/ && NF >= 8 {
+                       print $4 "\t" $5 "\t" $6 "\t" $7 "\t" $8; exit }' <<< "$out")
+        if [[ -z "$row" ]]; then
+            echo "     [error] no result in rtt_test output"
+            failed=$((failed + 1))
+            break
+        fi
+        printf '%s\t%d\t%s\t%s\t%s\t%s\n' "$key" "$n" "$rx_actual" "$tx_actual" "$row" \
+            "$(date +%s)" >> "$RESULTS"
+        IFS=$'\t' read -r p50 p99 _ <<< "$row"
+        echo "     - p50 $p50 us, p99 $p99 us"
+        ran=$((ran + 1))
+    done
+done
+
+elapsed=$(awk -v a="$T_START" -v b="$EPOCHREALTIME" 'BEGIN { printf "%.1f", b - a }')
+echo "[+] Done: $ran runs, $skipped points already done, $failed failed, ${elapsed}s"
+
+# --- Summary: one line per point ---
+awk -F'\t' -v target="${PLAN[confidence]}" '
+    function t95(df) {
+        split("12.71 4.30 3.18 2.78 2.57 2.45 2.36 2.31 2.26 2.23", t, " ")
+        return df <= 10 ? t[df] : df <= 20 ? 2.09 : df <= 30 ? 2.04 : 1.96
+    }
+    !/^#/ && $1 != "port" && $11 ~ /^[0-9.]+$/ {
+        k = $1 "\t" $2 "\t" $3 "\t" $4 "\t" $5 "\t" $6 "\t" $7
+        if (!(k in n)) order[++nk] = k
+        n[k]++; s[k] += $11; ss[k] += $11 * $11; p99[k] += $12
+    }
+    END {
+        printf "%-8s %8s %4s %4s %7s %-8s %-16s %4s %10s %8s %10s\n", "port", "baud",
+               "rx", "tx", "payload", "engine", "load", "n", "p50_us", "ci95%", "p99_us"
+        for (i = 1; i <= nk; i++) {
+            k = order[i]; split(k, f, "\t")
+            mean = s[k] / n[k]
+            ci = "-"
+            if (n[k] > 1 && mean > 0) {
+                var = (ss[k] - n[k] * mean * mean) / (n[k] - 1)
+                half = t95(n[k] - 1) * sqrt(var > 0 ? var : 0) / sqrt(n[k])
+                ci = sprintf("%.1f", 100 * half / mean)
+                if (target > 0 && ci + 0 > target) ci = ci "!"
+            }
+            printf "%-8s %8s %4s %4s %7s %-8s %-16s %4d %10.1f %8s %10.1f\n", f[1], f[2],
+                   f[3], f[4], f[5], f[6], f[7], n[k], mean, ci, p99[k] / n[k]
+        }
+    }' "$RESULTS"
@@ -9,6 +9,10 @@
  * the current configuration. It currently supports
  * serial devices compatible with the 8250 core and is intended for driver
  * development and diagnostics of fifo_control.
+ *
+ * The probes are available as debugfs files (one port, text results) and
+ * through /dev/uart_probe (batches of ports and probes, binary results,
+ * see uart_probe_ioctl.h).
  */
 #include <linux/module.h>
 #include <linux/init.h>
@@ -20,16 +24,75 @@
 #include <linux/serial_8250.h>
 #include <linux/uaccess.h>
 #include <linux/delay.h>
+#include <linux/ktime.h>
+#include <linux/async.h>
+#include <linux/atomic.h>
+#include <linux/interrupt.h>
+#include <linux/kprobes.h>
+#include <linux/seq_file.h>
+#include <linux/list.h>
+#include <linux/mutex.h>
+#include <linux/workqueue.h>
+#include <linux/miscdevice.h>
+#include <linux/sched/signal.h>
+#include <linux/slab.h>
+#include <linux/math64.h>
+#include <linux/minmax.h>
+#include <linux/sort.h>
+
+#define CREATE_TRACE_POINTS
+#include "uart_probe_trace.h"
 
 #define FIFO_SIZE_MAX 512
 
 static struct dentry *dir_entry;
 static struct dentry *dev_entry;
-static struct dentry *tx_fifo_entry;
-static struct dentry *tx_trig_entry;
-static struct dentry *rx_fifo_entry;
-static struct dentry *rx_trig_entry;
 static char selected_dev[16] = "ttyS0";
+static u32 probe_sampling = 16;		/* for the debugfs probes, see probe_set_clock() */
+static u32 probe_prescale;
+static bool probe_fast = true;		/* use the fingerprint's strategy, see probe_identify() */
+
+/* What probe_fingerprint() found, cached per port */
+struct probe_fingerprint {
+	u8 chip;			/* enum uart_probe_chip */
+	u8 strategy;			/* enum uart_probe_strategy */
+	u8 iir;				/* with FCR = ENABLE_FIFO */
+	u8 efr;				/* as found */
+	bool scratch;
+	bool has_efr;
+	u8 id[4];			/* 16C950 ID1..3 and REV, or Exar DVID and DREV */
+	u16 fifo;			/* bytes for the chip family, 0 if it varies */
+	u64 ns;				/* time the register reads took */
+};
+
+/*
+ * A probe session owns the port from probe_begin() to probe_end(): the
+ * port mutex is held, the registers the probes touch are saved, and the
+ * session start time is the reference for the tracepoint deltas.
+ */
+struct probe_session {
+	const char *dev;
+	int kind;
+	struct tty_port *tport;
+	struct uart_port *port;
+	struct uart_8250_port *u8250p;
+	u8 lcr, fcr, mcr, ier;
+	u16 dl;
+	u16 div;			/* loopback divisor */
+	u8 sampling;			/* loopback clocks per bit, see probe_clock() */
+	u8 prescale;			/* loopback 16C950 CPR, 0: prescaler off */
+	u8 clk, cpr;			/* TCR or DLD, and CPR, before the probe */
+	u8 probe_fcr;			/* FCR the probes build on */
+	struct probe_fingerprint fp;
+	ktime_t t0;
+};
+
+struct probe_desc {
+	const char *name;
+	int kind;
+	int (*run)(struct probe_session *s);
+	const char *fail;		/* reported instead of a negative result */
+};
 
 /* uart_probe/select_dev
  * Select serial device for testing 
@@ -64,107 +127,90 @@ static const struct file_operations select_dev_fops = {
     .read = select_dev_read,
 };
 
-static int measure_tx_fifo_size(struct tty_port *tport,
-                                struct uart_port *port,
-                                struct uart_8250_port *u8250p)
-{
-    unsigned char old_fcr, old_mcr, old_lcr, lsr;
-    u32 old_dl;
-    int i, tx_count = 0, rx_count = 0;
-    unsigned long deadline;
-
-    /* Store initial port config */
-    old_lcr = port->serial_in(port, UART_LCR);
-    old_fcr = u8250p->fcr;
-    old_mcr = port->serial_in(port, UART_MCR);
-
-    /* Enable FIFO and loopback */
-    port->serial_out(port, UART_FCR, UART_FCR_ENABLE_FIFO |
-                                    UART_FCR_CLEAR_RCVR |
-                                    UART_FCR_CLEAR_XMIT);
-    port->serial_out(port, UART_MCR, old_mcr | UART_MCR_LOOP);
-
-    /* Drain RX */
-    while (port->serial_in(port, UART_LSR) & UART_LSR_DR)
-        (void)port->serial_in(port, UART_RX);
-
-    /* Set baud 115200 (DL=1), 8N1 */
-    port->serial_out(port, UART_LCR, UART_LCR_CONF_MODE_A);
-    old_dl = port->serial_in(port, UART_DLL) |
-             (port->serial_in(port, UART_DLM) << 8);
-    port->serial_out(port, UART_DLL, 1);
-    port->serial_out(port, UART_DLM, 0);
-    port->serial_out(port, UART_LCR, UART_LCR_WLEN8);
-
-    /* Fill TX FIFO */
-    for (i = 0; i < FIFO_SIZE_MAX; i++) {
-        port->serial_out(port, UART_TX, 0xFF);
-        tx_count++;
-    }
-
-    /* Let RX drain what arrived via loopback */
-    deadline = jiffies + msecs_to_jiffies(500);
-    while (time_before(jiffies, deadline) && rx_count < tx_count) {
-        lsr = port->serial_in(port, UART_LSR);
-        if (lsr & UART_LSR_DR) {
-            if (port->serial_in(port, UART_RX) == 0xFF)
-                rx_count++;
-        } else {
-            cpu_relax();
-        }
-    }
-
-    /* Restore port state */
-    port->serial_out(port, UART_FCR, old_fcr);
-    port->serial_out(port, UART_MCR, old_mcr);
-    port->serial_out(port, UART_LCR, UART_LCR_CONF_MODE_A);
-    port->serial_out(port, UART_DLL, old_dl & 0xff);
-    port->serial_out(port, UART_DLM, old_dl >> 8);
-    port->serial_out(port, UART_LCR, old_lcr);
-
-    if (rx_count <= 0)
-        return -EIO;
-
-    return rx_count;
-}
-
-/* uart_probe/rx_trig_test
- * Probe the serial devices RX FIFO trigger level
- * by setting internal loopback and sending data to itself,
- * one byte at a time,
- * until the rx interrupt is triggered 
- * @returns RX FIFO trigger level in number of bytes
+/*
+ * A claim holds a port for one /dev/uart_probe file across many probe
+ * sessions. The tty is opened exclusively from the kernel side, so
+ * open() from userspace fails with -EBUSY until the claim ends, and
+ * sessions for anyone else are refused. The owner's own sessions skip
+ * the busy check. A claim ends on UART_PROBE_IOC_RELEASE, when its
+ * timeout expires, or when the file that made it is closed.
  */
-static ssize_t rx_trig_probe_read(struct file *file, char __user *buf,
-                                  size_t count, loff_t *ppos)
+struct probe_claim {
+	struct list_head node;		/* on claims, empty once dropped */
+	dev_t devt;
+	struct tty_struct *tty;
+	struct file *owner;
+	struct delayed_work expire;
+};
+
+static LIST_HEAD(claims);
+static DEFINE_MUTEX(claims_lock);
+
+/* 1 if owner holds tport, 0 if nobody does, -EBUSY if someone else does */
+static int claim_check(struct tty_port *tport, struct file *owner)
 {
-	char tmp[128];
-	struct tty_driver *driver;
-	struct tty_port *tport;
-	struct uart_port *port;
-	struct uart_state *state;
-	struct uart_8250_port *u8250p;
-	int line = 0;
-	int trig = 0;
+	struct probe_claim *c;
 	int ret = 0;
-	unsigned char old_fcr, old_mcr, old_lcr, iir;
-	u32 old_dl;
 
-	if (*ppos)
-    	return 0;   /* EOF */
+	mutex_lock(&claims_lock);
+	list_for_each_entry(c, &claims, node) {
+		if (c->tty->port == tport) {
+			ret = (owner && c->owner == owner) ? 1 : -EBUSY;
+			break;
+		}
+	}
+	mutex_unlock(&claims_lock);
+	return ret;
+}
+
+/* Close the tty behind a claim already taken off the list */
+static void claim_drop(struct probe_claim *c)
+{
+	cancel_delayed_work_sync(&c->expire);
+	tty_kclose(c->tty);
+	kfree(c);
+}
+
+static void claim_expire(struct work_struct *work)
+{
+	struct probe_claim *c = container_of(to_delayed_work(work),
+					     struct probe_claim, expire);
+	bool listed;
+
+	mutex_lock(&claims_lock);
+	listed = !list_empty(&c->node);
+	list_del_init(&c->node);
+	mutex_unlock(&claims_lock);
+
+	/* a release that got here first frees it */
+	if (!listed)
+		return;
+	pr_info("uart_probe: claim on %s expired\n", c->tty->name);
+	tty_kclose(c->tty);
+	kfree(c);
+}
 
-	pr_info("uart_probe: starting RX trigger probe\n");
+/* Find the 8250 port behind a tty name such as ttyS1 */
+static struct uart_port *probe_find_port(char *dev, struct tty_port **tportp)
+{
+	struct tty_driver *driver;
+	struct tty_port *tport;
+	struct uart_state *state;
+	struct uart_port *port;
+	int line;
 
-	driver = tty_find_polling_driver(selected_dev, &line);
+	driver = tty_find_polling_driver(dev, &line);
 	if (!driver) {
 		pr_err("uart_probe: tty_find_polling_driver failed\n");
-		return -ENODEV;
+		return ERR_PTR(-ENODEV);
 	}
 
+	/* tty_find_polling_driver() took a reference for the lookup only */
 	tport = driver->ports[line];
+	tty_driver_kref_put(driver);
 	if (!tport) {
 		pr_err("uart_probe: no tty_port found for line %d\n", line);
-		return -ENODEV;
+		return ERR_PTR(-ENODEV);
 	}
 
 	state = container_of(tport, struct uart_state, port);
@@ -172,451 +218,742 @@ static ssize_t rx_trig_probe_read(struct file *file, char __user *buf,
 
 	if (!port || !port->serial_in || !port->serial_out) {
 		pr_err("uart_probe: invalid port or missing ops\n");
-		return -ENODEV;
+		return ERR_PTR(-ENODEV);
 	}
 
-	u8250p = up_to_u8250p(port);
-	if (!u8250p) {
-		pr_err("uart_probe: Not an 8250-based UART\n");
-		return -ENODEV;
-	}
+	*tportp = tport;
+	return port;
+}
 
-	if (tty_port_initialized(tport) && tty_port_users(tport) > 0) {
-		pr_err("uart_probe: TTY device %s is busy or opened by userspace\n", selected_dev);
-		return -EBUSY;
-	}
+/* 16C950 indexed control registers, reachable while LCR != 0xBF */
+static void probe_icr_write(struct uart_port *port, u8 offset, u8 value)
+{
+	port->serial_out(port, UART_SCR, offset);
+	port->serial_out(port, UART_ICR, value);
+}
 
-	mutex_lock(&tport->mutex);
+static u8 probe_icr_read(struct probe_session *s, u8 offset)
+{
+	struct uart_port *port = s->port;
+	u8 value;
+
+	probe_icr_write(port, UART_ACR, s->u8250p->acr | UART_ACR_ICRRD);
+	port->serial_out(port, UART_SCR, offset);
+	value = port->serial_in(port, UART_ICR);
+	probe_icr_write(port, UART_ACR, s->u8250p->acr);
+	return value;
+}
 
-	/* Store current port config */
-	old_lcr = port->serial_in(port, UART_LCR);
-	old_fcr = u8250p->fcr;
-	old_mcr = port->serial_in(port, UART_MCR);
+/*
+ * Sampling clocks other than 16x. The 16C950 samples at 4x to 16x (TCR,
+ * where 0 means 16x) and has a prescaler of CPR/8 behind MCR[7]; the
+ * XR17V35x samples at 8x or 4x (DLD, whose low bits are the fractional
+ * divisor). The probes run at 16x without prescaler unless asked.
+ */
+enum probe_clock {
+	PROBE_CLOCK_16X,
+	PROBE_CLOCK_950,
+	PROBE_CLOCK_XR,
+};
 
-	/* Enable and clear FIFO */
-	port->serial_out(port, UART_FCR,
-	                 old_fcr | UART_FCR_CLEAR_RCVR | UART_FCR_CLEAR_XMIT);
+static const char *const probe_clock_names[] = {
+	[PROBE_CLOCK_16X] = "16x",
+	[PROBE_CLOCK_950] = "16c950",
+	[PROBE_CLOCK_XR] = "xr17v35x",
+};
+
+#define XR_DLD		0x02		/* with DLAB and EFR[4] */
+#define XR_DLD_8X	0x10
+#define XR_DLD_4X	0x20
+
+static int probe_clock(struct uart_port *port)
+{
+	switch (port->type) {
+	case PORT_16C950:
+		return PROBE_CLOCK_950;
+	case PORT_XR17V35X:
+		return PROBE_CLOCK_XR;
+	default:
+		return PROBE_CLOCK_16X;
+	}
+}
 
-	/* Enable loopback */
-	port->serial_out(port, UART_MCR, old_mcr | UART_MCR_LOOP);
+/* Read or write the XR17V35x DLD. Leaves LCR at 8N1. */
+static u8 probe_xr_dld(struct probe_session *s, bool write, u8 value)
+{
+	struct uart_port *port = s->port;
+	u8 efr;
 
-	/* Set baud to 115200 */
+	port->serial_out(port, UART_LCR, UART_LCR_CONF_MODE_B);
+	efr = port->serial_in(port, UART_XR_EFR);
+	port->serial_out(port, UART_XR_EFR, efr | UART_EFR_ECB);
 	port->serial_out(port, UART_LCR, UART_LCR_CONF_MODE_A);
-	old_dl = port->serial_in(port, UART_DLL) |
-	         (port->serial_in(port, UART_DLM) << 8);
-	port->serial_out(port, UART_DLL, 1);
-	port->serial_out(port, UART_DLM, 0);
+	if (write)
+		port->serial_out(port, XR_DLD, value);
+	else
+		value = port->serial_in(port, XR_DLD);
+	port->serial_out(port, UART_LCR, UART_LCR_CONF_MODE_B);
+	port->serial_out(port, UART_XR_EFR, efr);
 	port->serial_out(port, UART_LCR, UART_LCR_WLEN8);
+	return value;
+}
 
-	u8 save_lcr = port->serial_in(port, UART_LCR);
-	port->serial_out(port, UART_LCR, 0xBF);                 /* conf mode B */
-	u8 efr = port->serial_in(port, UART_EFR);               /* bit4 = ECB */
-	u8 acr = port->serial_in(port, UART_ACR);               /* bit5 = TLENB (950 table) */
-	port->serial_out(port, UART_LCR, save_lcr);
-
-	pr_info("%s: EFR=%02x (ECB=%d) ACR=%02x (TLENB=%d) type=%d caps=%#x\n",
-			selected_dev, efr, !!(efr & UART_EFR_ECB),
-			acr, !!(acr & UART_ACR_TLENB),
-			port->type, (unsigned int)up_to_u8250p(port)->capabilities);
-	
-	pr_info("%s: ACR bits: b7=%d b6=%d b5=%d b4=%d b3=%d b2=%d b1=%d b0=%d\n",
-		selected_dev,
-		(acr >> 7) & 1, (acr >> 6) & 1,
-		(acr >> 5) & 1, (acr >> 4) & 1,
-		(acr >> 3) & 1, (acr >> 2) & 1,
-		(acr >> 1) & 1, (acr >> 0) & 1);
+/* Set the loopback sampling clock and prescaler, checked against the chip */
+static int probe_set_clock(struct probe_session *s, unsigned int sampling,
+			   unsigned int prescale)
+{
+	if (sampling < 4 || sampling > 16 || prescale > 255 ||
+	    (prescale && prescale < 8))
+		return -EINVAL;
+
+	switch (probe_clock(s->port)) {
+	case PROBE_CLOCK_950:
+		break;
+	case PROBE_CLOCK_XR:
+		if ((sampling != 4 && sampling != 8 && sampling != 16) || prescale)
+			return -EOPNOTSUPP;
+		break;
+	default:
+		if (sampling != 16 || prescale)
+			return -EOPNOTSUPP;
+	}
+	s->sampling = sampling;
+	s->prescale = prescale;
+	return 0;
+}
 
-	/* Enable RX interrupts */
-	port->serial_out(port, UART_IER, UART_IER_RDI);
+/* Program the session clock, or put back what was there */
+static void probe_write_clock(struct probe_session *s, bool restore)
+{
+	struct uart_port *port = s->port;
+
+	switch (probe_clock(port)) {
+	case PROBE_CLOCK_950:
+		probe_icr_write(port, UART_TCR, restore ? s->clk : s->sampling & 0x0f);
+		probe_icr_write(port, UART_CPR, restore || !s->prescale ? s->cpr : s->prescale);
+		break;
+	case PROBE_CLOCK_XR:
+		probe_xr_dld(s, true, restore ? s->clk :
+			     s->sampling == 8 ? XR_DLD_8X :
+			     s->sampling == 4 ? XR_DLD_4X : 0);
+		break;
+	}
+}
 
-	/* Probe for trigger threshold */
-	for (trig = 1; trig < 256; trig++) {
-		port->serial_out(port, UART_TX, 0x55);
+/*
+ * Chip fingerprint
+ *
+ * A few register reads, no characters on the line, say what the FIFO
+ * probes are talking to before they spend time in loopback. The sequence
+ * follows the 8250 driver's autoconfig(): the scratch register, the FIFO
+ * bits that FCR leaves in IIR, EFR behind LCR 0xBF, then the 16C950 ID
+ * registers through ICR or the Exar divisor ID, and the 16750's 64 byte
+ * bit behind DLAB. ICR is only touched once EFR has been seen, as
+ * autoconfig does, since some clones lock up on it. The XR17D15x and
+ * XR17V35x keep EFR at UART_XR_EFR and their ID in the device's global
+ * registers, out of reach from the port, so the driver's type names them.
+ */
+static const char *const probe_chip_names[] = {
+	[UART_PROBE_CHIP_UNKNOWN] = "unknown",
+	[UART_PROBE_CHIP_8250] = "8250",
+	[UART_PROBE_CHIP_16450] = "16450",
+	[UART_PROBE_CHIP_16550] = "16550",
+	[UART_PROBE_CHIP_16550A] = "16550a",
+	[UART_PROBE_CHIP_16650] = "16650",
+	[UART_PROBE_CHIP_16750] = "16750",
+	[UART_PROBE_CHIP_16850] = "16850",
+	[UART_PROBE_CHIP_16C950] = "16c950",
+	[UART_PROBE_CHIP_XR17D15X] = "xr17d15x",
+	[UART_PROBE_CHIP_XR17V35X] = "xr17v35x",
+};
 
-		/* Wait for byte transmission */ 
-		udelay(100); /* 1 byte @ 115200 bps = ~87us */
-		iir = port->serial_in(port, UART_IIR);
+static const char *const probe_strategy_names[] = {
+	[UART_PROBE_STRAT_DELAY] = "delay",
+	[UART_PROBE_STRAT_POLL] = "poll",
+	[UART_PROBE_STRAT_NOFIFO] = "nofifo",
+};
 
-		u8 iir_id = iir & UART_IIR_ID;
+/* EFR behind LCR 0xBF at reg: no software flow bits and ECB sticks. Leaves LCR at 0xBF. */
+static bool probe_has_efr(struct probe_session *s, int reg, u8 *efr)
+{
+	struct uart_port *port = s->port;
+	bool found;
+
+	port->serial_out(port, UART_LCR, UART_LCR_CONF_MODE_B);
+	*efr = port->serial_in(port, reg);
+	/* without EFR this is IIR, whose NO_INT bit is set with IER clear */
+	if (*efr & 0x0f)
+		return false;
+	port->serial_out(port, reg, *efr ^ UART_EFR_ECB);
+	found = port->serial_in(port, reg) == (*efr ^ UART_EFR_ECB);
+	port->serial_out(port, reg, *efr);
+	return found;
+}
 
-		if (!(iir & UART_IIR_NO_INT)) {
-			if ((iir_id == UART_IIR_RDI) && (iir_id != UART_IIR_RX_TIMEOUT)) 
-			break;
-		}
-	}
+/* XR16C85x DVID and DREV: what DLM and DLL read after writing 0. Leaves LCR in DLAB. */
+static u16 probe_divisor_id(struct probe_session *s)
+{
+	struct uart_port *port = s->port;
+	u16 id;
 
-	/* Disable interrupts */
-	port->serial_out(port, UART_IER, 0x00);
+	port->serial_out(port, UART_LCR, UART_LCR_CONF_MODE_A);
+	port->serial_out(port, UART_DLL, 0);
+	port->serial_out(port, UART_DLM, 0);
+	id = port->serial_in(port, UART_DLL) | (port->serial_in(port, UART_DLM) << 8);
+	port->serial_out(port, UART_DLL, s->dl & 0xff);
+	port->serial_out(port, UART_DLM, s->dl >> 8);
+	return id;
+}
 
-	/* Drain RX FIFO */
-	while (port->serial_in(port, UART_LSR) & UART_LSR_DR) 
-		port->serial_in(port, UART_RX);
+/* A working 16550A FIFO: tell the enhanced parts apart */
+static void probe_fingerprint_fifo(struct probe_session *s, struct probe_fingerprint *fp)
+{
+	struct uart_port *port = s->port;
+	bool exar = port->type == PORT_XR17D15X || port->type == PORT_XR17V35X;
+	u8 st1, st2;
+	u16 id;
 
-	/* Restore prior port config */
-	port->serial_out(port, UART_FCR, old_fcr);
-	port->serial_out(port, UART_MCR, old_mcr);
-	port->serial_out(port, UART_LCR, UART_LCR_CONF_MODE_A);
-	port->serial_out(port, UART_DLL, old_dl & 0xff);
-	port->serial_out(port, UART_DLM, old_dl >> 8);
-	port->serial_out(port, UART_LCR, old_lcr);
+	fp->chip = UART_PROBE_CHIP_16550A;
+	fp->fifo = 16;
 
-	mutex_unlock(&tport->mutex);
+	fp->has_efr = probe_has_efr(s, exar ? UART_XR_EFR : UART_EFR, &fp->efr);
+	port->serial_out(port, UART_LCR, UART_LCR_WLEN8);
+	if (fp->has_efr && exar) {
+		bool v35x = port->type == PORT_XR17V35X;
 
-	if (trig >= 256) {
-		pr_err("uart_probe: RX trigger test failed — no interrupt detected\n");
-		ret = snprintf(tmp, sizeof(tmp), "RX trigger test failed\n");
-	} else {
-		ret = snprintf(tmp, sizeof(tmp), "%d\n", trig);
+		fp->chip = v35x ? UART_PROBE_CHIP_XR17V35X : UART_PROBE_CHIP_XR17D15X;
+		fp->fifo = v35x ? 256 : 64;
+		return;
 	}
+	if (fp->has_efr) {
+		fp->id[0] = probe_icr_read(s, UART_ID1);
+		fp->id[1] = probe_icr_read(s, UART_ID2);
+		fp->id[2] = probe_icr_read(s, UART_ID3);
+		fp->id[3] = probe_icr_read(s, UART_REV);
+		if (fp->id[0] == 0x16 && fp->id[1] == 0xc9 &&
+		    (fp->id[2] == 0x50 || fp->id[2] == 0x52 || fp->id[2] == 0x54)) {
+			fp->chip = UART_PROBE_CHIP_16C950;
+			fp->fifo = 128;
+			return;
+		}
 
-	return simple_read_from_buffer(buf, count, ppos, tmp, ret);
-}
+		id = probe_divisor_id(s);
+		port->serial_out(port, UART_LCR, UART_LCR_WLEN8);
+		fp->id[0] = id >> 8;
+		fp->id[1] = id & 0xff;
+		fp->id[2] = fp->id[3] = 0;
+		if (fp->id[0] == 0x10 || fp->id[0] == 0x12 || fp->id[0] == 0x14) {
+			fp->chip = UART_PROBE_CHIP_16850;
+			fp->fifo = 128;
+		} else {
+			/* ST16C650 variants differ in depth */
+			fp->chip = UART_PROBE_CHIP_16650;
+			fp->fifo = 0;
+		}
+		return;
+	}
 
-static const struct file_operations rx_trig_fops = {
-	.read = rx_trig_probe_read,
-	.llseek = default_llseek,
-};
+	/* 16750: the 64 byte bit only takes with DLAB set */
+	port->serial_out(port, UART_FCR, UART_FCR_ENABLE_FIFO | UART_FCR7_64BYTE);
+	st1 = port->serial_in(port, UART_IIR) & (UART_IIR_64BYTE_FIFO | UART_IIR_FIFO_ENABLED);
+	port->serial_out(port, UART_FCR, 0);
+	port->serial_out(port, UART_LCR, UART_LCR_CONF_MODE_A);
+	port->serial_out(port, UART_FCR, UART_FCR_ENABLE_FIFO | UART_FCR7_64BYTE);
+	st2 = port->serial_in(port, UART_IIR) & (UART_IIR_64BYTE_FIFO | UART_IIR_FIFO_ENABLED);
+	port->serial_out(port, UART_FCR, 0);
+	port->serial_out(port, UART_LCR, UART_LCR_WLEN8);
+	if (st1 == UART_IIR_FIFO_ENABLED_16550A &&
+	    st2 == (UART_IIR_64BYTE_FIFO | UART_IIR_FIFO_ENABLED_16550A)) {
+		fp->chip = UART_PROBE_CHIP_16750;
+		fp->fifo = 64;
+	}
+}
 
-/* uart_probe/rx_fifo_size
- * Probe the RX FIFO size by setting internal loopback,
- * transmitting data to itself, one byte at a time
- * and detecting rx overrun
- * @returns the size of th RX FIFO in number of bytes
+/*
+ * Identify the chip and put back what it touches. The 16750 check writes
+ * FCR=0 to switch the FIFOs off, which empties them. The probes clear them
+ * anyway, and probe_begin() has already turned away ports that are open.
  */
-static ssize_t rx_fifo_size_read(struct file *file, char __user *buf,
-                                 size_t count, loff_t *ppos)
+static void probe_fingerprint(struct probe_session *s, struct probe_fingerprint *fp)
 {
-	char tmp[128];
-	struct tty_driver *driver;
-	struct tty_port *tport;
-	struct uart_port *port;
-	struct uart_state *state;
-	struct uart_8250_port *u8250p;
-	unsigned char old_fcr, old_mcr, old_lcr, lsr;
-	u32 old_dl;
-    int line, count_tx, rx_fifo_size = 0;
+	struct uart_port *port = s->port;
+	u64 t0 = ktime_get_ns();
+	u8 scr;
 
-	if (*ppos)
-    	return 0;   /* EOF */
-
-    pr_info("uart_probe: starting RX size probe\n");
+	memset(fp, 0, sizeof(*fp));
+	port->serial_out(port, UART_IER, 0x00);
+	port->serial_out(port, UART_LCR, UART_LCR_WLEN8);
 
-	driver = tty_find_polling_driver(selected_dev, &line);
-	if (!driver) {
-		pr_err("uart_probe: tty_find_polling_driver failed\n");
-		return -ENODEV;
+	scr = port->serial_in(port, UART_SCR);
+	port->serial_out(port, UART_SCR, 0xa5);
+	fp->scratch = port->serial_in(port, UART_SCR) == 0xa5;
+	port->serial_out(port, UART_SCR, 0x5a);
+	fp->scratch = fp->scratch && port->serial_in(port, UART_SCR) == 0x5a;
+
+	port->serial_out(port, UART_FCR, UART_FCR_ENABLE_FIFO);
+	fp->iir = port->serial_in(port, UART_IIR);
+	switch (fp->iir & UART_IIR_FIFO_ENABLED) {
+	case UART_IIR_FIFO_ENABLED_8250:
+		fp->chip = fp->scratch ? UART_PROBE_CHIP_16450 : UART_PROBE_CHIP_8250;
+		fp->fifo = 1;
+		break;
+	case UART_IIR_FIFO_ENABLED_16550:
+		fp->chip = UART_PROBE_CHIP_16550;
+		fp->fifo = 1;
+		break;
+	case UART_IIR_FIFO_ENABLED_16550A:
+		probe_fingerprint_fifo(s, fp);
+		break;
+	default:
+		fp->chip = UART_PROBE_CHIP_UNKNOWN;
 	}
 
-	tport = driver->ports[line];
-	if (!tport) {
-		pr_err("uart_probe: no tty_port found for line %d\n", line);
-		return -ENODEV;
+	/* the 16750's 64 byte bit is written with DLAB, as the driver does */
+	if (fp->chip == UART_PROBE_CHIP_16750)
+		port->serial_out(port, UART_LCR, UART_LCR_CONF_MODE_A);
+	port->serial_out(port, UART_FCR, s->fcr);
+	/* ICR reads go through SCR, so it is put back last */
+	port->serial_out(port, UART_LCR, UART_LCR_WLEN8);
+	port->serial_out(port, UART_SCR, scr);
+	port->serial_out(port, UART_LCR, s->lcr);
+	port->serial_out(port, UART_IER, s->ier);
+
+	switch (fp->chip) {
+	case UART_PROBE_CHIP_UNKNOWN:
+		fp->strategy = UART_PROBE_STRAT_DELAY;
+		break;
+	case UART_PROBE_CHIP_8250:
+	case UART_PROBE_CHIP_16450:
+	case UART_PROBE_CHIP_16550:
+		fp->strategy = UART_PROBE_STRAT_NOFIFO;
+		break;
+	default:
+		fp->strategy = UART_PROBE_STRAT_POLL;
 	}
+	fp->ns = ktime_get_ns() - t0;
+}
 
-	state = container_of(tport, struct uart_state, port);
-	port = state->uart_port;
+#define FP_CACHE_LINES	64
 
-	if (!port || !port->serial_in || !port->serial_out) {
-		pr_err("uart_probe: invalid port or missing ops\n");
-		return -ENODEV;
+/* A port is known again while its address and driver type stay the same */
+struct fp_cache_entry {
+	struct uart_port *port;
+	unsigned long iobase, mapbase;
+	unsigned int type;
+	struct probe_fingerprint fp;
+};
+
+static struct fp_cache_entry fp_cache[FP_CACHE_LINES];
+static DEFINE_MUTEX(fp_cache_lock);
+
+/*
+ * Fill in s->fp from the cache, or fingerprint the port, under the port
+ * mutex. refresh skips the cache. With probe_fast off every chip gets
+ * the fixed delays. Returns whether the cache answered.
+ */
+static bool probe_identify(struct probe_session *s, bool refresh)
+{
+	struct uart_port *port = s->port;
+	struct fp_cache_entry *e = NULL;
+	bool cached = false;
+	int i;
+
+	mutex_lock(&fp_cache_lock);
+	for (i = 0; i < FP_CACHE_LINES; i++) {
+		if (fp_cache[i].port == port) {
+			e = &fp_cache[i];
+			break;
+		}
+		if (!fp_cache[i].port && !e)
+			e = &fp_cache[i];
+	}
+	if (e && e->port == port && e->iobase == port->iobase &&
+	    e->mapbase == port->mapbase && e->type == port->type && !refresh) {
+		s->fp = e->fp;
+		cached = true;
+	} else {
+		probe_fingerprint(s, &s->fp);
+		if (e) {
+			e->port = port;
+			e->iobase = port->iobase;
+			e->mapbase = port->mapbase;
+			e->type = port->type;
+			e->fp = s->fp;
+		}
 	}
+	mutex_unlock(&fp_cache_lock);
+
+	if (!probe_fast)
+		s->fp.strategy = UART_PROBE_STRAT_DELAY;
+	trace_uart_probe_fingerprint(s->dev, s->fp.chip, s->fp.strategy,
+				     s->fp.iir, s->fp.efr,
+				     s->fp.id[0] << 16 | s->fp.id[1] << 8 | s->fp.id[2],
+				     cached, s->fp.ns);
+	return cached;
+}
+
+/*
+ * Look up an idle 8250 port, take its mutex, save its registers and
+ * identify the chip (see probe_identify()).
+ * owner is the /dev/uart_probe file asking, NULL for debugfs and boot.
+ */
+static int probe_begin(struct probe_session *s, char *dev, int kind,
+		       struct file *owner)
+{
+	struct uart_port *port;
+	int claimed;
 
-	u8250p = up_to_u8250p(port);
-	if (!u8250p) {
+	memset(s, 0, sizeof(*s));
+	s->dev = dev;
+	s->kind = kind;
+
+	port = probe_find_port(dev, &s->tport);
+	if (IS_ERR(port))
+		return PTR_ERR(port);
+
+	s->port = port;
+	s->u8250p = up_to_u8250p(port);
+	if (!s->u8250p) {
 		pr_err("uart_probe: Not an 8250-based UART\n");
 		return -ENODEV;
 	}
 
-	if (tty_port_initialized(tport) && tty_port_users(tport) > 0) {
-		pr_err("uart_probe: TTY device %s is busy or opened by userspace\n", selected_dev);
+	claimed = claim_check(s->tport, owner);
+	if (claimed < 0) {
+		pr_err("uart_probe: TTY device %s is claimed\n", dev);
+		return claimed;
+	}
+
+	if (!claimed && tty_port_initialized(s->tport) && tty_port_users(s->tport) > 0) {
+		pr_err("uart_probe: TTY device %s is busy or opened by userspace\n", dev);
 		return -EBUSY;
 	}
 
-    mutex_lock(&tport->mutex);
+	mutex_lock(&s->tport->mutex);
+
+	s->t0 = ktime_get();
+	trace_uart_probe_start(dev, kind, port->uartclk, port->fifosize);
 
 	/* Store current port config */
-    old_lcr = port->serial_in(port, UART_LCR);
-    old_fcr = u8250p->fcr;
-    old_mcr = port->serial_in(port, UART_MCR);
+	s->lcr = port->serial_in(port, UART_LCR);
+	s->fcr = s->u8250p->fcr;
+	s->mcr = port->serial_in(port, UART_MCR);
+	s->ier = port->serial_in(port, UART_IER);
+	port->serial_out(port, UART_LCR, UART_LCR_CONF_MODE_A);
+	s->dl = port->serial_in(port, UART_DLL) |
+		(port->serial_in(port, UART_DLM) << 8);
+	port->serial_out(port, UART_LCR, s->lcr);
+	switch (probe_clock(port)) {
+	case PROBE_CLOCK_950:
+		s->clk = probe_icr_read(s, UART_TCR);
+		s->cpr = probe_icr_read(s, UART_CPR);
+		break;
+	case PROBE_CLOCK_XR:
+		s->clk = probe_xr_dld(s, false, 0);
+		port->serial_out(port, UART_LCR, s->lcr);
+		break;
+	}
+	probe_identify(s, false);
 
-	/* Enable FIFO and loopback */
-    port->serial_out(port, UART_FCR, UART_FCR_ENABLE_FIFO |
-                                    UART_FCR_CLEAR_RCVR |
-                                    UART_FCR_CLEAR_XMIT | old_fcr);
-    port->serial_out(port, UART_MCR, old_mcr | UART_MCR_LOOP);
-
-	/* Set baud 115200 */
-    port->serial_out(port, UART_LCR, UART_LCR_CONF_MODE_A);
-    old_dl = port->serial_in(port, UART_DLL) |
-             (port->serial_in(port, UART_DLM) << 8);
-    port->serial_out(port, UART_DLL, 1);
-    port->serial_out(port, UART_DLM, 0);
-    port->serial_out(port, UART_LCR, UART_LCR_WLEN8);
+	s->div = 1;
+	s->sampling = 16;
+	s->probe_fcr = s->fcr;
+	return 0;
+}
 
-	/* Transmit one byte at a time and check for overrun */
-    for (count_tx = 0; count_tx < FIFO_SIZE_MAX; count_tx++) {
-        port->serial_out(port, UART_TX, 0xff);
-        mdelay(1);
+/* Internal loopback, 8N1 at the session clock, interrupts off, with the given FCR */
+static void probe_loopback(struct probe_session *s, u8 fcr)
+{
+	struct uart_port *port = s->port;
+	u8 mcr = s->mcr | UART_MCR_LOOP;
 
-        lsr = port->serial_in(port, UART_LSR);
-        if (lsr & UART_LSR_OE) {
-            rx_fifo_size = count_tx;
-            break;
-        }
-    }
+	if (probe_clock(port) == PROBE_CLOCK_950)
+		mcr = (mcr & ~UART_MCR_CLKSEL) | (s->prescale ? UART_MCR_CLKSEL : 0);
 
-	/* Restore initial port config */
-    port->serial_out(port, UART_FCR, old_fcr);
-    port->serial_out(port, UART_MCR, old_mcr);
-    port->serial_out(port, UART_LCR, UART_LCR_CONF_MODE_A);
-    port->serial_out(port, UART_DLL, old_dl & 0xff);
-    port->serial_out(port, UART_DLM, old_dl >> 8);
-    port->serial_out(port, UART_LCR, old_lcr);
-    mutex_unlock(&tport->mutex);
+	port->serial_out(port, UART_IER, 0x00);
+	port->serial_out(port, UART_FCR, fcr);
+	port->serial_out(port, UART_MCR, mcr);
 
-    int len = (rx_fifo_size == 0)
-              ? snprintf(tmp, sizeof(tmp), "RX overflow not detected\n")
-              : snprintf(tmp, sizeof(tmp), "%d\n", rx_fifo_size);
-    return simple_read_from_buffer(buf, count, ppos, tmp, len);
-}
+	port->serial_out(port, UART_LCR, UART_LCR_CONF_MODE_A);
+	port->serial_out(port, UART_DLL, s->div & 0xff);
+	port->serial_out(port, UART_DLM, s->div >> 8);
+	port->serial_out(port, UART_LCR, UART_LCR_WLEN8);
+	probe_write_clock(s, false);
 
-static const struct file_operations rx_fifo_fops = {
-    .read = rx_fifo_size_read,
-    .llseek = default_llseek,
-};
+	trace_uart_probe_config(s->dev, UART_LCR_WLEN8, fcr, mcr, 0x00,
+				s->div, s->t0);
+}
 
-/* uart_probe/tx_fifo_size 
- * Probe the TX FIFO size by overrunning the THR
- * enabling loopback, and counting how many bytes
- * we received. This should match port->fifosize.
- * @returns TX FIFO size in number of bytes
- */
-static ssize_t tx_fifo_size_read(struct file *file, char __user *buf,
-                                 size_t count, loff_t *ppos)
+/* One character at the session clock: 10 bits, sampling clocks per bit */
+static u64 probe_char_ns(const struct probe_session *s)
 {
-    char tmp[128];
-	struct tty_driver *driver;
-	struct tty_port *tport;
-	struct uart_port *port;
-	struct uart_state *state;
-	struct uart_8250_port *u8250p;
-    unsigned long deadline;
-    int line, i , rx_count, tx_count = 0;
-	unsigned char old_fcr, old_mcr, old_lcr, lsr;
-	u32 old_dl;
-
-	if (*ppos)
-    	return 0;   /* EOF */
-
-    pr_info("uart_probe: starting TX size probe\n");
+	u64 clocks = 10ULL * s->sampling * s->div;
 
-	driver = tty_find_polling_driver(selected_dev, &line);
-	if (!driver) {
-		pr_err("uart_probe: tty_find_polling_driver failed\n");
-		return -ENODEV;
-	}
+	if (s->prescale)
+		clocks = div_u64(clocks * s->prescale, 8);
+	return div_u64(clocks * NSEC_PER_SEC, s->port->uartclk ?: 1843200);
+}
 
-	tport = driver->ports[line];
-	if (!tport) {
-		pr_err("uart_probe: no tty_port found for line %d\n", line);
-		return -ENODEV;
+/*
+ * Wait for a byte written to THR to be back in RX: TEMT, then a bit
+ * time for the receiver. Only with STRAT_POLL and at most a few char
+ * times; false tells the caller to keep its fixed delay.
+ */
+static bool probe_wait_sent(struct probe_session *s)
+{
+	struct uart_port *port = s->port;
+	u64 char_ns = probe_char_ns(s);
+	u64 deadline;
+
+	if (s->fp.strategy != UART_PROBE_STRAT_POLL)
+		return false;
+	deadline = ktime_get_ns() + 4 * char_ns;
+	while (!(port->serial_in(port, UART_LSR) & UART_LSR_TEMT)) {
+		if (ktime_get_ns() > deadline)
+			return false;
+		cpu_relax();
 	}
+	ndelay(div_u64(char_ns, 10));
+	return true;
+}
 
-	state = container_of(tport, struct uart_state, port);
-	port = state->uart_port;
+static int probe_drain_rx(struct probe_session *s)
+{
+	struct uart_port *port = s->port;
+	u8 lsr;
+	int n = 0;
 
-	if (!port || !port->serial_in || !port->serial_out) {
-		pr_err("uart_probe: invalid port or missing ops\n");
-		return -ENODEV;
+	while ((lsr = port->serial_in(port, UART_LSR)) & UART_LSR_DR) {
+		port->serial_in(port, UART_RX);
+		n++;
 	}
+	trace_uart_probe_drain(s->dev, n, lsr, s->t0);
+	return n;
+}
 
-	u8250p = up_to_u8250p(port);
-	if (!u8250p) {
-		pr_err("uart_probe: Not an 8250-based UART\n");
-		return -ENODEV;
-	}
+/* Put the saved registers back and release the port */
+static void probe_end(struct probe_session *s, int result)
+{
+	struct uart_port *port = s->port;
 
-	if (tty_port_initialized(tport) && tty_port_users(tport) > 0) {
-		pr_err("uart_probe: TTY device %s is busy or opened by userspace\n", selected_dev);
-		return -EBUSY;
-	}
+	port->serial_out(port, UART_IER, 0x00);
+	probe_drain_rx(s);
 
-    mutex_lock(&tport->mutex);
+	probe_write_clock(s, true);
+	port->serial_out(port, UART_FCR, s->fcr);
+	port->serial_out(port, UART_MCR, s->mcr);
+	port->serial_out(port, UART_LCR, UART_LCR_CONF_MODE_A);
+	port->serial_out(port, UART_DLL, s->dl & 0xff);
+	port->serial_out(port, UART_DLM, s->dl >> 8);
+	port->serial_out(port, UART_LCR, s->lcr);
+	port->serial_out(port, UART_IER, s->ier);
 
-	/* Store initial port config */
-    old_lcr = port->serial_in(port, UART_LCR);
-    old_fcr = u8250p->fcr;
-    old_mcr = port->serial_in(port, UART_MCR);
+	trace_uart_probe_restore(s->dev, s->lcr, s->fcr, s->mcr, s->ier,
+				 s->dl, s->t0);
 
-	/* Enable FIFO and Loopback */
-    port->serial_out(port, UART_FCR, UART_FCR_ENABLE_FIFO |
-                                    UART_FCR_CLEAR_RCVR |
-                                    UART_FCR_CLEAR_XMIT);
-    port->serial_out(port, UART_MCR, old_mcr | UART_MCR_LOOP);
+	mutex_unlock(&s->tport->mutex);
 
-	/* Set baud 115200 */
-    port->serial_out(port, UART_LCR, UART_LCR_CONF_MODE_A);
-    old_dl = port->serial_in(port, UART_DLL) |
-             (port->serial_in(port, UART_DLM) << 8);
-    port->serial_out(port, UART_DLL, 1);
-    port->serial_out(port, UART_DLM, 0);
-    port->serial_out(port, UART_LCR, UART_LCR_WLEN8);
-	
-	/* Fill TX FIFO */
-    for (i = 0; i < FIFO_SIZE_MAX; i++) {
-        port->serial_out(port, UART_TX, 0xFF);
-        tx_count++;
-    }
-
-	mdelay(50);
-
-	/* Count how many bytes we received */
-    deadline = jiffies + msecs_to_jiffies(500);
-    while (time_before(jiffies, deadline) && rx_count < tx_count) {
-        lsr = port->serial_in(port, UART_LSR);
-        if (lsr & UART_LSR_DR) {
-            unsigned char val = port->serial_in(port, UART_RX);
-            if (val == 0xFF)
-                rx_count++;
-        } else {
-            cpu_relax();
-        }
-    }
-
-	/* Restore port config */
-    port->serial_out(port, UART_FCR, old_fcr);
-    port->serial_out(port, UART_MCR, old_mcr);
-    port->serial_out(port, UART_LCR, UART_LCR_CONF_MODE_A);
-    port->serial_out(port, UART_DLL, old_dl & 0xff);
-    port->serial_out(port, UART_DLM, old_dl >> 8);
-    port->serial_out(port, UART_LCR, old_lcr);
-
-    mutex_unlock(&tport->mutex);
-
-	if (rx_count == 0)
-		return simple_read_from_buffer(buf, count, ppos, 
-					"TX loopback failed or no data received\n", 42);
-	else {
-		int strlen = scnprintf(tmp, sizeof(tmp), "%d\n", rx_count);
-		return simple_read_from_buffer(buf, count, ppos, tmp, strlen);
-	}
-   
-}
-
-static const struct file_operations tx_fifo_fops = {
-    .read = tx_fifo_size_read,
-    .llseek = default_llseek,
-};
+	trace_uart_probe_end(s->dev, s->kind, result, s->t0);
+}
 
-/* uart_probe/tx_trig_level
- * Probe the trigger level of the TX FIFO
- * by enabling loopback, filling the TX FIFO, 
- * and counting how many bytes until THRI interrupt is set
- * NOTE: we explicitly cap TX size to port->fifosize
- * otherwise serial_out will drop & transmit
- * randomly while it's full.
- * @returns TX FIFO trigger level in number of bytes
+/*
+ * Fill the TX FIFO in loopback and count what comes back, which should
+ * match port->fifosize. Leaves the port in loopback.
  */
-static ssize_t tx_trig_probe_read(struct file *file, char __user *buf,
-                                  size_t count, loff_t *ppos)
+static int measure_tx_fifo_size(struct probe_session *s, unsigned int settle_ms)
 {
-    char tmp[128];
-	struct tty_driver *driver;
-	struct tty_port *tport;
-	struct uart_port *port;
-	struct uart_state *state;
-	struct uart_8250_port *u8250p;
-    unsigned long deadline;
-    int line;
-	int measured_tx_fifo = 0;
-    int trig = 0;
-    int rx_count = 0;
-	unsigned char old_fcr, old_mcr, old_lcr, old_ier, lsr, iir;
-	u32 old_dl;
-
-	if (*ppos)
-    	return 0;   /* EOF */
+	struct uart_port *port = s->port;
+	unsigned long deadline;
+	int i, tx_count = 0, rx_count = 0;
+	u8 lsr = 0;
 
-    pr_info("uart_probe: starting TX size probe\n");
+	probe_loopback(s, UART_FCR_ENABLE_FIFO | UART_FCR_CLEAR_RCVR |
+			  UART_FCR_CLEAR_XMIT);
+	probe_drain_rx(s);
 
-	driver = tty_find_polling_driver(selected_dev, &line);
-	if (!driver) {
-		pr_err("uart_probe: tty_find_polling_driver failed\n");
-		return -ENODEV;
+	/* Fill TX FIFO */
+	for (i = 0; i < FIFO_SIZE_MAX; i++) {
+		port->serial_out(port, UART_TX, 0xFF);
+		tx_count++;
 	}
+	if (trace_uart_probe_fill_enabled())
+		trace_uart_probe_fill(s->dev, tx_count,
+				      port->serial_in(port, UART_LSR), s->t0);
 
-	tport = driver->ports[line];
-	if (!tport) {
-		pr_err("uart_probe: no tty_port found for line %d\n", line);
-		return -ENODEV;
+	if (settle_ms)
+		mdelay(settle_ms);
+
+	/* Let RX drain what arrived via loopback */
+	deadline = jiffies + msecs_to_jiffies(500 * s->div);
+	while (time_before(jiffies, deadline) && rx_count < tx_count) {
+		lsr = port->serial_in(port, UART_LSR);
+		if (lsr & UART_LSR_DR) {
+			if (port->serial_in(port, UART_RX) == 0xFF)
+				rx_count++;
+		} else if (s->fp.strategy == UART_PROBE_STRAT_POLL &&
+			   (lsr & UART_LSR_TEMT) && probe_wait_sent(s) &&
+			   !(port->serial_in(port, UART_LSR) & UART_LSR_DR)) {
+			/* all sent and all read, the rest was dropped at THR */
+			break;
+		} else {
+			cpu_relax();
+		}
 	}
+	trace_uart_probe_drain(s->dev, rx_count, lsr, s->t0);
 
-	state = container_of(tport, struct uart_state, port);
-	port = state->uart_port;
+	if (rx_count <= 0)
+		return -EIO;
 
-	if (!port || !port->serial_in || !port->serial_out) {
-		pr_err("uart_probe: invalid port or missing ops\n");
-		return -ENODEV;
-	}
+	return rx_count;
+}
 
-	u8250p = up_to_u8250p(port);
-	if (!u8250p) {
-		pr_err("uart_probe: Not an 8250-based UART\n");
-		return -ENODEV;
-	}
+/* uart_probe/rx_trig_level
+ * Probe the serial devices RX FIFO trigger level
+ * by setting internal loopback and sending data to itself,
+ * one byte at a time,
+ * until the rx interrupt is triggered 
+ * @returns RX FIFO trigger level in number of bytes
+ */
+static int probe_rx_trig(struct probe_session *s)
+{
+	struct uart_port *port = s->port;
+	u8 efr, acr, iir = 0;
+	int trig;
 
-	if (tty_port_initialized(tport) && tty_port_users(tport) > 0) {
-		pr_err("uart_probe: TTY device %s is busy or opened by userspace\n", selected_dev);
-		return -EBUSY;
-	}
+	if (s->fp.strategy == UART_PROBE_STRAT_NOFIFO)
+		return 1;
 
-	mutex_lock(&tport->mutex);
+	/* Enable and clear FIFO */
+	probe_loopback(s, s->probe_fcr | UART_FCR_CLEAR_RCVR | UART_FCR_CLEAR_XMIT);
+
+	port->serial_out(port, UART_LCR, UART_LCR_CONF_MODE_B);
+	efr = port->serial_in(port, UART_EFR);		/* bit4 = ECB */
+	acr = port->serial_in(port, UART_ACR);		/* bit5 = TLENB (950 table) */
+	port->serial_out(port, UART_LCR, UART_LCR_WLEN8);
+	trace_uart_probe_ident(s->dev, efr, acr, port->type,
+			       s->u8250p->capabilities);
 
-	measured_tx_fifo = measure_tx_fifo_size(tport, port, u8250p);
+	/* Enable RX interrupts */
+	port->serial_out(port, UART_IER, UART_IER_RDI);
 
-	/* probe for fifosize, since port->fifosize may not be reliable */
-	measured_tx_fifo = measure_tx_fifo_size(tport, port, u8250p);
-	if (measured_tx_fifo < 1) {
-		char tmp[64];
-		int len;
-		mutex_unlock(&tport->mutex);
-		len = scnprintf(tmp, sizeof(tmp), "TX loopback failed or no data received\n");
-		return simple_read_from_buffer(buf, count, ppos, tmp, len);
+	/* Probe for trigger threshold */
+	for (trig = 1; trig < 256; trig++) {
+		port->serial_out(port, UART_TX, 0x55);
+
+		/* Wait for byte transmission */
+		if (!probe_wait_sent(s))
+			udelay(100 * s->div); /* 1 byte @ 115200 bps = ~87us */
+		if (trace_uart_probe_fill_enabled())
+			trace_uart_probe_fill(s->dev, trig,
+					      port->serial_in(port, UART_LSR), s->t0);
+		iir = port->serial_in(port, UART_IIR);
+
+		if (!(iir & UART_IIR_NO_INT) && (iir & UART_IIR_ID) == UART_IIR_RDI) {
+			trace_uart_probe_irq(s->dev, UART_PROBE_COND_RDI, iir, 0, 0,
+					     trig, s->t0);
+			return trig;
+		}
 	}
 
-	/* Store initial port config */
-	old_lcr = port->serial_in(port, UART_LCR);
-    old_fcr = u8250p->fcr;
-	old_mcr = port->serial_in(port, UART_MCR);
-	old_ier = port->serial_in(port, UART_IER);
+	trace_uart_probe_irq(s->dev, UART_PROBE_COND_TIMEOUT, iir, 0, 0, trig,
+			     s->t0);
+	pr_err("uart_probe: RX trigger test failed — no interrupt detected\n");
+	return -EIO;
+}
+
+/* uart_probe/rx_fifo_size
+ * Probe the RX FIFO size by setting internal loopback,
+ * transmitting data to itself, one byte at a time
+ * and detecting rx overrun
+ * @returns the size of th RX FIFO in number of bytes
+ */
+static int probe_rx_fifo(struct probe_session *s)
+{
+	struct uart_port *port = s->port;
+	int count_tx;
+	u8 lsr = 0;
+
+	if (s->fp.strategy == UART_PROBE_STRAT_NOFIFO)
+		return 1;
 
 	/* Enable FIFO and loopback */
-	port->serial_out(port, UART_FCR, UART_FCR_ENABLE_FIFO |
-	                                UART_FCR_CLEAR_RCVR |
-                                    UART_FCR_CLEAR_XMIT | old_fcr);
-	port->serial_out(port, UART_MCR, old_mcr | UART_MCR_LOOP);
+	probe_loopback(s, UART_FCR_ENABLE_FIFO | UART_FCR_CLEAR_RCVR |
+			  UART_FCR_CLEAR_XMIT | s->probe_fcr);
 
-	/* Drain RX FIFO */
-	while (port->serial_in(port, UART_LSR) & UART_LSR_DR)
-		port->serial_in(port, UART_RX);
+	/* Transmit one byte at a time and check for overrun */
+	for (count_tx = 0; count_tx < FIFO_SIZE_MAX; count_tx++) {
+		port->serial_out(port, UART_TX, 0xff);
+		if (!probe_wait_sent(s))
+			mdelay(s->div);
 
-	/* Set baud rate 115200 */
-	port->serial_out(port, UART_LCR, UART_LCR_CONF_MODE_A);
-	old_dl = port->serial_in(port, UART_DLL) |
-	        	(port->serial_in(port, UART_DLM) << 8);
-	port->serial_out(port, UART_DLL, 1);
-	port->serial_out(port, UART_DLM, 0);
-	port->serial_out(port, UART_LCR, UART_LCR_WLEN8);
+		lsr = port->serial_in(port, UART_LSR);
+		trace_uart_probe_fill(s->dev, count_tx + 1, lsr, s->t0);
+		if (lsr & UART_LSR_OE) {
+			trace_uart_probe_irq(s->dev, UART_PROBE_COND_OE, 0, lsr, 0,
+					     count_tx, s->t0);
+			return count_tx ? count_tx : -EIO;
+		}
+	}
+
+	trace_uart_probe_irq(s->dev, UART_PROBE_COND_TIMEOUT, 0, lsr, 0,
+			     count_tx, s->t0);
+	return -EIO;
+}
+
+/* uart_probe/tx_fifo_size 
+ * Probe the TX FIFO size by overrunning the THR
+ * enabling loopback, and counting how many bytes
+ * we received. This should match port->fifosize.
+ * @returns TX FIFO size in number of bytes
+ */
+static int probe_tx_fifo(struct probe_session *s)
+{
+	if (s->fp.strategy == UART_PROBE_STRAT_NOFIFO)
+		return 1;
+	return measure_tx_fifo_size(s, 50);
+}
+
+/* uart_probe/tx_trig_level
+ * Probe the trigger level of the TX FIFO
+ * by enabling loopback, filling the TX FIFO, 
+ * and counting how many bytes until THRI interrupt is set
+ * NOTE: we explicitly cap TX size to port->fifosize
+ * otherwise serial_out will drop & transmit
+ * randomly while it's full.
+ * @returns TX FIFO trigger level in number of bytes
+ */
+static int probe_tx_trig(struct probe_session *s)
+{
+	struct uart_port *port = s->port;
+	unsigned long deadline;
+	int measured_tx_fifo, i, trig, rx_count = 0;
+	u8 lsr = 0, iir = 0;
+
+	if (s->fp.strategy == UART_PROBE_STRAT_NOFIFO)
+		return 1;
+
+	/* probe for fifosize, since port->fifosize may not be reliable */
+	measured_tx_fifo = measure_tx_fifo_size(s, 0);
+	if (measured_tx_fifo < 1)
+		return -EIO;
+
+	/* Enable FIFO and loopback */
+	probe_loopback(s, UART_FCR_ENABLE_FIFO | UART_FCR_CLEAR_RCVR |
+			  UART_FCR_CLEAR_XMIT | s->probe_fcr);
+	probe_drain_rx(s);
 
 	/* Enable Transmission Hold Register Empty Interrupt */
 	port->serial_out(port, UART_IER, UART_IER_THRI);
 
 	/* Fill THR, but don't overfill it!  */
-	for (int i = 0; i <= measured_tx_fifo; i++)
+	for (i = 0; i <= measured_tx_fifo; i++)
 		port->serial_out(port, UART_TX, 0xFF);
+	if (trace_uart_probe_fill_enabled())
+		trace_uart_probe_fill(s->dev, i,
+				      port->serial_in(port, UART_LSR), s->t0);
 
 	/* Count how many bytes we rx until THR is empty */
-	deadline = jiffies + msecs_to_jiffies(1500);
+	deadline = jiffies + msecs_to_jiffies(1500 * s->div);
 	while (time_before(jiffies, deadline)) {
 		lsr = port->serial_in(port, UART_LSR);
 		if (lsr & UART_LSR_DR) {
@@ -626,69 +963,2155 @@ static ssize_t tx_trig_probe_read(struct file *file, char __user *buf,
 
 		iir = port->serial_in(port, UART_IIR);
 		if (!(iir & UART_IIR_NO_INT) && (iir & 0x0E) == UART_IIR_THRI) {
+			trace_uart_probe_drain(s->dev, rx_count, lsr, s->t0);
+			trace_uart_probe_irq(s->dev, UART_PROBE_COND_THRI, iir, lsr, 0,
+					     rx_count, s->t0);
 			trig = measured_tx_fifo + 1 - rx_count;
-			break;
+			return trig > 0 ? trig : -EIO;
 		}
 
 		ndelay(10);
 	}
 
-	/* Restore IER */
-	port->serial_out(port, UART_IER, old_ier);
+	trace_uart_probe_drain(s->dev, rx_count, lsr, s->t0);
+	trace_uart_probe_irq(s->dev, UART_PROBE_COND_TIMEOUT, iir, lsr, 0,
+			     rx_count, s->t0);
+	return -EIO;
+}
 
-	/* Drain RX FIFO just in case */
-	while (port->serial_in(port, UART_LSR) & UART_LSR_DR)
-		port->serial_in(port, UART_RX);
+/*
+ * Automatic RTS/CTS flow control, set up the way serial8250_set_termios()
+ * does it: EFR on 16650-class, 16C950 and Exar parts, MCR AFE on the
+ * 16750. In loopback RTS is wired to CTS, so MSR shows what auto-RTS is
+ * doing and auto-CTS holds the transmitter off while RTS is down.
+ */
+#define FLOW_BYTES	256		/* throughput run */
+#define FLOW_LAG	2		/* receiver takes a byte every FLOW_LAG char times */
+#define FLOW_TIME_MS	2000
+
+enum flow_mode {
+	FLOW_NONE,
+	FLOW_MCR_AFE,
+	FLOW_EFR,
+	FLOW_XR_EFR,
+};
 
-	/* Restore registers */
-	port->serial_out(port, UART_FCR, old_fcr);
-	port->serial_out(port, UART_MCR, old_mcr);
-	port->serial_out(port, UART_DLL, old_dl & 0xff);
-	port->serial_out(port, UART_DLM, old_dl >> 8);
-	port->serial_out(port, UART_LCR, old_lcr);
+static const char *const flow_mode_names[] = {
+	[FLOW_NONE] = "none",
+	[FLOW_MCR_AFE] = "mcr_afe",
+	[FLOW_EFR] = "efr",
+	[FLOW_XR_EFR] = "xr_efr",
+};
 
-	mutex_unlock(&tport->mutex);
+struct flow_result {
+	int mode;
+	int off;			/* RX FIFO level where RTS went down */
+	int on;				/* and where it came back up */
+	u32 sent, received, overruns;
+	u64 ns;
+};
+
+static int flow_mode(struct probe_session *s)
+{
+	if (s->port->type == PORT_16C950)
+		return FLOW_EFR;
+	if (s->u8250p->capabilities & UART_CAP_EFR)
+		return (s->port->flags & UPF_EXAR_EFR) ? FLOW_XR_EFR : FLOW_EFR;
+	if (s->u8250p->capabilities & UART_CAP_AFE)
+		return FLOW_MCR_AFE;
+	return FLOW_NONE;
+}
+
+/* Write EFR, return what was there. Leaves LCR at 8N1. */
+static u8 flow_set_efr(struct probe_session *s, int mode, u8 efr)
+{
+	struct uart_port *port = s->port;
+	int reg = mode == FLOW_XR_EFR ? UART_XR_EFR : UART_EFR;
+	u8 old;
+
+	port->serial_out(port, UART_LCR, UART_LCR_CONF_MODE_B);
+	old = port->serial_in(port, reg);
+	port->serial_out(port, reg, efr);
+	port->serial_out(port, UART_LCR, UART_LCR_WLEN8);
+	return old;
+}
+
+/* Wait for the byte just written to come out, or give up after 4 chars */
+static u8 flow_wait_temt(struct probe_session *s, u64 char_ns)
+{
+	struct uart_port *port = s->port;
+	ktime_t end = ktime_add_ns(ktime_get(), 4 * char_ns);
+	u8 lsr;
+
+	while (!((lsr = port->serial_in(port, UART_LSR)) & UART_LSR_TEMT) &&
+	       ktime_before(ktime_get(), end))
+		cpu_relax();
+	return lsr;
+}
+
+/* The RTS levels, then with throughput the flow-controlled run as well */
+static int flow_measure(struct probe_session *s, struct flow_result *r,
+			bool throughput)
+{
+	struct uart_port *port = s->port;
+	u64 char_ns = probe_char_ns(s);
+	u8 fcr = UART_FCR_ENABLE_FIFO | UART_FCR_CLEAR_RCVR | UART_FCR_CLEAR_XMIT |
+		 s->probe_fcr;
+	u8 mcr, msr = 0, efr = 0;
+	unsigned int loadsz;
+	ktime_t start, now, next_read, deadline;
+	int n, ret = 0;
+
+	memset(r, 0, sizeof(*r));
+	r->off = r->on = -1;
+	r->mode = flow_mode(s);
+	if (r->mode == FLOW_NONE)
+		return -EOPNOTSUPP;
+
+	probe_loopback(s, fcr);
+	probe_drain_rx(s);
+	mcr = s->mcr | UART_MCR_LOOP | UART_MCR_RTS;
+	if (r->mode == FLOW_MCR_AFE)
+		mcr |= UART_MCR_AFE;
+	else
+		efr = flow_set_efr(s, r->mode, UART_EFR_ECB | UART_EFR_RTS | UART_EFR_CTS);
+	port->serial_out(port, UART_MCR, mcr);
+	trace_uart_probe_config(s->dev, UART_LCR_WLEN8, fcr, mcr, 0x00, s->div, s->t0);
+
+	/* one byte at a time until RTS, seen on CTS, drops */
+	for (n = 1; n <= FIFO_SIZE_MAX; n++) {
+		port->serial_out(port, UART_TX, 0x55);
+		flow_wait_temt(s, char_ns);
+		msr = port->serial_in(port, UART_MSR);
+		if (!(msr & UART_MSR_CTS)) {
+			r->off = n;
+			break;
+		}
+	}
+	if (trace_uart_probe_fill_enabled())
+		trace_uart_probe_fill(s->dev, min(n, FIFO_SIZE_MAX),
+				      port->serial_in(port, UART_LSR), s->t0);
+	if (r->off < 0) {
+		trace_uart_probe_irq(s->dev, UART_PROBE_COND_TIMEOUT, 0, 0, msr, n,
+				     s->t0);
+		ret = -EIO;
+		goto out;
+	}
+	trace_uart_probe_irq(s->dev, UART_PROBE_COND_CTS, 0, 0, msr, r->off,
+			     s->t0);
+
+	/* read back one byte at a time until it comes up again */
+	for (n = r->off; n >= 0; n--) {
+		msr = port->serial_in(port, UART_MSR);
+		if (msr & UART_MSR_CTS) {
+			r->on = n;
+			break;
+		}
+		if (n)
+			port->serial_in(port, UART_RX);
+	}
+	if (trace_uart_probe_drain_enabled())
+		trace_uart_probe_drain(s->dev, r->off - max(n, 0),
+				       port->serial_in(port, UART_LSR), s->t0);
+	if (r->on < 0) {
+		trace_uart_probe_irq(s->dev, UART_PROBE_COND_TIMEOUT, 0, 0, msr, 0,
+				     s->t0);
+		ret = -EIO;
+		goto out;
+	}
+	trace_uart_probe_irq(s->dev, UART_PROBE_COND_CTS, 0, 0, msr, r->on,
+			     s->t0);
+
+	if (!throughput)
+		goto out;
+
+	/* a receiver slower than the line: does flow control hold it off? */
+	probe_drain_rx(s);
+	loadsz = s->u8250p->tx_loadsz ?: port->fifosize ?: 1;
+	start = next_read = ktime_get();
+	deadline = ktime_add_ms(start, FLOW_TIME_MS);
+	do {
+		u8 lsr = port->serial_in(port, UART_LSR);
+
+		if (lsr & UART_LSR_OE)
+			r->overruns++;
+		if ((lsr & UART_LSR_THRE) && r->sent < FLOW_BYTES) {
+			for (n = 0; n < loadsz && r->sent < FLOW_BYTES; n++, r->sent++)
+				port->serial_out(port, UART_TX, r->sent & 0xff);
+		}
+		now = ktime_get();
+		if ((lsr & UART_LSR_DR) && !ktime_before(now, next_read)) {
+			port->serial_in(port, UART_RX);
+			r->received++;
+			next_read = ktime_add_ns(now, FLOW_LAG * char_ns);
+		}
+	} while (r->received < FLOW_BYTES && ktime_before(now, deadline));
+	r->ns = ktime_to_ns(ktime_sub(now, start));
+	if (trace_uart_probe_drain_enabled())
+		trace_uart_probe_drain(s->dev, r->received,
+				       port->serial_in(port, UART_LSR), s->t0);
+
+out:
+	if (r->mode != FLOW_MCR_AFE)
+		flow_set_efr(s, r->mode, efr);
+	return ret;
+}
+
+/* uart_probe/rts_off_level
+ * RX FIFO level at which automatic RTS deasserts
+ * @returns bytes in the RX FIFO when RTS went down
+ */
+static int probe_rts_off(struct probe_session *s)
+{
+	struct flow_result r;
+	int ret = flow_measure(s, &r, false);
+
+	return ret ? ret : r.off;
+}
+
+/* uart_probe/rts_on_level
+ * RX FIFO level at which automatic RTS asserts again,
+ * reading the FIFO back down from rts_off_level
+ * @returns bytes left in the RX FIFO when RTS came up, 0 means empty
+ */
+static int probe_rts_on(struct probe_session *s)
+{
+	struct flow_result r;
+	int ret = flow_measure(s, &r, false);
+
+	return ret ? ret : r.on;
+}
+
+static const struct probe_desc probes[UART_PROBE_COUNT] = {
+	[UART_PROBE_RX_TRIG] = { "rx_trig_level", UART_PROBE_RX_TRIG,
+		probe_rx_trig, "RX trigger test failed\n" },
+	[UART_PROBE_RX_FIFO] = { "rx_fifo_size", UART_PROBE_RX_FIFO,
+		probe_rx_fifo, "RX overflow not detected\n" },
+	[UART_PROBE_TX_FIFO] = { "tx_fifo_size", UART_PROBE_TX_FIFO,
+		probe_tx_fifo, "TX loopback failed or no data received\n" },
+	[UART_PROBE_TX_TRIG] = { "tx_trig_level", UART_PROBE_TX_TRIG,
+		probe_tx_trig, "TX loopback failed or no data received\n" },
+	[UART_PROBE_RTS_OFF] = { "rts_off_level", UART_PROBE_RTS_OFF,
+		probe_rts_off, "No automatic RTS/CTS, or RTS never dropped\n" },
+	[UART_PROBE_RTS_ON] = { "rts_on_level", UART_PROBE_RTS_ON,
+		probe_rts_on, "No automatic RTS/CTS, or RTS never came back\n" },
+};
+
+/*
+ * One command from start to finish. Failures before the session starts
+ * (unknown port, busy) leave everything but value and probe zero.
+ */
+static int probe_run(const struct uart_probe_cmd *cmd,
+		     struct uart_probe_result *res, struct file *owner)
+{
+	struct probe_session s;
+	char dev[UART_PROBE_PORT_LEN];
+	int ret;
+
+	memset(res, 0, sizeof(*res));
+	res->probe = cmd->probe;
+
+	if (cmd->probe >= UART_PROBE_COUNT ||
+	    cmd->flags & ~(UART_PROBE_F_DIVISOR | UART_PROBE_F_FCR |
+			   UART_PROBE_F_SAMPLING | UART_PROBE_F_PRESCALE) ||
+	    ((cmd->flags & UART_PROBE_F_DIVISOR) &&
+	     (!cmd->divisor || cmd->divisor > UART_PROBE_DIVISOR_MAX))) {
+		res->value = -EINVAL;
+		return -EINVAL;
+	}
+	strscpy(dev, cmd->port, sizeof(dev));
+
+	ret = probe_begin(&s, dev, cmd->probe, owner);
+	if (ret) {
+		res->value = ret;
+		return ret;
+	}
+	if (cmd->flags & UART_PROBE_F_DIVISOR)
+		s.div = cmd->divisor;
+	if (cmd->flags & UART_PROBE_F_FCR)
+		s.probe_fcr = cmd->fcr;
+	ret = probe_set_clock(&s, cmd->flags & UART_PROBE_F_SAMPLING ? cmd->sampling : 16,
+			      cmd->flags & UART_PROBE_F_PRESCALE ? cmd->prescale : 0);
+
+	if (!ret)
+		ret = probes[cmd->probe].run(&s);
+	probe_end(&s, ret);
+
+	if (ret == 0 && cmd->probe != UART_PROBE_RTS_ON)
+		ret = -EIO;
+	res->value = ret;
+	res->duration_ns = ktime_to_ns(ktime_sub(ktime_get(), s.t0));
+	res->uartclk = s.port->uartclk;
+	res->type = s.port->type;
+	res->fifosize = s.port->fifosize;
+	res->dl = s.dl;
+	res->lcr = s.lcr;
+	res->fcr = s.fcr;
+	res->mcr = s.mcr;
+	res->ier = s.ier;
+	res->chip = s.fp.chip;
+	res->strategy = s.fp.strategy;
+	return res->value;
+}
+
+/* One probe on dev, formatted for a probe file */
+static ssize_t probe_show(const char *dev, const struct probe_desc *pd,
+			  char __user *buf, size_t count, loff_t *ppos)
+{
+	struct uart_probe_cmd cmd = { .probe = pd->kind };
+	struct uart_probe_result res;
+	char tmp[64];
+	int ret, len;
+
+	if (*ppos)
+		return 0;   /* EOF */
+
+	strscpy(cmd.port, dev, sizeof(cmd.port));
+	cmd.flags = UART_PROBE_F_SAMPLING | (probe_prescale ? UART_PROBE_F_PRESCALE : 0);
+	cmd.sampling = min_t(u32, probe_sampling, 255);
+	cmd.prescale = min_t(u32, probe_prescale, 255);
+	ret = probe_run(&cmd, &res, NULL);
+	if (ret == -ENODEV || ret == -EBUSY || ret == -EINVAL || ret == -EOPNOTSUPP)
+		return ret;
+
+	if (ret < 0)
+		len = scnprintf(tmp, sizeof(tmp), "%s", pd->fail);
+	else
+		len = scnprintf(tmp, sizeof(tmp), "%d\n", ret);
+	return simple_read_from_buffer(buf, count, ppos, tmp, len);
+}
+
+/* Each probe file runs its probe on the selected device once per open */
+static ssize_t probe_read(struct file *file, char __user *buf,
+			  size_t count, loff_t *ppos)
+{
+	return probe_show(selected_dev, file->private_data, buf, count, ppos);
+}
+
+static const struct file_operations probe_fops = {
+	.open = simple_open,
+	.read = probe_read,
+	.llseek = default_llseek,
+};
 
+/* uart_probe/flow_control
+ * Both RTS levels and the lagging receiver run, on the selected device
+ */
+static ssize_t flow_read(struct file *file, char __user *buf,
+			 size_t count, loff_t *ppos)
+{
+	struct probe_session s;
+	struct flow_result r;
+	char dev[UART_PROBE_PORT_LEN], tmp[256];
+	u64 rate = 0, line;
+	int ret, len;
 
-	if (trig == 0)
-		return simple_read_from_buffer(buf, count, ppos, 
-					"TX loopback failed or no data received\n", 42);
-	else {
-		int len = scnprintf(tmp, sizeof(tmp), "%d\n", trig);
-		return simple_read_from_buffer(buf, count, ppos, tmp, len);
+	if (*ppos)
+		return 0;   /* EOF */
+
+	strscpy(dev, selected_dev, sizeof(dev));
+	ret = probe_begin(&s, dev, UART_PROBE_FLOW, NULL);
+	if (ret)
+		return ret;
+	ret = probe_set_clock(&s, probe_sampling, probe_prescale);
+	if (ret) {
+		probe_end(&s, ret);
+		return ret;
 	}
+	ret = flow_measure(&s, &r, true);
+	line = div64_u64(NSEC_PER_SEC, probe_char_ns(&s) ?: 1);
+	probe_end(&s, ret);
+
+	if (ret == -EOPNOTSUPP)
+		return -EOPNOTSUPP;
+	if (r.ns)
+		rate = div64_u64((u64)r.received * NSEC_PER_SEC, r.ns);
+
+	len = scnprintf(tmp, sizeof(tmp),
+			"mode: %s\nrts_off_level: %d\nrts_on_level: %d\n"
+			"lagging receiver: 1 byte per %d chars, %u of %u bytes in %llu ns\n"
+			"throughput: %llu bytes/s, %llu%% of line rate\noverruns: %u\n",
+			flow_mode_names[r.mode], r.off, r.on, FLOW_LAG,
+			r.received, r.sent, r.ns, rate,
+			line ? div64_u64(rate * 100, line) : 0, r.overruns);
+	return simple_read_from_buffer(buf, count, ppos, tmp, len);
+}
+
+static const struct file_operations flow_fops = {
+	.read = flow_read,
+	.llseek = default_llseek,
+};
 
+/* uart_probe/fingerprint
+ * Identify the selected device (or the port directory's, see
+ * ports_create()) again, bypassing the cache
+ */
+static ssize_t fingerprint_read(struct file *file, char __user *buf,
+				size_t count, loff_t *ppos)
+{
+	const char *port_dev = file->private_data;
+	struct probe_session s;
+	struct probe_fingerprint *fp = &s.fp;
+	char dev[UART_PROBE_PORT_LEN], tmp[384];
+	unsigned int type;
+	int ret, len;
+
+	if (*ppos)
+		return 0;   /* EOF */
+
+	strscpy(dev, port_dev ?: selected_dev, sizeof(dev));
+	ret = probe_begin(&s, dev, UART_PROBE_FINGERPRINT, NULL);
+	if (ret)
+		return ret;
+	probe_identify(&s, true);
+	type = s.port->type;
+	probe_end(&s, 0);
+
+	len = scnprintf(tmp, sizeof(tmp),
+			"chip: %s\nport type: %u\nscratch: %s\nIIR: %02x\n"
+			"EFR: %s, %02x\nid: %02x %02x %02x %02x\nfifo: %u\n"
+			"strategy: %s\ntime: %llu ns\n",
+			probe_chip_names[fp->chip], type, fp->scratch ? "yes" : "no",
+			fp->iir, fp->has_efr ? "yes" : "no", fp->efr,
+			fp->id[0], fp->id[1], fp->id[2], fp->id[3], fp->fifo,
+			probe_strategy_names[fp->strategy], fp->ns);
+	return simple_read_from_buffer(buf, count, ppos, tmp, len);
 }
 
-static const struct file_operations tx_trig_fops = {
-	.read = tx_trig_probe_read,
+static const struct file_operations fingerprint_fops = {
+	.open = simple_open,
+	.read = fingerprint_read,
 	.llseek = default_llseek,
 };
 
-static int __init uart_probe_debugfs_init(void)
+/* uart_probe/fifo_disable
+ * Write 1 to run the selected device without its FIFO (16450 mode),
+ * 0 to give it back. Read to list the ports running without one.
+ *
+ * This is not a probe session: the setting stays, for benchmarks through
+ * the tty, until it is cleared or the module is unloaded. The driver
+ * rewrites FCR from up->fcr on every open and termios change and loads
+ * tx_loadsz bytes per THRE interrupt, so both are changed and the old
+ * values kept here. An open port gets the new FCR right away, like a
+ * write to rx_trig_bytes.
+ */
+struct fifo_off {
+	struct list_head node;
+	char dev[UART_PROBE_PORT_LEN];
+	u8 fcr;
+	unsigned short tx_loadsz;
+};
+
+static LIST_HEAD(fifo_offs);
+static DEFINE_MUTEX(fifo_lock);
+
+static struct fifo_off *fifo_off_find(const char *dev)
+{
+	struct fifo_off *f;
+
+	list_for_each_entry(f, &fifo_offs, node)
+		if (!strcmp(f->dev, dev))
+			return f;
+	return NULL;
+}
+
+/* Program up->fcr and tx_loadsz, and FCR itself if the port is open */
+static void fifo_apply(struct tty_port *tport, struct uart_port *port,
+		       u8 fcr, unsigned short tx_loadsz)
+{
+	struct uart_8250_port *up = up_to_u8250p(port);
+	unsigned long flags;
+
+	uart_port_lock_irqsave(port, &flags);
+	up->fcr = fcr;
+	up->tx_loadsz = tx_loadsz;
+	if (tty_port_initialized(tport)) {
+		/* clear both FIFOs on the way, as serial8250_clear_fifos() does */
+		port->serial_out(port, UART_FCR, UART_FCR_ENABLE_FIFO);
+		port->serial_out(port, UART_FCR, UART_FCR_ENABLE_FIFO |
+				 UART_FCR_CLEAR_RCVR | UART_FCR_CLEAR_XMIT);
+		port->serial_out(port, UART_FCR, fcr);
+	}
+	uart_port_unlock_irqrestore(port, flags);
+}
+
+static int fifo_set_disabled(char *dev, bool off)
+{
+	struct tty_port *tport;
+	struct uart_port *port;
+	struct uart_8250_port *up;
+	struct fifo_off *f;
+	int ret = 0;
+
+	port = probe_find_port(dev, &tport);
+	if (IS_ERR(port))
+		return PTR_ERR(port);
+	up = up_to_u8250p(port);
+	if (claim_check(tport, NULL) < 0)
+		return -EBUSY;
+
+	mutex_lock(&fifo_lock);
+	mutex_lock(&tport->mutex);
+	f = fifo_off_find(dev);
+	if (off && !f) {
+		f = kzalloc(sizeof(*f), GFP_KERNEL);
+		if (!f) {
+			ret = -ENOMEM;
+			goto out;
+		}
+		strscpy(f->dev, dev, sizeof(f->dev));
+		f->fcr = up->fcr;
+		f->tx_loadsz = up->tx_loadsz;
+		list_add_tail(&f->node, &fifo_offs);
+		fifo_apply(tport, port, 0, 1);
+	} else if (!off && f) {
+		fifo_apply(tport, port, f->fcr, f->tx_loadsz);
+		list_del(&f->node);
+		kfree(f);
+	}
+out:
+	mutex_unlock(&tport->mutex);
+	mutex_unlock(&fifo_lock);
+	return ret;
+}
+
+/* Give every port its FIFO back, at unload */
+static void fifo_restore_all(void)
+{
+	while (!list_empty(&fifo_offs)) {
+		struct fifo_off *f = list_first_entry(&fifo_offs, struct fifo_off, node);
+
+		/* on success the entry is gone, otherwise the port is */
+		if (fifo_set_disabled(f->dev, false)) {
+			list_del(&f->node);
+			kfree(f);
+		}
+	}
+}
+
+static ssize_t fifo_disable_write(struct file *file, const char __user *buf,
+				  size_t count, loff_t *ppos)
+{
+	char dev[UART_PROBE_PORT_LEN];
+	bool off;
+	int ret;
+
+	ret = kstrtobool_from_user(buf, count, &off);
+	if (ret)
+		return ret;
+
+	strscpy(dev, selected_dev, sizeof(dev));
+	ret = fifo_set_disabled(dev, off);
+	return ret ? ret : count;
+}
+
+static int fifo_disable_show(struct seq_file *m, void *v)
+{
+	struct fifo_off *f;
+
+	mutex_lock(&fifo_lock);
+	list_for_each_entry(f, &fifo_offs, node)
+		seq_printf(m, "%s fcr=%02x tx_loadsz=%u\n", f->dev, f->fcr,
+			   f->tx_loadsz);
+	mutex_unlock(&fifo_lock);
+	return 0;
+}
+
+static int fifo_disable_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, fifo_disable_show, NULL);
+}
+
+static const struct file_operations fifo_disable_fops = {
+	.open = fifo_disable_open,
+	.read = seq_read,
+	.write = fifo_disable_write,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+/* uart_probe/fifo_scope, uart_probe/fifo_scope.vcd
+ * Start a TX burst in loopback and sample LSR, IIR and, where the chip
+ * has them, the FIFO level registers as fast as the bus allows. A sample
+ * is kept only when something changed, so the buffer covers the whole
+ * burst. The capture runs once per open and is read back as a table or
+ * as a VCD waveform.
+ *
+ * Reading IIR clears a pending THRI and reading LSR clears OE, as they
+ * do for the driver's interrupt handler, so both show up once per event.
+ */
+#define SCOPE_SAMPLES_MAX	65536
+#define SCOPE_TIME_MS		1000
+#define SCOPE_TAIL_CHARS	8	/* keep sampling after TEMT, past the rx timeout */
+#define SCOPE_LINE_MAX		128	/* formatted bytes per sample, either format */
+
+/* Exar XR17D15x/XR17V35x enhanced registers, read side */
+#define SCOPE_EXAR_TXCNT	0x0a
+#define SCOPE_EXAR_RXCNT	0x0b
+
+static u32 scope_burst;			/* bytes, 0: the driver's fifosize */
+static u32 scope_samples = 16384;
+static u32 scope_divisor = 1;
+static bool scope_drain;		/* read RX on RDI/timeout like the driver */
+
+enum scope_levels {
+	SCOPE_LEVELS_NONE,
+	SCOPE_LEVELS_950,		/* RFL/TFL at offsets 3/4 with ACR[7] */
+	SCOPE_LEVELS_EXAR,		/* RXCNT/TXCNT */
+};
+
+enum scope_format {
+	SCOPE_TEXT,
+	SCOPE_VCD,
+};
+
+struct scope_sample {
+	u32 t_ns;			/* since the burst was written */
+	u8 lsr;
+	u8 iir;
+	s16 rfl;			/* -1 without level registers */
+	s16 tfl;
+};
+
+struct scope_buf {
+	size_t len;
+	char data[];
+};
+
+static int scope_levels(struct uart_port *port)
+{
+	switch (port->type) {
+	case PORT_16C950:
+		return SCOPE_LEVELS_950;
+	case PORT_XR17D15X:
+	case PORT_XR17V35X:
+		/* past the 8 standard registers, only mapped on MMIO ports */
+		return port->iotype == UPIO_MEM ? SCOPE_LEVELS_EXAR : SCOPE_LEVELS_NONE;
+	default:
+		return SCOPE_LEVELS_NONE;
+	}
+}
+
+static void scope_poll(struct uart_port *port, int levels, struct scope_sample *smp)
+{
+	smp->lsr = port->serial_in(port, UART_LSR);
+	smp->iir = port->serial_in(port, UART_IIR);
+
+	switch (levels) {
+	case SCOPE_LEVELS_950:
+		smp->rfl = port->serial_in(port, UART_LCR);
+		smp->tfl = port->serial_in(port, UART_MCR);
+		break;
+	case SCOPE_LEVELS_EXAR:
+		smp->rfl = port->serial_in(port, SCOPE_EXAR_RXCNT);
+		smp->tfl = port->serial_in(port, SCOPE_EXAR_TXCNT);
+		break;
+	default:
+		smp->rfl = -1;
+		smp->tfl = -1;
+	}
+}
+
+static bool scope_same(const struct scope_sample *a, const struct scope_sample *b)
+{
+	return a->lsr == b->lsr && a->iir == b->iir &&
+	       a->rfl == b->rfl && a->tfl == b->tfl;
+}
+
+/*
+ * Runs without yielding until the transmitter has been empty for
+ * SCOPE_TAIL_CHARS, the buffer is full or SCOPE_TIME_MS have passed.
+ * Returns the samples kept; the last poll is always kept.
+ */
+static u32 scope_capture(struct probe_session *s, int levels, u32 burst,
+			 struct scope_sample *smp, u32 nsmp, u32 *polls)
+{
+	struct uart_port *port = s->port;
+	u64 char_ns = probe_char_ns(s);
+	struct scope_sample cur;
+	ktime_t start, now, deadline, temt = 0;
+	bool kept = false;
+	u32 i, n = 0;
+
+	probe_loopback(s, UART_FCR_ENABLE_FIFO | UART_FCR_CLEAR_RCVR |
+			  UART_FCR_CLEAR_XMIT | s->probe_fcr);
+	probe_drain_rx(s);
+	if (levels == SCOPE_LEVELS_950)
+		probe_icr_write(port, UART_ACR, s->u8250p->acr | UART_ACR_ASREN);
+	port->serial_out(port, UART_IER, UART_IER_RDI | UART_IER_THRI);
+
+	start = ktime_get();
+	deadline = ktime_add_ms(start, SCOPE_TIME_MS);
+	for (i = 0; i < burst; i++)
+		port->serial_out(port, UART_TX, i & 0xff);
+	if (trace_uart_probe_fill_enabled())
+		trace_uart_probe_fill(s->dev, burst,
+				      port->serial_in(port, UART_LSR), s->t0);
+
+	*polls = 0;
+	for (;;) {
+		now = ktime_get();
+		scope_poll(port, levels, &cur);
+		++*polls;
+
+		kept = false;
+		if (!n || !scope_same(&cur, &smp[n - 1])) {
+			if (n == nsmp)
+				break;
+			cur.t_ns = ktime_to_ns(ktime_sub(now, start));
+			smp[n++] = cur;
+			kept = true;
+		}
+
+		if (scope_drain && !(cur.iir & UART_IIR_NO_INT) &&
+		    ((cur.iir & UART_IIR_ID) == UART_IIR_RDI ||
+		     (cur.iir & UART_IIR_ID) == UART_IIR_RX_TIMEOUT))
+			probe_drain_rx(s);
+
+		if (!temt && (cur.lsr & UART_LSR_TEMT))
+			temt = now;
+		if ((temt && ktime_after(now, ktime_add_ns(temt, SCOPE_TAIL_CHARS * char_ns))) ||
+		    ktime_after(now, deadline))
+			break;
+	}
+
+	/* mark where sampling stopped */
+	if (!kept && n < nsmp) {
+		cur.t_ns = ktime_to_ns(ktime_sub(now, start));
+		smp[n++] = cur;
+	}
+
+	if (levels == SCOPE_LEVELS_950)
+		probe_icr_write(port, UART_ACR, s->u8250p->acr);
+	return n;
+}
+
+static const char *scope_irq_name(u8 iir)
+{
+	if (iir & UART_IIR_NO_INT)
+		return "-";
+	switch (iir & UART_IIR_ID) {
+	case UART_IIR_MSI:		return "MSI";
+	case UART_IIR_THRI:		return "THRI";
+	case UART_IIR_RDI:		return "RDI";
+	case UART_IIR_RLSI:		return "RLSI";
+	case UART_IIR_RX_TIMEOUT:	return "TIMEOUT";
+	default:			return "?";
+	}
+}
+
+static const char *const scope_level_names[] = {
+	[SCOPE_LEVELS_NONE] = "none",
+	[SCOPE_LEVELS_950] = "16c950",
+	[SCOPE_LEVELS_EXAR] = "exar",
+};
+
+static size_t scope_vcd_bits(char *buf, size_t size, unsigned int v, int width,
+			     char id)
+{
+	char bits[17];
+	int i;
+
+	for (i = 0; i < width; i++)
+		bits[i] = v & (1U << (width - 1 - i)) ? '1' : '0';
+	bits[width] = '\0';
+	return scnprintf(buf, size, "b%s %c\n", bits, id);
+}
+
+/* Value changes against prev, or everything when prev is NULL */
+static size_t scope_vcd_sample(char *buf, size_t size, const struct scope_sample *smp,
+			       const struct scope_sample *prev, bool levels)
+{
+	static const struct { u8 bit; char id; } lsr_bits[] = {
+		{ UART_LSR_DR, 'd' }, { UART_LSR_OE, 'o' },
+		{ UART_LSR_THRE, 't' }, { UART_LSR_TEMT, 'e' },
+	};
+	size_t len;
+	int i;
+
+	len = scnprintf(buf, size, "#%u\n", smp->t_ns);
+	for (i = 0; i < ARRAY_SIZE(lsr_bits); i++)
+		if (!prev || (smp->lsr ^ prev->lsr) & lsr_bits[i].bit)
+			len += scnprintf(buf + len, size - len, "%d%c\n",
+					 !!(smp->lsr & lsr_bits[i].bit), lsr_bits[i].id);
+	if (!prev || (smp->iir ^ prev->iir) & UART_IIR_NO_INT)
+		len += scnprintf(buf + len, size - len, "%di\n",
+				 !(smp->iir & UART_IIR_NO_INT));
+	if (!prev || smp->lsr != prev->lsr)
+		len += scope_vcd_bits(buf + len, size - len, smp->lsr, 8, 'l');
+	if (!prev || smp->iir != prev->iir)
+		len += scope_vcd_bits(buf + len, size - len, smp->iir, 8, 'r');
+	if (levels && (!prev || smp->rfl != prev->rfl))
+		len += scope_vcd_bits(buf + len, size - len, smp->rfl, 9, 'R');
+	if (levels && (!prev || smp->tfl != prev->tfl))
+		len += scope_vcd_bits(buf + len, size - len, smp->tfl, 9, 'T');
+	return len;
+}
+
+static struct scope_buf *scope_format(enum scope_format fmt, const char *dev,
+				      const struct probe_session *s, int levels,
+				      u32 burst, const struct scope_sample *smp,
+				      u32 n, u32 nsmp, u32 polls)
 {
-    dir_entry = debugfs_create_dir("uart_probe", NULL);
-    if (!dir_entry)
-        return -ENOMEM;
+	size_t size = 1024 + (size_t)n * SCOPE_LINE_MAX, len = 0;
+	struct scope_buf *sb;
+	u32 i;
+
+	sb = kvmalloc(sizeof(*sb) + size, GFP_KERNEL);
+	if (!sb)
+		return NULL;
+
+	if (fmt == SCOPE_TEXT) {
+		len += scnprintf(sb->data + len, size - len,
+				 "# %s type=%u uartclk=%u divisor=%u fcr=%02x burst=%u levels=%s char_ns=%llu\n"
+				 "# polls=%u samples=%u%s\n"
+				 "# %10s LSR IIR  RFL  TFL irq\n",
+				 dev, s->port->type, s->port->uartclk, s->div,
+				 s->probe_fcr, burst, scope_level_names[levels],
+				 probe_char_ns(s), polls, n,
+				 n == nsmp ? " (buffer full)" : "", "t_ns");
+		for (i = 0; i < n; i++)
+			len += scnprintf(sb->data + len, size - len,
+					 "%12u  %02x  %02x %4d %4d %s\n",
+					 smp[i].t_ns, smp[i].lsr, smp[i].iir,
+					 smp[i].rfl, smp[i].tfl,
+					 scope_irq_name(smp[i].iir));
+	} else {
+		len += scnprintf(sb->data + len, size - len,
+				 "$comment %s burst=%u divisor=%u fcr=%02x polls=%u $end\n"
+				 "$timescale 1ns $end\n"
+				 "$scope module %s $end\n"
+				 "$var wire 1 d DR $end\n"
+				 "$var wire 1 o OE $end\n"
+				 "$var wire 1 t THRE $end\n"
+				 "$var wire 1 e TEMT $end\n"
+				 "$var wire 1 i INT $end\n"
+				 "$var wire 8 l LSR $end\n"
+				 "$var wire 8 r IIR $end\n",
+				 dev, burst, s->div, s->probe_fcr, polls, dev);
+		if (levels)
+			len += scnprintf(sb->data + len, size - len,
+					 "$var wire 9 R RFL $end\n"
+					 "$var wire 9 T TFL $end\n");
+		len += scnprintf(sb->data + len, size - len,
+				 "$upscope $end\n$enddefinitions $end\n");
+		for (i = 0; i < n; i++)
+			len += scope_vcd_sample(sb->data + len, size - len, &smp[i],
+						i ? &smp[i - 1] : NULL, levels);
+	}
 
-    dev_entry = debugfs_create_file("select_dev", 0666, dir_entry, NULL, &select_dev_fops);
-    tx_fifo_entry = debugfs_create_file("tx_fifo_size", 0444, dir_entry, NULL, &tx_fifo_fops);
-	tx_trig_entry = debugfs_create_file("tx_trig_level", 0444, dir_entry, NULL, &tx_trig_fops);
-	rx_fifo_entry = debugfs_create_file("rx_fifo_size", 0444, dir_entry, NULL, &rx_fifo_fops);
-    rx_trig_entry = debugfs_create_file("rx_trig_level", 0444, dir_entry, NULL, &rx_trig_fops);
+	sb->len = len;
+	return sb;
+}
+
+static int scope_open(struct file *file, enum scope_format fmt)
+{
+	struct scope_sample *smp;
+	struct probe_session s;
+	struct scope_buf *sb;
+	char dev[UART_PROBE_PORT_LEN];
+	u32 n, nsmp, burst, polls;
+	int levels, ret;
+
+	nsmp = clamp_t(u32, scope_samples, 16, SCOPE_SAMPLES_MAX);
+	smp = kvcalloc(nsmp, sizeof(*smp), GFP_KERNEL);
+	if (!smp)
+		return -ENOMEM;
+
+	strscpy(dev, selected_dev, sizeof(dev));
+	ret = probe_begin(&s, dev, UART_PROBE_SCOPE, NULL);
+	if (ret)
+		goto out;
+	s.div = clamp_t(u32, scope_divisor, 1, UART_PROBE_DIVISOR_MAX);
+	ret = probe_set_clock(&s, probe_sampling, probe_prescale);
+	if (ret) {
+		probe_end(&s, ret);
+		goto out;
+	}
+	burst = min_t(u32, scope_burst ?: s.port->fifosize ?: 16, FIFO_SIZE_MAX);
+	levels = scope_levels(s.port);
 
-    if (!dev_entry || !rx_fifo_entry || !rx_trig_entry) {
-        debugfs_remove_recursive(dir_entry);
-        return -ENOMEM;
-    }
+	n = scope_capture(&s, levels, burst, smp, nsmp, &polls);
+	probe_end(&s, n);
+
+	sb = scope_format(fmt, dev, &s, levels, burst, smp, n, nsmp, polls);
+	if (!sb) {
+		ret = -ENOMEM;
+		goto out;
+	}
+	file->private_data = sb;
+out:
+	kvfree(smp);
+	return ret;
+}
+
+static int scope_text_open(struct inode *inode, struct file *file)
+{
+	return scope_open(file, SCOPE_TEXT);
+}
+
+static int scope_vcd_open(struct inode *inode, struct file *file)
+{
+	return scope_open(file, SCOPE_VCD);
+}
+
+static ssize_t scope_read(struct file *file, char __user *buf,
+			  size_t count, loff_t *ppos)
+{
+	const struct scope_buf *sb = file->private_data;
+
+	return simple_read_from_buffer(buf, count, ppos, sb->data, sb->len);
+}
+
+static int scope_release(struct inode *inode, struct file *file)
+{
+	kvfree(file->private_data);
+	return 0;
+}
+
+static const struct file_operations scope_text_fops = {
+	.open = scope_text_open,
+	.read = scope_read,
+	.release = scope_release,
+	.llseek = default_llseek,
+};
+
+static const struct file_operations scope_vcd_fops = {
+	.open = scope_vcd_open,
+	.read = scope_read,
+	.release = scope_release,
+	.llseek = default_llseek,
+};
+
+/* uart_probe/clock_modes
+ * The sampling clocks the selected device has, what it was set to, the
+ * fastest rate each gives at divisor 1, and the rx and tx trigger levels
+ * measured at each. With fewer clocks per bit the probes sample FIFO
+ * state less often per character, so a level that moves against 16x is
+ * one the driver cannot count on at that rate.
+ */
+#define CLOCK_LINE_MAX		96
+
+/* A trigger level and how far it is from the one at 16x */
+static size_t clock_level(char *buf, size_t size, int level, int ref)
+{
+	if (level > 0 && ref > 0)
+		return scnprintf(buf, size, " %7d %+5d", level, level - ref);
+	return scnprintf(buf, size, " %7d %5s", level, "-");
+}
+
+static int clock_modes_open(struct inode *inode, struct file *file)
+{
+	struct probe_session s;
+	struct scope_buf *sb;
+	char dev[UART_PROBE_PORT_LEN];
+	int rx[17], tx[17], clock, i, ret;
+	size_t size = 512 + 17 * CLOCK_LINE_MAX, len = 0;
+
+	strscpy(dev, selected_dev, sizeof(dev));
+	ret = probe_begin(&s, dev, UART_PROBE_CLOCK, NULL);
+	if (ret)
+		return ret;
+	clock = probe_clock(s.port);
+	for (i = 16; i >= 4; i--) {
+		rx[i] = tx[i] = -EOPNOTSUPP;
+		if (probe_set_clock(&s, i, 0))
+			continue;
+		rx[i] = probe_rx_trig(&s);
+		tx[i] = probe_tx_trig(&s);
+	}
+	probe_set_clock(&s, 16, 0);
+	probe_end(&s, 0);
+
+	sb = kvmalloc(sizeof(*sb) + size, GFP_KERNEL);
+	if (!sb)
+		return -ENOMEM;
+	len += scnprintf(sb->data + len, size - len,
+			 "# %s type=%u uartclk=%u fcr=%02x\nclock: %s\n",
+			 dev, s.port->type, s.port->uartclk, s.probe_fcr,
+			 probe_clock_names[clock]);
+	if (clock == PROBE_CLOCK_950)
+		len += scnprintf(sb->data + len, size - len,
+				 "tcr: 0x%02x\ncpr: 0x%02x, prescaler %s\n", s.clk, s.cpr,
+				 s.mcr & UART_MCR_CLKSEL ? "on" : "off");
+	else if (clock == PROBE_CLOCK_XR)
+		len += scnprintf(sb->data + len, size - len, "dld: 0x%02x\n", s.clk);
+	len += scnprintf(sb->data + len, size - len, "# %3s %9s %8s %7s %5s %7s %5s\n",
+			 "clk", "baud", "char_ns", "rx_trig", "vs16", "tx_trig", "vs16");
+	for (i = 16; i >= 4; i--) {
+		if (rx[i] == -EOPNOTSUPP)
+			continue;
+		s.sampling = i;
+		len += scnprintf(sb->data + len, size - len, "%4ux %9u %8llu",
+				 i, s.port->uartclk / i, probe_char_ns(&s));
+		len += clock_level(sb->data + len, size - len, rx[i], rx[16]);
+		len += clock_level(sb->data + len, size - len, tx[i], tx[16]);
+		len += scnprintf(sb->data + len, size - len, "\n");
+	}
+	sb->len = len;
+	file->private_data = sb;
+	return 0;
+}
+
+static const struct file_operations clock_modes_fops = {
+	.open = clock_modes_open,
+	.read = scope_read,
+	.release = scope_release,
+	.llseek = default_llseek,
+};
+
+/* uart_probe/max_baud
+ * Fastest clock setting the selected device runs without errors. Steps
+ * through every (sampling clock, divisor) pair from the highest rate down,
+ * streams prbs_bytes of PRBS-15 (x^15 + x^14 + 1) at each in loopback and
+ * stops at the first one with no bit, framing or overrun errors and no
+ * lost bytes. Divisor 1 at 16x sampling is as fast as a plain 8250 goes;
+ * the faster sampling clocks of probe_set_clock() add rates above that.
+ *
+ * In internal loopback the line itself cannot corrupt anything, so what
+ * fails is the host keeping up: FIFO service over the bus at that rate.
+ * With prbs_external set the port runs with loopback off, for a plug or a
+ * cable to a second port wired back.
+ *
+ * The checker is self-synchronising: it predicts each bit from the 15
+ * before it, so one corrupted bit counts up to three times and the first
+ * two bytes are not checked.
+ */
+#define BAUD_DIV_MAX		256
+#define BAUD_BYTES_MAX		(1 << 20)
+#define BAUD_TIME_MS		2000	/* per step, fewer bytes at slow rates */
+#define BAUD_QUIET_CHARS	16	/* after the last byte, give up on the rest */
+#define BAUD_SYNC_BYTES		2
+#define BAUD_LINE_MAX		128
+#define BAUD_SEARCH_MS_MAX	600000
+
+static u32 prbs_bytes = 4096;
+static u32 prbs_max_div = 16;
+static u32 prbs_time_ms = 30000;	/* whole search, checked between steps */
+static bool prbs_external;
+
+/* the register that sets a sampling clock other than 16x */
+static const char *const baud_clock_regs[] = {
+	[PROBE_CLOCK_16X] = "-",
+	[PROBE_CLOCK_950] = "tcr",
+	[PROBE_CLOCK_XR] = "dld",
+};
+
+struct baud_step {
+	u32 baud;
+	u16 div;
+	u8 sampling;			/* clocks per bit */
+	/* out */
+	u32 bytes, sent, received;
+	u32 bit_errors, frame_errors, overruns;
+	u64 ns;
+};
+
+static int baud_step_cmp(const void *a, const void *b)
+{
+	const struct baud_step *x = a, *y = b;
+
+	/* fastest first, and for the same rate the most clocks per bit */
+	if (x->baud != y->baud)
+		return x->baud < y->baud ? 1 : -1;
+	return y->sampling - x->sampling;
+}
+
+/* Every clock setting the chip has, sorted fastest first, one per rate */
+static int baud_steps(struct probe_session *s, u32 max_div, struct baud_step **stepsp)
+{
+	u8 sampling[16];
+	struct baud_step *steps;
+	int nmodes = 0, n = 0, i, j;
+	u32 div;
+
+	for (i = 16; i >= 4; i--)
+		if (!probe_set_clock(s, i, 0))
+			sampling[nmodes++] = i;
+	probe_set_clock(s, 16, 0);
+
+	steps = kvcalloc(nmodes * max_div, sizeof(*steps), GFP_KERNEL);
+	if (!steps)
+		return -ENOMEM;
+	for (i = 0; i < nmodes; i++) {
+		for (div = 1; div <= max_div; div++, n++) {
+			steps[n].baud = s->port->uartclk / (sampling[i] * div);
+			steps[n].div = div;
+			steps[n].sampling = sampling[i];
+		}
+	}
+	sort(steps, n, sizeof(*steps), baud_step_cmp, NULL);
+
+	for (i = 0, j = 0; i < n; i++)
+		if (!j || steps[i].baud != steps[j - 1].baud)
+			steps[j++] = steps[i];
+	*stepsp = steps;
+	return j;
+}
+
+static u8 prbs15_byte(u16 *state)
+{
+	u8 byte = 0;
+	int i;
+
+	for (i = 0; i < 8; i++) {
+		u16 bit = ((*state >> 14) ^ (*state >> 13)) & 1;
+
+		*state = ((*state << 1) | bit) & 0x7fff;
+		byte |= bit << i;		/* LSB goes out first */
+	}
+	return byte;
+}
+
+/* Bits in byte that do not follow from the 15 received before them */
+static u32 prbs15_check(u16 *history, u8 byte, bool synced)
+{
+	u32 errors = 0;
+	int i;
+
+	for (i = 0; i < 8; i++) {
+		u16 bit = (byte >> i) & 1;
+
+		if (synced && bit != (((*history >> 14) ^ (*history >> 13)) & 1))
+			errors++;
+		*history = ((*history << 1) | bit) & 0x7fff;
+	}
+	return errors;
+}
+
+static void baud_run(struct probe_session *s, struct baud_step *st, u32 bytes)
+{
+	struct uart_port *port = s->port;
+	u8 fcr = UART_FCR_ENABLE_FIFO | UART_FCR_CLEAR_RCVR | UART_FCR_CLEAR_XMIT |
+		 s->probe_fcr;
+	u16 tx_state = 0x7fff, rx_history = 0;
+	unsigned int loadsz = s->u8250p->tx_loadsz ?: port->fifosize ?: 1;
+	ktime_t start, now, last, deadline;
+	u32 polls = 0;
+	u64 char_ns;
+	u8 lsr;
+	int n;
+
+	probe_set_clock(s, st->sampling, 0);
+	s->div = st->div;
+	char_ns = probe_char_ns(s);
+	st->bytes = clamp_t(u64, div64_u64((u64)BAUD_TIME_MS * NSEC_PER_MSEC, char_ns ?: 1),
+			    BAUD_SYNC_BYTES + 1, bytes);
+
+	probe_loopback(s, fcr);
+	if (prbs_external)
+		port->serial_out(port, UART_MCR,
+				 port->serial_in(port, UART_MCR) & ~UART_MCR_LOOP);
+	probe_drain_rx(s);
+
+	start = last = now = ktime_get();
+	deadline = ktime_add_ms(start, BAUD_TIME_MS + 100);
+	do {
+		lsr = port->serial_in(port, UART_LSR);
+		if ((lsr & UART_LSR_THRE) && st->sent < st->bytes) {
+			for (n = 0; n < loadsz && st->sent < st->bytes; n++, st->sent++)
+				port->serial_out(port, UART_TX, prbs15_byte(&tx_state));
+		}
+		while (lsr & UART_LSR_DR) {
+			u8 c = port->serial_in(port, UART_RX);
+
+			if (lsr & (UART_LSR_FE | UART_LSR_BI))
+				st->frame_errors++;
+			if (lsr & UART_LSR_OE)
+				st->overruns++;
+			st->bit_errors += prbs15_check(&rx_history, c,
+						       st->received >= BAUD_SYNC_BYTES);
+			st->received++;
+			last = ktime_get();
+			lsr = port->serial_in(port, UART_LSR);
+		}
+		if (lsr & UART_LSR_OE)
+			st->overruns++;
+		now = ktime_get();
+		if (st->sent == st->bytes && (lsr & UART_LSR_TEMT) &&
+		    ktime_to_ns(ktime_sub(now, last)) > BAUD_QUIET_CHARS * char_ns)
+			break;
+		if (!(++polls & 1023))
+			cond_resched();
+	} while (st->received < st->bytes && ktime_before(now, deadline));
+
+	st->ns = ktime_to_ns(ktime_sub(last, start));
+	trace_uart_probe_fill(s->dev, st->sent, lsr, s->t0);
+	trace_uart_probe_drain(s->dev, st->received, lsr, s->t0);
+}
+
+static bool baud_clean(const struct baud_step *st)
+{
+	return st->received == st->bytes && !st->bit_errors &&
+	       !st->frame_errors && !st->overruns;
+}
+
+static int max_baud_open(struct inode *inode, struct file *file)
+{
+	struct baud_step *steps = NULL, *st;
+	struct probe_session s;
+	struct scope_buf *sb;
+	char dev[UART_PROBE_PORT_LEN];
+	u32 bytes, max_div;
+	ktime_t search_end;
+	size_t size, len = 0;
+	int n, i, ret, found = -1;
+
+	strscpy(dev, selected_dev, sizeof(dev));
+	bytes = clamp_t(u32, prbs_bytes, BAUD_SYNC_BYTES + 1, BAUD_BYTES_MAX);
+	max_div = clamp_t(u32, prbs_max_div, 1, BAUD_DIV_MAX);
+
+	ret = probe_begin(&s, dev, UART_PROBE_BAUD, NULL);
+	if (ret)
+		return ret;
+	if (!s.port->uartclk) {
+		probe_end(&s, -EINVAL);
+		return -EINVAL;
+	}
+	n = baud_steps(&s, max_div, &steps);
+	if (n < 0) {
+		probe_end(&s, n);
+		return n;
+	}
+
+	search_end = ktime_add_ms(ktime_get(),
+				  clamp_t(u32, prbs_time_ms, BAUD_TIME_MS, BAUD_SEARCH_MS_MAX));
+	for (i = 0; i < n && found < 0; i++) {
+		if (fatal_signal_pending(current) ||
+		    (i && ktime_after(ktime_get(), search_end)))
+			break;
+		cond_resched();
+		baud_run(&s, &steps[i], bytes);
+		if (baud_clean(&steps[i]))
+			found = i;
+	}
+	probe_end(&s, found < 0 ? -EIO : steps[found].baud);
+	n = i;
+
+	size = 512 + (size_t)n * BAUD_LINE_MAX;
+	sb = kvmalloc(sizeof(*sb) + size, GFP_KERNEL);
+	if (!sb) {
+		kvfree(steps);
+		return -ENOMEM;
+	}
+	len += scnprintf(sb->data + len, size - len,
+			 "# %s type=%u uartclk=%u fcr=%02x bytes=%u %s\n"
+			 "# %9s %4s %4s %5s %8s %8s %8s %6s %6s %4s %10s\n",
+			 dev, s.port->type, s.port->uartclk, s.probe_fcr, bytes,
+			 prbs_external ? "external" : "loopback",
+			 "baud", "clk", "reg", "div", "bytes", "received", "bit_err",
+			 "frame", "overr", "lost", "bytes/s");
+	for (i = 0; i < n; i++) {
+		st = &steps[i];
+		len += scnprintf(sb->data + len, size - len,
+				 "%11u %3ux %4s %5u %8u %8u %8u %6u %6u %4u %10llu\n",
+				 st->baud, st->sampling,
+				 baud_clock_regs[st->sampling == 16 ? PROBE_CLOCK_16X : probe_clock(s.port)],
+				 st->div, st->bytes, st->received, st->bit_errors,
+				 st->frame_errors, st->overruns,
+				 st->sent - min(st->received, st->sent),
+				 st->ns ? div64_u64((u64)st->received * NSEC_PER_SEC, st->ns) : 0);
+	}
+	if (found < 0)
+		len += scnprintf(sb->data + len, size - len, "max_baud: none\n");
+	else
+		len += scnprintf(sb->data + len, size - len,
+				 "max_baud: %u (divisor %u, %u clocks per bit)\n",
+				 steps[found].baud, steps[found].div, steps[found].sampling);
+	sb->len = len;
+	file->private_data = sb;
+	kvfree(steps);
+	return 0;
+}
+
+static const struct file_operations max_baud_fops = {
+	.open = max_baud_open,
+	.read = scope_read,
+	.release = scope_release,
+	.llseek = default_llseek,
+};
+
+/* uart_probe/irq_timing
+ * Write 1 to time the 8250 interrupt path with kretprobes, 0 to stop.
+ * Writing 1 again clears the counters. Read for one row per interrupt
+ * line ("irqN", the chain on that line) and per port ("ttySN").
+ *
+ * serial8250_interrupt() runs once per interrupt on a line and walks every
+ * port on it, calling serial8250_handle_irq() through port->handle_irq,
+ * until a whole pass finds nothing to do. On a multiport card that shares
+ * one line, the handler calls that find their port idle, plus what the
+ * chain call spends outside any handler, is the cost of the sharing.
+ * The kretprobes add their own overhead to every row, so compare runs
+ * with each other rather than taking the numbers as absolute.
+ */
+#define IRQ_TIMING_LINES	64
+#define IRQ_TIMING_CHAINS	16
+
+struct irq_time {
+	atomic64_t calls;
+	atomic64_t handled;
+	atomic64_t ns;
+	atomic64_t idle_ns;		/* in calls that handled nothing */
+};
+
+struct irq_timing_data {
+	u64 t;
+	int irq;
+	struct uart_port *port;
+};
+
+/* one per interrupt line seen, irq is -1 while the slot is free */
+struct irq_chain_time {
+	atomic_t irq;
+	struct irq_time time;
+};
+
+static struct irq_chain_time irq_chains[IRQ_TIMING_CHAINS];
+static struct irq_time irq_ports[IRQ_TIMING_LINES];
+static DEFINE_MUTEX(irq_timing_lock);
+static bool irq_timing_on;
+
+static void irq_time_add(struct irq_time *it, u64 ns, bool handled)
+{
+	atomic64_inc(&it->calls);
+	atomic64_add(ns, &it->ns);
+	if (handled)
+		atomic64_inc(&it->handled);
+	else
+		atomic64_add(ns, &it->idle_ns);
+}
+
+/* The slot for irq, claiming a free one the first time; NULL when full. */
+static struct irq_time *irq_chain_time(int irq)
+{
+	int i, cur;
+
+	for (i = 0; i < IRQ_TIMING_CHAINS; i++) {
+		cur = atomic_read(&irq_chains[i].irq);
+		if (cur == -1)
+			cur = atomic_cmpxchg(&irq_chains[i].irq, -1, irq);
+		if (cur == -1 || cur == irq)
+			return &irq_chains[i].time;
+	}
+	return NULL;
+}
+
+static int irq_chain_entry(struct kretprobe_instance *ri, struct pt_regs *regs)
+{
+	struct irq_timing_data *d = (struct irq_timing_data *)ri->data;
+
+	d->irq = (int)regs_get_kernel_argument(regs, 0);
+	d->t = ktime_get_ns();
+	return 0;
+}
+
+static int irq_chain_ret(struct kretprobe_instance *ri, struct pt_regs *regs)
+{
+	struct irq_timing_data *d = (struct irq_timing_data *)ri->data;
+	struct irq_time *it = irq_chain_time(d->irq);
+
+	if (it)
+		irq_time_add(it, ktime_get_ns() - d->t,
+			     regs_return_value(regs) == IRQ_HANDLED);
+	return 0;
+}
+
+static int irq_port_entry(struct kretprobe_instance *ri, struct pt_regs *regs)
+{
+	struct irq_timing_data *d = (struct irq_timing_data *)ri->data;
+
+	d->port = (struct uart_port *)regs_get_kernel_argument(regs, 0);
+	d->t = ktime_get_ns();
+	return 0;
+}
+
+static int irq_port_ret(struct kretprobe_instance *ri, struct pt_regs *regs)
+{
+	struct irq_timing_data *d = (struct irq_timing_data *)ri->data;
+
+	if (d->port->line < IRQ_TIMING_LINES)
+		irq_time_add(&irq_ports[d->port->line], ktime_get_ns() - d->t,
+			     regs_return_value(regs));
+	return 0;
+}
+
+static struct kretprobe irq_chain_probe = {
+	.kp.symbol_name = "serial8250_interrupt",
+	.entry_handler = irq_chain_entry,
+	.handler = irq_chain_ret,
+	.data_size = sizeof(struct irq_timing_data),
+	.maxactive = 64,
+};
+
+static struct kretprobe irq_port_probe = {
+	.kp.symbol_name = "serial8250_handle_irq",
+	.entry_handler = irq_port_entry,
+	.handler = irq_port_ret,
+	.data_size = sizeof(struct irq_timing_data),
+	.maxactive = 64,
+};
+
+static void irq_time_reset(struct irq_time *it)
+{
+	atomic64_set(&it->calls, 0);
+	atomic64_set(&it->handled, 0);
+	atomic64_set(&it->ns, 0);
+	atomic64_set(&it->idle_ns, 0);
+}
+
+/*
+ * register_kretprobe() fills in kp.addr and kp.flags and refuses a kprobe
+ * that already has them, so clear what the last registration left behind.
+ */
+static int irq_timing_register(struct kretprobe *rp)
+{
+	rp->kp.addr = NULL;
+	rp->kp.flags = 0;
+	rp->nmissed = 0;
+	return register_kretprobe(rp);
+}
+
+static int irq_timing_set(bool on)
+{
+	int i, ret = 0;
+
+	mutex_lock(&irq_timing_lock);
+	if (on) {
+		for (i = 0; i < IRQ_TIMING_CHAINS; i++) {
+			irq_time_reset(&irq_chains[i].time);
+			atomic_set(&irq_chains[i].irq, -1);
+		}
+		for (i = 0; i < IRQ_TIMING_LINES; i++)
+			irq_time_reset(&irq_ports[i]);
+	}
+	if (on == irq_timing_on)
+		goto out;
+
+	if (on) {
+		ret = irq_timing_register(&irq_chain_probe);
+		if (ret) {
+			pr_err("uart_probe: cannot probe serial8250_interrupt: %d\n", ret);
+			goto out;
+		}
+		ret = irq_timing_register(&irq_port_probe);
+		if (ret) {
+			pr_err("uart_probe: cannot probe serial8250_handle_irq: %d\n", ret);
+			unregister_kretprobe(&irq_chain_probe);
+			goto out;
+		}
+	} else {
+		unregister_kretprobe(&irq_port_probe);
+		unregister_kretprobe(&irq_chain_probe);
+	}
+	irq_timing_on = on;
+out:
+	mutex_unlock(&irq_timing_lock);
+	return ret;
+}
+
+static ssize_t irq_timing_write(struct file *file, const char __user *buf,
+				size_t count, loff_t *ppos)
+{
+	bool on;
+	int ret;
+
+	ret = kstrtobool_from_user(buf, count, &on);
+	if (ret)
+		return ret;
+
+	ret = irq_timing_set(on);
+	return ret ? ret : count;
+}
+
+static void irq_time_show(struct seq_file *m, const char *name, struct irq_time *it)
+{
+	seq_printf(m, "%-8s %12lld %12lld %14lld %14lld\n", name,
+		   atomic64_read(&it->calls), atomic64_read(&it->handled),
+		   atomic64_read(&it->ns), atomic64_read(&it->idle_ns));
+}
+
+static int irq_timing_show(struct seq_file *m, void *v)
+{
+	char name[16];
+	int i;
+
+	mutex_lock(&irq_timing_lock);
+	seq_printf(m, "# %s, missed %d/%d\n", irq_timing_on ? "on" : "off",
+		   irq_chain_probe.nmissed, irq_port_probe.nmissed);
+	seq_printf(m, "# %-6s %12s %12s %14s %14s\n",
+		   "what", "calls", "handled", "ns", "idle_ns");
+	for (i = 0; i < IRQ_TIMING_CHAINS; i++) {
+		if (!atomic64_read(&irq_chains[i].time.calls))
+			continue;
+		snprintf(name, sizeof(name), "irq%d", atomic_read(&irq_chains[i].irq));
+		irq_time_show(m, name, &irq_chains[i].time);
+	}
+	for (i = 0; i < IRQ_TIMING_LINES; i++) {
+		if (!atomic64_read(&irq_ports[i].calls))
+			continue;
+		snprintf(name, sizeof(name), "ttyS%d", i);
+		irq_time_show(m, name, &irq_ports[i]);
+	}
+	mutex_unlock(&irq_timing_lock);
+	return 0;
+}
+
+static int irq_timing_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, irq_timing_show, NULL);
+}
+
+static const struct file_operations irq_timing_fops = {
+	.open = irq_timing_open,
+	.read = seq_read,
+	.write = irq_timing_write,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+/*
+ * boot_probe=1 runs every probe on every idle 8250 port once, in the
+ * background, right after load. Ports are probed in parallel, one async
+ * entry per port, in a domain of our own so that neither module_init nor
+ * modprobe waits for them. uart_probe/boot_results blocks until they
+ * are done. A port opened while its probes run fails the remaining
+ * probes with -EBUSY; the kernel console port is skipped.
+ */
+#define BOOT_PROBE_LINES	64
+
+static bool boot_probe;
+module_param(boot_probe, bool, 0444);
+MODULE_PARM_DESC(boot_probe, "Probe every idle 8250 port in the background at load");
+
+static ASYNC_DOMAIN_EXCLUSIVE(boot_domain);
+
+struct boot_port {
+	char dev[UART_PROBE_PORT_LEN];
+	struct uart_probe_result res[UART_PROBE_COUNT];
+};
+
+static struct boot_port boot_ports[BOOT_PROBE_LINES];
+static int boot_nports;
+
+static void boot_probe_port(void *data, async_cookie_t cookie)
+{
+	struct boot_port *bp = data;
+	struct uart_probe_cmd cmd = {};
+	char line[192];
+	int i, len;
+
+	strscpy(cmd.port, bp->dev, sizeof(cmd.port));
+	len = scnprintf(line, sizeof(line), "%s", bp->dev);
+	for (i = 0; i < UART_PROBE_COUNT; i++) {
+		cmd.probe = i;
+		probe_run(&cmd, &bp->res[i], NULL);
+		len += scnprintf(line + len, sizeof(line) - len, " %s=%d",
+				 probes[i].name, bp->res[i].value);
+	}
+	scnprintf(line + len, sizeof(line) - len, " chip=%s",
+		  probe_chip_names[bp->res[0].chip]);
+
+	pr_info("uart_probe: %s\n", line);
+}
+
+/* The 8250 tty driver: any ttyS line that answers gives it to us, with a reference */
+static struct tty_driver *probe_tty_driver(void)
+{
+	struct tty_driver *driver = NULL;
+	char name[UART_PROBE_PORT_LEN];
+	int i, line;
+
+	for (i = 0; i < BOOT_PROBE_LINES && !driver; i++) {
+		snprintf(name, sizeof(name), "ttyS%d", i);
+		driver = tty_find_polling_driver(name, &line);
+	}
+	return driver;
+}
+
+/* Queue every registered ttyS line with a known UART behind it */
+static void boot_probe_start(void)
+{
+	struct tty_driver *driver = probe_tty_driver();
+	int i;
+
+	if (!driver) {
+		pr_info("uart_probe: boot_probe: no 8250 ports\n");
+		return;
+	}
+
+	for (i = 0; i < driver->num && boot_nports < BOOT_PROBE_LINES; i++) {
+		struct boot_port *bp;
+		struct uart_port *port;
+
+		if (!driver->ports[i])
+			continue;
+		port = container_of(driver->ports[i], struct uart_state, port)->uart_port;
+		if (!port || port->type == PORT_UNKNOWN || uart_console(port))
+			continue;
+
+		bp = &boot_ports[boot_nports++];
+		snprintf(bp->dev, sizeof(bp->dev), "%s%d", driver->name,
+			 driver->name_base + i);
+		async_schedule_domain(boot_probe_port, bp, &boot_domain);
+	}
+	tty_driver_kref_put(driver);
+	pr_info("uart_probe: boot_probe: probing %d ports\n", boot_nports);
+}
+
+/* uart_probe/boot_results
+ * One line per port probed at load, values in bytes or -errno, then
+ * the chip the fingerprint found.
+ * Waits for the boot probes to finish.
+ */
+static int boot_results_show(struct seq_file *m, void *v)
+{
+	int i, j;
+
+	async_synchronize_full_domain(&boot_domain);
+
+	for (i = 0; i < boot_nports; i++) {
+		seq_printf(m, "%s", boot_ports[i].dev);
+		for (j = 0; j < UART_PROBE_COUNT; j++)
+			seq_printf(m, " %s=%d", probes[j].name,
+				   boot_ports[i].res[j].value);
+		seq_printf(m, " chip=%s\n", probe_chip_names[boot_ports[i].res[0].chip]);
+	}
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(boot_results);
+
+/* uart_probe/ports/<tty>/
+ * The probe files and fingerprint once more for each 8250 line with a
+ * known UART at load, bound to that line instead of select_dev. Each
+ * read is its own session under that port's mutex, so different ports
+ * can be probed at the same time.
+ */
+struct port_probe {
+	const char *dev;
+	const struct probe_desc *pd;
+};
+
+static char port_devs[BOOT_PROBE_LINES][UART_PROBE_PORT_LEN];
+static struct port_probe port_probes[BOOT_PROBE_LINES][UART_PROBE_COUNT];
+
+static ssize_t port_probe_read(struct file *file, char __user *buf,
+			       size_t count, loff_t *ppos)
+{
+	const struct port_probe *pp = file->private_data;
+
+	return probe_show(pp->dev, pp->pd, buf, count, ppos);
+}
+
+static const struct file_operations port_probe_fops = {
+	.open = simple_open,
+	.read = port_probe_read,
+	.llseek = default_llseek,
+};
+
+static void ports_create(struct dentry *parent)
+{
+	struct tty_driver *driver = probe_tty_driver();
+	struct dentry *ports, *dir;
+	int i, k, n = 0;
+
+	if (!driver)
+		return;
+	ports = debugfs_create_dir("ports", parent);
+
+	for (i = 0; i < driver->num && n < BOOT_PROBE_LINES; i++) {
+		struct uart_port *port;
+
+		if (!driver->ports[i])
+			continue;
+		port = container_of(driver->ports[i], struct uart_state, port)->uart_port;
+		if (!port || port->type == PORT_UNKNOWN)
+			continue;
+
+		snprintf(port_devs[n], sizeof(port_devs[n]), "%s%d", driver->name,
+			 driver->name_base + i);
+		dir = debugfs_create_dir(port_devs[n], ports);
+		for (k = 0; k < UART_PROBE_COUNT; k++) {
+			port_probes[n][k].dev = port_devs[n];
+			port_probes[n][k].pd = &probes[k];
+			debugfs_create_file(probes[k].name, 0444, dir,
+					    &port_probes[n][k], &port_probe_fops);
+		}
+		debugfs_create_file("fingerprint", 0444, dir, port_devs[n],
+				    &fingerprint_fops);
+		n++;
+	}
+	tty_driver_kref_put(driver);
+}
+
+static long probe_batch(struct file *file, struct uart_probe_batch __user *ubatch)
+{
+	struct uart_probe_batch batch;
+	struct uart_probe_cmd *cmds;
+	struct uart_probe_result *results;
+	long done = 0;
+	u32 i;
+
+	if (copy_from_user(&batch, ubatch, sizeof(batch)))
+		return -EFAULT;
+	if (batch.flags || !batch.count || batch.count > UART_PROBE_BATCH_MAX)
+		return -EINVAL;
+
+	cmds = memdup_user(u64_to_user_ptr(batch.cmds),
+			   array_size(batch.count, sizeof(*cmds)));
+	if (IS_ERR(cmds))
+		return PTR_ERR(cmds);
+	results = kcalloc(batch.count, sizeof(*results), GFP_KERNEL);
+	if (!results) {
+		kfree(cmds);
+		return -ENOMEM;
+	}
+
+	for (i = 0; i < batch.count; i++) {
+		if (signal_pending(current))
+			break;
+		probe_run(&cmds[i], &results[i], file);
+		done++;
+	}
+
+	if (done && copy_to_user(u64_to_user_ptr(batch.results), results,
+				 done * sizeof(*results)))
+		done = -EFAULT;
+	else if (!done)
+		done = -ERESTARTSYS;
+
+	kfree(results);
+	kfree(cmds);
+	return done;
+}
+
+static int prog_validate(const struct uart_probe_op *ops, u32 nops)
+{
+	u32 pc;
+
+	for (pc = 0; pc < nops; pc++) {
+		const struct uart_probe_op *op = &ops[pc];
+
+		if (op->op >= UART_PROBE_OP_COUNT || op->reg > UART_SCR)
+			return -EINVAL;
+		if (op->op == UART_PROBE_OP_LOOP && op->target >= pc)
+			return -EINVAL;
+	}
+	return 0;
+}
+
+/*
+ * Wait ns, cut short at the program deadline. Only waits under 10 us
+ * spin; longer ones sleep, so a program does not hold the CPU for up to
+ * UART_PROBE_PROG_TIME_MS while it has tport->mutex.
+ */
+static void prog_delay(u64 ns, ktime_t deadline)
+{
+	s64 left = ktime_to_ns(ktime_sub(deadline, ktime_get()));
+	unsigned long us;
+
+	if (left <= 0)
+		return;
+	ns = min_t(u64, ns, left);
+	if (ns < 10 * NSEC_PER_USEC) {
+		ndelay(ns);
+	} else if (ns < 20 * NSEC_PER_MSEC) {
+		us = div_u64(ns, NSEC_PER_USEC);
+		usleep_range(us, us + us / 8);
+	} else {
+		msleep(div_u64(ns, NSEC_PER_MSEC));
+	}
+}
+
+/*
+ * Run a validated program on an open session. Every op that samples
+ * appends to smp; running out of room, steps or time stops the program
+ * with a status, the samples taken so far are still returned.
+ */
+static int prog_exec(struct probe_session *s, const struct uart_probe_op *ops,
+		     u32 nops, u16 *loops, struct uart_probe_sample *smp,
+		     u32 nsmp, u32 *used, u32 *steps)
+{
+	struct uart_port *port = s->port;
+	ktime_t deadline = ktime_add_ms(s->t0, UART_PROBE_PROG_TIME_MS);
+	u64 char_ns = probe_char_ns(s);
+	u32 pc = 0;
+	int status = 0;
+
+	*used = 0;
+	*steps = 0;
+	while (pc < nops) {
+		const struct uart_probe_op *op = &ops[pc];
+		u8 value = 0, flags = 0;
+		bool sample = false;
+
+		if (++*steps > UART_PROBE_PROG_STEPS_MAX) {
+			status = -E2BIG;
+			break;
+		}
+		if (!(*steps & 1023)) {
+			if (ktime_after(ktime_get(), deadline)) {
+				status = -ETIME;
+				break;
+			}
+			if (fatal_signal_pending(current)) {
+				status = -EINTR;
+				break;
+			}
+			cond_resched();
+		}
+
+		switch (op->op) {
+		case UART_PROBE_OP_READ:
+			value = port->serial_in(port, op->reg);
+			sample = true;
+			break;
+		case UART_PROBE_OP_WRITE:
+			port->serial_out(port, op->reg, op->value);
+			value = op->value;
+			break;
+		case UART_PROBE_OP_WAIT: {
+			ktime_t end = ktime_add_ns(ktime_get(), op->arg * char_ns);
+
+			if (ktime_after(end, deadline))
+				end = deadline;
+			for (;;) {
+				value = port->serial_in(port, op->reg);
+				if ((value & op->mask) == op->value)
+					break;
+				if (ktime_after(ktime_get(), end)) {
+					flags |= UART_PROBE_S_TIMEOUT;
+					break;
+				}
+				cpu_relax();
+				cond_resched();
+			}
+			sample = true;
+			break;
+		}
+		case UART_PROBE_OP_DELAY:
+			prog_delay(op->arg * char_ns, deadline);
+			break;
+		case UART_PROBE_OP_TIME:
+			sample = true;
+			break;
+		case UART_PROBE_OP_LOOP:
+			if (loops[pc] < op->arg) {
+				loops[pc]++;
+				pc = op->target;
+				continue;
+			}
+			/* reset, so an enclosing loop runs this one again in full */
+			loops[pc] = 0;
+			break;
+		}
+
+		if (op->op != UART_PROBE_OP_LOOP && op->op != UART_PROBE_OP_DELAY)
+			trace_uart_probe_op(s->dev, pc, op->op, op->reg, value, s->t0);
+
+		if (sample) {
+			if (*used >= nsmp) {
+				status = -ENOSPC;
+				break;
+			}
+			smp[*used].t_ns = ktime_to_ns(ktime_sub(ktime_get(), s->t0));
+			smp[*used].pc = pc;
+			smp[*used].value = value;
+			smp[*used].flags = flags;
+			smp[*used].reserved = 0;
+			++*used;
+		}
+		pc++;
+	}
+
+	return status;
+}
+
+static long probe_prog(struct file *file, struct uart_probe_prog __user *uprog)
+{
+	struct uart_probe_prog prog;
+	struct uart_probe_op *ops;
+	struct uart_probe_sample *smp;
+	struct probe_session s;
+	char dev[UART_PROBE_PORT_LEN];
+	u32 used = 0, steps = 0;
+	u16 *loops;
+	int ret;
+
+	if (copy_from_user(&prog, uprog, sizeof(prog)))
+		return -EFAULT;
+	if (!prog.nops || prog.nops > UART_PROBE_PROG_OPS_MAX ||
+	    prog.nsamples > UART_PROBE_PROG_SAMPLES_MAX ||
+	    prog.flags & ~(UART_PROBE_F_DIVISOR | UART_PROBE_F_FCR |
+			   UART_PROBE_F_SAMPLING | UART_PROBE_F_LOOPBACK) ||
+	    ((prog.flags & UART_PROBE_F_DIVISOR) &&
+	     (!prog.divisor || prog.divisor > UART_PROBE_DIVISOR_MAX)))
+		return -EINVAL;
+
+	ops = memdup_user(u64_to_user_ptr(prog.ops),
+			  array_size(prog.nops, sizeof(*ops)));
+	if (IS_ERR(ops))
+		return PTR_ERR(ops);
+	ret = prog_validate(ops, prog.nops);
+	if (ret)
+		goto out_ops;
+
+	loops = kcalloc(prog.nops, sizeof(*loops), GFP_KERNEL);
+	smp = kvcalloc(prog.nsamples ?: 1, sizeof(*smp), GFP_KERNEL);
+	if (!loops || !smp) {
+		ret = -ENOMEM;
+		goto out_smp;
+	}
+
+	strscpy(dev, prog.port, sizeof(dev));
+	ret = probe_begin(&s, dev, UART_PROBE_PROGRAM, file);
+	if (ret)
+		goto out_smp;
+	if (prog.flags & UART_PROBE_F_DIVISOR)
+		s.div = prog.divisor;
+	if (prog.flags & UART_PROBE_F_FCR)
+		s.probe_fcr = prog.fcr;
+	if (prog.flags & UART_PROBE_F_SAMPLING) {
+		ret = probe_set_clock(&s, prog.sampling, 0);
+		if (ret) {
+			probe_end(&s, ret);
+			goto out_smp;
+		}
+	}
+	if (prog.flags & UART_PROBE_F_LOOPBACK)
+		probe_loopback(&s, s.probe_fcr);
+
+	prog.status = prog_exec(&s, ops, prog.nops, loops, smp, prog.nsamples,
+				&used, &steps);
+	probe_end(&s, prog.status);
+
+	prog.samples_used = used;
+	prog.steps = steps;
+	prog.duration_ns = ktime_to_ns(ktime_sub(ktime_get(), s.t0));
+
+	ret = 0;
+	if (used && copy_to_user(u64_to_user_ptr(prog.samples), smp,
+				 array_size(used, sizeof(*smp))))
+		ret = -EFAULT;
+	else if (copy_to_user(uprog, &prog, sizeof(prog)))
+		ret = -EFAULT;
+
+out_smp:
+	kvfree(smp);
+	kfree(loops);
+out_ops:
+	kfree(ops);
+	return ret;
+}
+
+static long probe_claim(struct file *file, struct uart_probe_claim __user *uclaim)
+{
+	struct uart_probe_claim req;
+	struct probe_claim *c;
+	struct tty_struct *tty;
+	char dev[UART_PROBE_PORT_LEN];
+	dev_t devt;
+	int ret;
+
+	if (copy_from_user(&req, uclaim, sizeof(req)))
+		return -EFAULT;
+	if (req.flags || !req.timeout_ms || req.timeout_ms > UART_PROBE_CLAIM_MS_MAX)
+		return -EINVAL;
+	strscpy(dev, req.port, sizeof(dev));
+	ret = tty_dev_name_to_number(dev, &devt);
+	if (ret)
+		return ret;
+
+	mutex_lock(&claims_lock);
+	list_for_each_entry(c, &claims, node) {
+		if (c->devt != devt)
+			continue;
+		/* claiming again only moves the timeout */
+		if (c->owner == file)
+			mod_delayed_work(system_wq, &c->expire,
+					 msecs_to_jiffies(req.timeout_ms));
+		else
+			ret = -EBUSY;
+		goto out;
+	}
+
+	c = kzalloc(sizeof(*c), GFP_KERNEL);
+	if (!c) {
+		ret = -ENOMEM;
+		goto out;
+	}
+	/* fails with -EBUSY if anyone has it open */
+	tty = tty_kopen_exclusive(devt);
+	if (IS_ERR(tty)) {
+		kfree(c);
+		ret = PTR_ERR(tty);
+		goto out;
+	}
+	tty_unlock(tty);
+
+	c->devt = devt;
+	c->tty = tty;
+	c->owner = file;
+	INIT_DELAYED_WORK(&c->expire, claim_expire);
+	list_add(&c->node, &claims);
+	schedule_delayed_work(&c->expire, msecs_to_jiffies(req.timeout_ms));
+out:
+	mutex_unlock(&claims_lock);
+	return ret;
+}
+
+static long probe_release_claim(struct file *file, struct uart_probe_claim __user *uclaim)
+{
+	struct uart_probe_claim req;
+	struct probe_claim *c, *found = NULL;
+	char dev[UART_PROBE_PORT_LEN];
+	dev_t devt;
+	int ret;
+
+	if (copy_from_user(&req, uclaim, sizeof(req)))
+		return -EFAULT;
+	strscpy(dev, req.port, sizeof(dev));
+	ret = tty_dev_name_to_number(dev, &devt);
+	if (ret)
+		return ret;
+
+	ret = -ENOENT;
+	mutex_lock(&claims_lock);
+	list_for_each_entry(c, &claims, node) {
+		if (c->devt != devt)
+			continue;
+		if (c->owner == file) {
+			list_del_init(&c->node);
+			found = c;
+			ret = 0;
+		} else {
+			ret = -EPERM;
+		}
+		break;
+	}
+	mutex_unlock(&claims_lock);
+
+	if (found)
+		claim_drop(found);
+	return ret;
+}
+
+static long probe_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
+{
+	switch (cmd) {
+	case UART_PROBE_IOC_VERSION:
+		return put_user(UART_PROBE_ABI_VERSION, (__u32 __user *)arg);
+	case UART_PROBE_IOC_BATCH:
+		return probe_batch(file, (struct uart_probe_batch __user *)arg);
+	case UART_PROBE_IOC_RUN:
+		return probe_prog(file, (struct uart_probe_prog __user *)arg);
+	case UART_PROBE_IOC_CLAIM:
+		return probe_claim(file, (struct uart_probe_claim __user *)arg);
+	case UART_PROBE_IOC_RELEASE:
+		return probe_release_claim(file, (struct uart_probe_claim __user *)arg);
+	default:
+		return -ENOTTY;
+	}
+}
+
+/* Whatever the file still holds goes when it is closed */
+static int probe_misc_release(struct inode *inode, struct file *file)
+{
+	struct probe_claim *c, *found;
+
+	do {
+		found = NULL;
+		mutex_lock(&claims_lock);
+		list_for_each_entry(c, &claims, node) {
+			if (c->owner == file) {
+				list_del_init(&c->node);
+				found = c;
+				break;
+			}
+		}
+		mutex_unlock(&claims_lock);
+		if (found)
+			claim_drop(found);
+	} while (found);
+
+	return 0;
+}
+
+static const struct file_operations probe_misc_fops = {
+	.owner = THIS_MODULE,
+	.release = probe_misc_release,
+	.unlocked_ioctl = probe_ioctl,
+	.compat_ioctl = compat_ptr_ioctl,
+	.llseek = noop_llseek,
+};
+
+/* root only by default, a udev rule can hand it to a group */
+static struct miscdevice probe_misc = {
+	.minor = MISC_DYNAMIC_MINOR,
+	.name = "uart_probe",
+	.fops = &probe_misc_fops,
+	.mode = 0600,
+};
+
+static int __init uart_probe_debugfs_init(void)
+{
+	int i, ret;
+
+	dir_entry = debugfs_create_dir("uart_probe", NULL);
+	if (IS_ERR_OR_NULL(dir_entry))
+		return -ENOMEM;
+
+	dev_entry = debugfs_create_file("select_dev", 0666, dir_entry, NULL, &select_dev_fops);
+	for (i = 0; i < ARRAY_SIZE(probes); i++)
+		debugfs_create_file(probes[i].name, 0444, dir_entry,
+				    (void *)&probes[i], &probe_fops);
+
+	debugfs_create_file("fifo_scope", 0444, dir_entry, NULL, &scope_text_fops);
+	debugfs_create_file("fifo_scope.vcd", 0444, dir_entry, NULL, &scope_vcd_fops);
+	debugfs_create_u32("scope_burst", 0644, dir_entry, &scope_burst);
+	debugfs_create_u32("scope_samples", 0644, dir_entry, &scope_samples);
+	debugfs_create_u32("scope_divisor", 0644, dir_entry, &scope_divisor);
+	debugfs_create_bool("scope_drain", 0644, dir_entry, &scope_drain);
+	debugfs_create_file("boot_results", 0444, dir_entry, NULL, &boot_results_fops);
+	debugfs_create_file("flow_control", 0444, dir_entry, NULL, &flow_fops);
+	debugfs_create_file("fingerprint", 0444, dir_entry, NULL, &fingerprint_fops);
+	debugfs_create_bool("probe_fast", 0644, dir_entry, &probe_fast);
+	ports_create(dir_entry);
+	debugfs_create_file("fifo_disable", 0644, dir_entry, NULL, &fifo_disable_fops);
+	debugfs_create_file("max_baud", 0444, dir_entry, NULL, &max_baud_fops);
+	debugfs_create_file("clock_modes", 0444, dir_entry, NULL, &clock_modes_fops);
+	debugfs_create_u32("probe_sampling", 0644, dir_entry, &probe_sampling);
+	debugfs_create_u32("probe_prescale", 0644, dir_entry, &probe_prescale);
+	debugfs_create_file("irq_timing", 0644, dir_entry, NULL, &irq_timing_fops);
+	debugfs_create_u32("prbs_bytes", 0644, dir_entry, &prbs_bytes);
+	debugfs_create_u32("prbs_max_div", 0644, dir_entry, &prbs_max_div);
+	debugfs_create_u32("prbs_time_ms", 0644, dir_entry, &prbs_time_ms);
+	debugfs_create_bool("prbs_external", 0644, dir_entry, &prbs_external);
+
+	if (IS_ERR_OR_NULL(dev_entry)) {
+		debugfs_remove_recursive(dir_entry);
+		return -ENOMEM;
+	}
+
+	ret = misc_register(&probe_misc);
+	if (ret) {
+		pr_err("uart_probe: cannot register /dev/uart_probe: %d\n", ret);
+		debugfs_remove_recursive(dir_entry);
+		return ret;
+	}
 
-    pr_info("uart_probe: loaded\n");
-    return 0;
+	pr_info("uart_probe: loaded\n");
+	if (boot_probe)
+		boot_probe_start();
+	return 0;
 }
 
 static void __exit uart_probe_debugfs_exit(void)
 {
+	async_synchronize_full_domain(&boot_domain);
+	misc_deregister(&probe_misc);
 	debugfs_remove_recursive(dir_entry);
+	irq_timing_set(false);
+	fifo_restore_all();
 	pr_info("uart_probe: unloaded\n");
 }
 
@@ -698,3 +3121,5 @@ module_exit(uart_probe_debugfs_exit);
 MODULE_LICENSE("GPL");
 MODULE_AUTHOR("Kyle L. Bader");
 MODULE_DESCRIPTION("DebugFS interface for probing UART FIFO config");
+/* gives the module a srcversion, which uart_probe.sh compares before reloading */
+MODULE_VERSION("abi" __stringify(UART_PROBE_ABI_VERSION));
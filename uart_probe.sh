@@ -5,6 +5,9 @@ DEBUGFS_BASE="/sys/kernel/debug/uart_probe"
 DEVICE_ARG=""
 DISABLE_FIFO_ARG=false
 TEST_RTT_ARG=false
+MODEL_ARG=false
+RELOAD_ARG=false
+JOBS=1
 RX_TRIGGER=""
 TX_TRIGGER=""
 RX_LIST=()
@@ -14,15 +17,23 @@ usage() {
     echo "Usage: $0 [-d /dev/ttySX]"
     echo "  -d, --device <DEVICE>   Probe only the specified UART device"
     echo "              e.g.: $0 -d /dev/ttyS1"
-    echo "  -x, --disable-fifo   Disable FIFO, 1 byte FIFO depth, 16450 mode"
+    echo "  -x, --disable-fifo   Also run RTT, throughput and interrupts/byte with the FIFO"
+    echo "                       disabled (1 byte FIFO depth, 16450 mode), side by side"
     echo "  -r, --rx-trigger <LEVEL> Comma separated list of RX trigger levels to test (1, 4, 8, 14)"
     echo "  -t, --tx-trigger <LEVEL>  Comma separated list of TX trigger levels to test (1, 4, 8, 14)"
+    echo "  -m, --model          Show the serial model's predictions and residuals next to"
+    echo "                       the probe and rtt_test results"
+    echo "  -j, --jobs <N>       Probe up to N ports at once, each through its own"
+    echo "                       $DEBUGFS_BASE/ports/<tty> directory (default 1)."
+    echo "                       RTT runs stay one port at a time"
+    echo "      --reload         Clean, rebuild and reload the modules even if the loaded"
+    echo "                       ones match the source"
 
     exit 1
 }
 
 # Parse args
-OPTS=$(getopt -o hd:xur:t: --long help,device:,disable-fifo,rtt,rx-trigger:,tx-trigger: -n "$0" -- "$@")
+OPTS=$(getopt -o hd:xur:t:mj: --long help,device:,disable-fifo,rtt,rx-trigger:,tx-trigger:,model,jobs:,reload -n "$0" -- "$@")
 eval set -- "$OPTS"
 
 while true; do
@@ -32,6 +43,9 @@ while true; do
         -u|--rtt) TEST_RTT_ARG=true; shift ;;
         -r|--rx-trigger) RX_TRIGGER="$2"; shift 2 ;;
         -t|--tx-trigger) TX_TRIGGER="$2"; shift 2 ;;
+        -m|--model) MODEL_ARG=true; shift ;;
+        -j|--jobs) JOBS="$2"; shift 2 ;;
+        --reload) RELOAD_ARG=true; shift ;;
         -h|--help) usage ;;
         --) shift; break ;;
     esac
@@ -55,40 +69,58 @@ parse_csv_to_array() {
     outarr+=("$p")
   done
 }
+# Wall clock per phase, reported at the end
+PHASES=()
+phase_begin() { PHASE_NAME="$1"; PHASE_T0=$EPOCHREALTIME; }
+phase_end() {
+  local t
+  t=$(awk -v a="$PHASE_T0" -v b="$EPOCHREALTIME" 'BEGIN { printf "%.2fs", b - a }')
+  PHASES+=("$PHASE_NAME $t${1:+ ($1)}")
+}
+
+# ttyS<N> lines with a UART behind them, from one read of /proc/tty/driver/serial
+declare -A TTY_OK=()
+scan_serial() {
+  local idx
+  sudo test -r /proc/tty/driver/serial 2>/dev/null || return 0
+  while read -r idx; do
+    TTY_OK[$idx]=1
+  done < <(sudo awk '
+    $1 ~ /^[0-9]+:$/ {
+      idx = substr($1, 1, length($1) - 1)
+      uart=""; port=""; irq=""; mmio=0
+      for (i=2; i<=NF; i++) {
+        if ($i ~ /^uart:/) { split($i,a,":"); uart=a[2] }
+        else if ($i ~ /^port:/) { split($i,a,":"); port=a[2] }
+        else if ($i ~ /^irq:/)  { split($i,a,":"); irq=a[2] }
+        else if ($i ~ /^mmio:/) { mmio=1 }
+      }
+      # Accept if: uart != unknown, irq > 0, and (port != 00000000 or mmio present)
+      if (uart != "unknown" && irq ~ /^[1-9][0-9]*$/ && (port != "00000000" || mmio==1))
+        print idx;
+      else
+        printf "DBG[ttyS%s]: REJECT (uart=%s port=%s irq=%s mmio=%d)\n", idx, uart, port, irq, mmio > "/dev/stderr";
+    }
+  ' /proc/tty/driver/serial 2>/dev/null)
+}
+
 # Returns 0 (true) if /dev/ttyS<N> is actually initialized/probed by a driver.
 tty_is_initialized() {
-  local dev="$1" idx ok
+  local dev="$1"
   [[ "$dev" =~ ^ttyS([0-9]+)$ ]] || { echo "DBG[$dev]: not ttyS<N>" >&2; return 1; }
-  idx="${BASH_REMATCH[1]}"
-
-  if sudo test -r /proc/tty/driver/serial 2>/dev/null; then
-    ok=$(sudo awk -v idx="$idx" '
-      $1 == idx ":" {
-        uart=""; port=""; irq=""; mmio=0
-        for (i=2; i<=NF; i++) {
-          if ($i ~ /^uart:/) { split($i,a,":"); uart=a[2] }
-          else if ($i ~ /^port:/) { split($i,a,":"); port=a[2] }
-          else if ($i ~ /^irq:/)  { split($i,a,":"); irq=a[2] }
-          else if ($i ~ /^mmio:/) { mmio=1 }
-        }
-        # Accept if: uart != unknown, irq > 0, and (port != 00000000 or mmio present)
-        if (uart != "unknown" && irq ~ /^[1-9][0-9]*$/ && (port != "00000000" || mmio==1))
-          print "ok";
-        else
-          printf "DBG[ttyS%s]: REJECT (uart=%s port=%s irq=%s mmio=%d)\n", idx, uart, port, irq, mmio > "/dev/stderr";
-      }
-    ' /proc/tty/driver/serial 2>/dev/null)
+  [[ -n "${TTY_OK[${BASH_REMATCH[1]}]:-}" ]]
+}
 
-    if [[ "$ok" == "ok" ]]; then
-      return 0
-    else
-      return 1
-    fi
-  else
-    return 1
-  fi
+# Returns 0 if the loaded module was built from the same source as ./<name>.ko
+module_current() {
+  local loaded built
+  loaded=$(cat "/sys/module/$1/srcversion" 2>/dev/null) || return 1
+  built=$(modinfo -F srcversion "./$1.ko" 2>/dev/null) || return 1
+  [[ -n "$loaded" && "$loaded" == "$built" ]]
 }
 
+is_uint "$JOBS" && (( JOBS > 0 )) || { echo "Invalid job count: '$JOBS'" >&2; exit 2; }
+
 # Parse RX and TX trigger levels
 [[ -n "$RX_TRIGGER" ]] && parse_csv_to_array "$RX_TRIGGER" RX_LIST
 [[ -n "$TX_TRIGGER" ]] && parse_csv_to_array "$TX_TRIGGER" TX_LIST
@@ -107,10 +139,21 @@ fi
 # Ensure debugfs is mounted
 mountpoint -q /sys/kernel/debug || sudo mount -t debugfs none /sys/kernel/debug
 
-# Build & install
-make -s clean
+T_START=$EPOCHREALTIME
+
+# Build, then load only if the loaded modules are from other source
+phase_begin build
+$RELOAD_ARG && make -s clean
 make -s
-sudo make -s install
+phase_end
+
+phase_begin load
+if ! $RELOAD_ARG && module_current uart_probe && module_current uart_passthru; then
+    phase_end reused
+else
+    sudo make -s install
+    phase_end reloaded
+fi
 
 # Sanity check
 if ! sudo test -d "$DEBUGFS_BASE"; then
@@ -121,6 +164,7 @@ fi
 echo "[+] Probing UARTs..."
 
 # Build device list
+phase_begin scan
 if [[ -n "$DEVICE_ARG" ]]; then
     if [[ ! -e "$DEVICE_ARG" ]]; then
         echo "Device $DEVICE_ARG not found"
@@ -137,6 +181,8 @@ else
     fi
 fi
 
+scan_serial
+targets=()
 for dev_path in "${cands[@]}"; do
   dev=$(basename "$dev_path")
 
@@ -151,10 +197,34 @@ for dev_path in "${cands[@]}"; do
     echo "  - $dev: skipped (busy)"
     continue
   fi
+  targets+=("$dev_path")
+done
 
-  printf '%s\n' "$dev" | sudo tee "$DEBUGFS_BASE/select_dev" >/dev/null
+# Ports run in parallel only through their own directories, not select_dev
+if (( JOBS > 1 )) && ! sudo test -d "$DEBUGFS_BASE/ports"; then
+  echo "  (module has no ports/ directory, probing one port at a time)"
+  JOBS=1
+fi
+phase_end "${#targets[@]} ports"
+
+RTT_MODEL=()
+$MODEL_ARG && RTT_MODEL=(--model)
+
+# Probes and model for one port, output on stdout
+probe_port() {
+  local dev_path="$1" dev base fifo_base have_fifo out rx tx
+  dev=$(basename "$dev_path")
+  base="$DEBUGFS_BASE/ports/$dev"
+  if ! sudo test -d "$base"; then
+    base="$DEBUGFS_BASE"
+    printf '%s\n' "$dev" | sudo tee "$DEBUGFS_BASE/select_dev" >/dev/null
+  fi
   echo "  * $dev"
 
+  if out=$(sudo cat "$base/fingerprint" 2>/dev/null); then
+    echo "     - chip: $(awk -F': ' '$1 == "chip" { c = $2 } $1 == "strategy" { s = $2 } END { print c " (" s ")" }' <<< "$out")"
+  fi
+
   fifo_base="/sys/class/tty/$dev"
   have_fifo=false
   sudo test -d "$fifo_base" && have_fifo=true
@@ -167,7 +237,7 @@ for dev_path in "${cands[@]}"; do
       for rx in "${RX_LIST[@]}"; do
         echo "$rx" | sudo tee "$fifo_base/rx_trig_bytes" >/dev/null
         echo "  * $dev rx_trig_level set to $rx"
-        if out=$(sudo cat "$DEBUGFS_BASE/rx_trig_level" 2>&1); then
+        if out=$(sudo cat "$base/rx_trig_level" 2>&1); then
           echo "     - rx_trig_level: $out"
         else
           echo "     - rx_trig_level (set=$rx): [error] $out"
@@ -177,7 +247,7 @@ for dev_path in "${cands[@]}"; do
     fi
   else
     # No RX list provided: run once with current setting
-    if out=$(sudo cat "$DEBUGFS_BASE/rx_trig_level" 2>&1); then
+    if out=$(sudo cat "$base/rx_trig_level" 2>&1); then
       echo "     - rx_trig_level: $out"
     else
       echo "     - rx_trig_level: [error] $out"
@@ -185,7 +255,7 @@ for dev_path in "${cands[@]}"; do
   fi
 
   # --- RX FIFO size ---
-  if out=$(sudo cat "$DEBUGFS_BASE/rx_fifo_size" 2>&1); then
+  if out=$(sudo cat "$base/rx_fifo_size" 2>&1); then
       echo "     - rx_fifo_size:  $out"
     else
       echo "     - rx_fifo_size:  [error] $out"
@@ -198,7 +268,7 @@ for dev_path in "${cands[@]}"; do
     else
       for tx in "${TX_LIST[@]}"; do
         echo "$tx" | sudo tee "$fifo_base/tx_trig_bytes" >/dev/null
-        if out=$(sudo cat "$DEBUGFS_BASE/tx_trig_level" 2>&1); then
+        if out=$(sudo cat "$base/tx_trig_level" 2>&1); then
           echo "     - tx_trig_level (set=$tx): $out"
         else
           echo "     - tx_trig_level (set=$tx): [error] $out"
@@ -208,7 +278,7 @@ for dev_path in "${cands[@]}"; do
     fi
   else
     # No TX list provided: run once with current setting
-    if out=$(sudo cat "$DEBUGFS_BASE/tx_trig_level" 2>&1); then
+    if out=$(sudo cat "$base/tx_trig_level" 2>&1); then
       echo "     - tx_trig_level: $out"
     else
       echo "     - tx_trig_level: [error] $out"
@@ -216,20 +286,81 @@ for dev_path in "${cands[@]}"; do
   fi
 
   # --- TX FIFO size ---
-  if out=$(sudo cat "$DEBUGFS_BASE/tx_fifo_size" 2>&1); then
+  if out=$(sudo cat "$base/tx_fifo_size" 2>&1); then
         echo "     - tx_fifo_size: $out"
     else
         echo "     - tx_fifo_size: [error] $out"
   fi
   
+  # --- Model against the probe results (if requested) ---
+  if $MODEL_ARG; then
+    if out=$(sudo ./uart_model -d "$dev_path" --probe 2>&1); then
+      echo "     - model:"
+      sed 's/^/         /' <<< "$out"
+    else
+      echo "     - model: [error] $out"
+    fi
+  fi
+}
+
+# RTT runs share the CPUs with everything else, so they go one at a time
+rtt_port() {
+  local dev_path="$1" out
+  echo "  * $(basename "$dev_path")"
+
   # --- RTT test (if requested) ---
   if $TEST_RTT_ARG; then
-    if out=$(sudo ./rtt_test "$dev_path" 2>&1); then
+    if out=$(sudo ./rtt_test "${RTT_MODEL[@]}" "$dev_path" 2>&1); then
       echo "     - $out"
     else
       echo "     - RTT: [error] $out"
     fi
   fi
-done
 
+  # --- FIFO on vs off (if requested) ---
+  if $DISABLE_FIFO_ARG; then
+    if out=$(sudo ./rtt_test --fifo "${RTT_MODEL[@]}" "$dev_path" 2>&1); then
+      echo "     - fifo on/off:"
+      sed 's/^/         /' <<< "$out"
+    else
+      echo "     - fifo on/off: [error] $out"
+    fi
+  fi
+}
+
+phase_begin probe
+if (( JOBS > 1 )); then
+  sudo -v   # no password prompts from the background jobs
+  outdir=$(mktemp -d)
+  trap 'rm -rf "$outdir"' EXIT
+  for i in "${!targets[@]}"; do
+    while (( $(jobs -rp | wc -l) >= JOBS )); do
+      wait -n || true
+    done
+    probe_port "${targets[$i]}" > "$outdir/$i" 2>&1 &
+  done
+  wait
+  for i in "${!targets[@]}"; do
+    cat "$outdir/$i"
+  done
+else
+  for dev_path in "${targets[@]}"; do
+    probe_port "$dev_path"
+  done
+fi
+phase_end "$JOBS jobs"
+
+if $TEST_RTT_ARG || $DISABLE_FIFO_ARG; then
+  echo "[+] RTT..."
+  phase_begin rtt
+  for dev_path in "${targets[@]}"; do
+    rtt_port "$dev_path"
+  done
+  phase_end
+fi
+
+PHASE_NAME=total
+PHASE_T0=$T_START
+phase_end
 echo "[+] Done."
+printf '    %s\n' "${PHASES[@]}"
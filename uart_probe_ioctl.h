@@ -0,0 +1,185 @@
+/* SPDX-License-Identifier: GPL-2.0 WITH Linux-syscall-note */
+/*
+ * uart_probe_ioctl.h - Binary interface to the uart_probe module
+ *
+ * Copyright (C) 2025 Kyle L. Bader
+ *
+ * /dev/uart_probe takes a batch of (port, probe, parameters) commands in
+ * one ioctl and fills in one fixed size result per command. Commands run
+ * in order; a command that fails reports -errno in its result and the
+ * batch goes on. The ioctl returns the number of commands run, which is
+ * less than count only if a signal interrupted the batch.
+ *
+ * UART_PROBE_IOC_RUN runs a small register program on one port, under the
+ * same port lock and register save/restore as the built-in probes, and
+ * returns what it read along with timestamps. Programs are bounded in
+ * steps and in time.
+ *
+ * UART_PROBE_IOC_CLAIM holds a port for the calling file until
+ * UART_PROBE_IOC_RELEASE, the timeout, or close. While it is held,
+ * open() of the tty fails with EBUSY and only that file can probe it.
+ */
+#ifndef _UART_PROBE_IOCTL_H
+#define _UART_PROBE_IOCTL_H
+
+#include <linux/ioctl.h>
+#include <linux/types.h>
+
+#define UART_PROBE_ABI_VERSION	6
+#define UART_PROBE_PORT_LEN	16
+#define UART_PROBE_BATCH_MAX	256
+
+enum uart_probe_id {
+	UART_PROBE_RX_TRIG,		/* rx trigger level, bytes */
+	UART_PROBE_RX_FIFO,		/* rx FIFO size, bytes */
+	UART_PROBE_TX_FIFO,		/* tx FIFO size, bytes */
+	UART_PROBE_TX_TRIG,		/* tx trigger level, bytes */
+	UART_PROBE_RTS_OFF,		/* rx level where auto-RTS deasserts, bytes */
+	UART_PROBE_RTS_ON,		/* rx level where it asserts again, bytes, may be 0 */
+	UART_PROBE_COUNT,
+};
+
+/*
+ * uart_probe_result.chip: what the register fingerprint taken at the start
+ * of every session found, which may not be the driver's port->type
+ */
+enum uart_probe_chip {
+	UART_PROBE_CHIP_UNKNOWN,
+	UART_PROBE_CHIP_8250,		/* no FIFO, no scratch register */
+	UART_PROBE_CHIP_16450,		/* no FIFO */
+	UART_PROBE_CHIP_16550,		/* FIFO bits broken, run without */
+	UART_PROBE_CHIP_16550A,
+	UART_PROBE_CHIP_16650,		/* EFR, no ID registers */
+	UART_PROBE_CHIP_16750,		/* 64 byte FIFO behind DLAB */
+	UART_PROBE_CHIP_16850,		/* Exar XR16C85x, divisor ID */
+	UART_PROBE_CHIP_16C950,		/* Oxford, ICR ID registers */
+	UART_PROBE_CHIP_XR17D15X,
+	UART_PROBE_CHIP_XR17V35X,
+	UART_PROBE_CHIP_COUNT,
+};
+
+/* uart_probe_result.strategy: how the FIFO probes waited for the line */
+enum uart_probe_strategy {
+	UART_PROBE_STRAT_DELAY,		/* fixed delays, chip unknown */
+	UART_PROBE_STRAT_POLL,		/* LSR TEMT, about a char time per byte */
+	UART_PROBE_STRAT_NOFIFO,	/* no FIFO: sizes and levels are 1, no loopback */
+	UART_PROBE_STRAT_COUNT,
+};
+
+/* uart_probe_cmd.flags */
+#define UART_PROBE_F_DIVISOR	(1 << 0)	/* use divisor instead of 1 */
+#define UART_PROBE_F_FCR	(1 << 1)	/* use fcr instead of the port's FCR */
+#define UART_PROBE_F_SAMPLING	(1 << 3)	/* use sampling instead of 16 clocks per bit */
+#define UART_PROBE_F_PRESCALE	(1 << 4)	/* 16C950 only: prescale the clock by prescale / 8 */
+
+struct uart_probe_cmd {
+	char port[UART_PROBE_PORT_LEN];	/* tty name, e.g. "ttyS1" */
+	__u32 probe;			/* enum uart_probe_id */
+	__u32 flags;
+	__u16 divisor;			/* loopback baud divisor, 1..UART_PROBE_DIVISOR_MAX */
+	__u8 fcr;			/* FIFO control, selects the trigger levels */
+	__u8 sampling;			/* 4..16, 16C950 any, XR17V35x 4, 8 or 16 */
+	__u8 prescale;			/* 16C950 CPR, 8..255 */
+	__u8 reserved[3];
+};
+
+#define UART_PROBE_DIVISOR_MAX	16
+
+struct uart_probe_result {
+	__s32 value;			/* bytes, or -errno */
+	__u32 probe;
+	__u64 duration_ns;		/* whole session, save to restore */
+	__u32 uartclk;
+	__u32 type;			/* PORT_* from serial_core.h */
+	__u16 fifosize;			/* what the driver thinks */
+	__u16 dl;			/* registers before the probe */
+	__u8 lcr;
+	__u8 fcr;
+	__u8 mcr;
+	__u8 ier;
+	__u8 chip;			/* enum uart_probe_chip */
+	__u8 strategy;			/* enum uart_probe_strategy */
+	__u8 reserved[6];
+};
+
+struct uart_probe_batch {
+	__u32 count;			/* in: commands, at most UART_PROBE_BATCH_MAX */
+	__u32 flags;			/* must be 0 */
+	__u64 cmds;			/* struct uart_probe_cmd[count] */
+	__u64 results;			/* struct uart_probe_result[count] */
+};
+
+/* uart_probe_op.op */
+enum uart_probe_opcode {
+	UART_PROBE_OP_READ,		/* sample reg */
+	UART_PROBE_OP_WRITE,		/* reg = value */
+	UART_PROBE_OP_WAIT,		/* until (reg & mask) == value, at most arg char times, sample reg */
+	UART_PROBE_OP_DELAY,		/* wait arg char times, sleeping if over 10 us */
+	UART_PROBE_OP_TIME,		/* sample the time only */
+	UART_PROBE_OP_LOOP,		/* jump to op target, arg more times */
+	UART_PROBE_OP_COUNT,
+};
+
+struct uart_probe_op {
+	__u8 op;
+	__u8 reg;			/* UART_RX .. UART_SCR, as seen with the current LCR */
+	__u8 mask;
+	__u8 value;
+	__u16 arg;
+	__u16 target;			/* LOOP: index of an earlier op */
+};
+
+/* uart_probe_sample.flags */
+#define UART_PROBE_S_TIMEOUT	(1 << 0)	/* WAIT gave up */
+
+struct uart_probe_sample {
+	__u64 t_ns;			/* since the session started */
+	__u16 pc;			/* op that took the sample */
+	__u8 value;
+	__u8 flags;
+	__u32 reserved;
+};
+
+#define UART_PROBE_PROG_OPS_MAX		256
+#define UART_PROBE_PROG_SAMPLES_MAX	65536
+#define UART_PROBE_PROG_STEPS_MAX	1000000
+#define UART_PROBE_PROG_TIME_MS		2000
+
+/* uart_probe_prog.flags, plus UART_PROBE_F_DIVISOR, _FCR and _SAMPLING */
+#define UART_PROBE_F_LOOPBACK	(1 << 2)	/* start in internal loopback at 8N1 */
+
+struct uart_probe_prog {
+	char port[UART_PROBE_PORT_LEN];
+	__u32 flags;
+	__u16 divisor;			/* with UART_PROBE_F_LOOPBACK */
+	__u8 fcr;
+	__u8 sampling;			/* with UART_PROBE_F_LOOPBACK, prescaler off */
+	__u32 nops;
+	__u32 nsamples;			/* room in samples */
+	__u64 ops;			/* struct uart_probe_op[nops] */
+	__u64 samples;			/* struct uart_probe_sample[nsamples] */
+	/* out */
+	__s32 status;			/* 0, -ENOSPC (samples full), -E2BIG (steps), -ETIME, -EINTR */
+	__u32 samples_used;
+	__u32 steps;
+	__u32 reserved2;
+	__u64 duration_ns;
+};
+
+struct uart_probe_claim {
+	char port[UART_PROBE_PORT_LEN];
+	__u32 timeout_ms;		/* 1..UART_PROBE_CLAIM_MS_MAX, claim again to extend */
+	__u32 flags;			/* must be 0 */
+};
+
+#define UART_PROBE_CLAIM_MS_MAX	600000
+
+#define UART_PROBE_IOC_MAGIC	0xB8
+
+#define UART_PROBE_IOC_VERSION	_IOR(UART_PROBE_IOC_MAGIC, 0, __u32)
+#define UART_PROBE_IOC_BATCH	_IOWR(UART_PROBE_IOC_MAGIC, 1, struct uart_probe_batch)
+#define UART_PROBE_IOC_RUN	_IOWR(UART_PROBE_IOC_MAGIC, 2, struct uart_probe_prog)
+#define UART_PROBE_IOC_CLAIM	_IOW(UART_PROBE_IOC_MAGIC, 3, struct uart_probe_claim)
+#define UART_PROBE_IOC_RELEASE	_IOW(UART_PROBE_IOC_MAGIC, 4, struct uart_probe_claim)
+
+#endif /* _UART_PROBE_IOCTL_H */
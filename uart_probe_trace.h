@@ -0,0 +1,353 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/*
+ * uart_probe_trace.h - Tracepoints for uart_probe probe sessions
+ *
+ * Copyright (C) 2025 Kyle L. Bader
+ *
+ * Every probe runs as a session: start, register configuration, FIFO
+ * fills and drains, the condition it is looking for, restore and end.
+ * Time fields are nanoseconds since the session started and are only
+ * computed when the event is enabled.
+ *
+ *   trace-cmd record -e uart_probe cat /sys/kernel/debug/uart_probe/rx_trig_level
+ */
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM uart_probe
+
+#if !defined(_UART_PROBE_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _UART_PROBE_TRACE_H
+
+#include <linux/ktime.h>
+#include <linux/string.h>
+#include <linux/tracepoint.h>
+
+#ifndef _UART_PROBE_TRACE_DEFS
+#define _UART_PROBE_TRACE_DEFS
+
+#include "uart_probe_ioctl.h"
+
+#define UART_PROBE_DEV_LEN	16
+
+/* sessions that run a register program rather than a built-in probe */
+#define UART_PROBE_PROGRAM	UART_PROBE_COUNT
+/* fifo_scope captures */
+#define UART_PROBE_SCOPE	(UART_PROBE_COUNT + 1)
+/* flow_control reports */
+#define UART_PROBE_FLOW		(UART_PROBE_COUNT + 2)
+/* max_baud searches */
+#define UART_PROBE_BAUD		(UART_PROBE_COUNT + 3)
+/* clock_modes reports */
+#define UART_PROBE_CLOCK	(UART_PROBE_COUNT + 4)
+/* fingerprint reports */
+#define UART_PROBE_FINGERPRINT	(UART_PROBE_COUNT + 5)
+
+/* what a probe loop stopped on */
+enum uart_probe_cond {
+	UART_PROBE_COND_RDI,		/* rx data available interrupt */
+	UART_PROBE_COND_THRI,		/* tx holding register empty interrupt */
+	UART_PROBE_COND_OE,		/* overrun in LSR */
+	UART_PROBE_COND_TIMEOUT,	/* gave up */
+	UART_PROBE_COND_CTS,		/* CTS, looped back from auto-RTS, changed */
+};
+
+#define uart_probe_delta_ns(t0)	ktime_to_ns(ktime_sub(ktime_get(), t0))
+
+#endif
+
+TRACE_DEFINE_ENUM(UART_PROBE_RX_TRIG);
+TRACE_DEFINE_ENUM(UART_PROBE_RX_FIFO);
+TRACE_DEFINE_ENUM(UART_PROBE_TX_FIFO);
+TRACE_DEFINE_ENUM(UART_PROBE_TX_TRIG);
+TRACE_DEFINE_ENUM(UART_PROBE_RTS_OFF);
+TRACE_DEFINE_ENUM(UART_PROBE_RTS_ON);
+TRACE_DEFINE_ENUM(UART_PROBE_COUNT);
+TRACE_DEFINE_ENUM(UART_PROBE_COND_RDI);
+TRACE_DEFINE_ENUM(UART_PROBE_COND_THRI);
+TRACE_DEFINE_ENUM(UART_PROBE_COND_OE);
+TRACE_DEFINE_ENUM(UART_PROBE_COND_TIMEOUT);
+TRACE_DEFINE_ENUM(UART_PROBE_COND_CTS);
+TRACE_DEFINE_ENUM(UART_PROBE_STRAT_DELAY);
+TRACE_DEFINE_ENUM(UART_PROBE_STRAT_POLL);
+TRACE_DEFINE_ENUM(UART_PROBE_STRAT_NOFIFO);
+
+#define show_probe_kind(k)					\
+	__print_symbolic(k,					\
+		{ UART_PROBE_RX_TRIG,	"rx_trig_level" },	\
+		{ UART_PROBE_RX_FIFO,	"rx_fifo_size" },	\
+		{ UART_PROBE_TX_FIFO,	"tx_fifo_size" },	\
+		{ UART_PROBE_TX_TRIG,	"tx_trig_level" },	\
+		{ UART_PROBE_RTS_OFF,	"rts_off_level" },	\
+		{ UART_PROBE_RTS_ON,	"rts_on_level" },	\
+		{ UART_PROBE_PROGRAM,	"program" },		\
+		{ UART_PROBE_SCOPE,	"fifo_scope" },		\
+		{ UART_PROBE_FLOW,	"flow_control" },	\
+		{ UART_PROBE_BAUD,	"max_baud" },		\
+		{ UART_PROBE_CLOCK,	"clock_modes" },		\
+		{ UART_PROBE_FINGERPRINT, "fingerprint" })
+
+#define show_probe_cond(c)					\
+	__print_symbolic(c,					\
+		{ UART_PROBE_COND_RDI,		"RDI" },	\
+		{ UART_PROBE_COND_THRI,		"THRI" },	\
+		{ UART_PROBE_COND_OE,		"OE" },		\
+		{ UART_PROBE_COND_TIMEOUT,	"timeout" },	\
+		{ UART_PROBE_COND_CTS,		"CTS" })
+
+#define show_probe_strategy(st)					\
+	__print_symbolic(st,					\
+		{ UART_PROBE_STRAT_DELAY,	"delay" },	\
+		{ UART_PROBE_STRAT_POLL,	"poll" },	\
+		{ UART_PROBE_STRAT_NOFIFO,	"nofifo" })
+
+TRACE_EVENT(uart_probe_start,
+	TP_PROTO(const char *dev, int kind, unsigned int uartclk, int fifosize),
+	TP_ARGS(dev, kind, uartclk, fifosize),
+
+	TP_STRUCT__entry(
+		__array(char,		dev, UART_PROBE_DEV_LEN)
+		__field(int,		kind)
+		__field(unsigned int,	uartclk)
+		__field(int,		fifosize)
+	),
+
+	TP_fast_assign(
+		strscpy(__entry->dev, dev, UART_PROBE_DEV_LEN);
+		__entry->kind = kind;
+		__entry->uartclk = uartclk;
+		__entry->fifosize = fifosize;
+	),
+
+	TP_printk("%s %s uartclk=%u fifosize=%d", __entry->dev,
+		  show_probe_kind(__entry->kind), __entry->uartclk,
+		  __entry->fifosize)
+);
+
+TRACE_EVENT(uart_probe_end,
+	TP_PROTO(const char *dev, int kind, int result, ktime_t t0),
+	TP_ARGS(dev, kind, result, t0),
+
+	TP_STRUCT__entry(
+		__array(char,	dev, UART_PROBE_DEV_LEN)
+		__field(int,	kind)
+		__field(int,	result)
+		__field(s64,	delta_ns)
+	),
+
+	TP_fast_assign(
+		strscpy(__entry->dev, dev, UART_PROBE_DEV_LEN);
+		__entry->kind = kind;
+		__entry->result = result;
+		__entry->delta_ns = uart_probe_delta_ns(t0);
+	),
+
+	TP_printk("%s %s result=%d delta_ns=%lld", __entry->dev,
+		  show_probe_kind(__entry->kind), __entry->result,
+		  __entry->delta_ns)
+);
+
+DECLARE_EVENT_CLASS(uart_probe_regs,
+	TP_PROTO(const char *dev, u8 lcr, u8 fcr, u8 mcr, u8 ier, u16 dl,
+		 ktime_t t0),
+	TP_ARGS(dev, lcr, fcr, mcr, ier, dl, t0),
+
+	TP_STRUCT__entry(
+		__array(char,	dev, UART_PROBE_DEV_LEN)
+		__field(u8,	lcr)
+		__field(u8,	fcr)
+		__field(u8,	mcr)
+		__field(u8,	ier)
+		__field(u16,	dl)
+		__field(s64,	delta_ns)
+	),
+
+	TP_fast_assign(
+		strscpy(__entry->dev, dev, UART_PROBE_DEV_LEN);
+		__entry->lcr = lcr;
+		__entry->fcr = fcr;
+		__entry->mcr = mcr;
+		__entry->ier = ier;
+		__entry->dl = dl;
+		__entry->delta_ns = uart_probe_delta_ns(t0);
+	),
+
+	TP_printk("%s LCR=%02x FCR=%02x MCR=%02x IER=%02x DL=%u delta_ns=%lld",
+		  __entry->dev, __entry->lcr, __entry->fcr, __entry->mcr,
+		  __entry->ier, __entry->dl, __entry->delta_ns)
+);
+
+/* registers as programmed for the probe */
+DEFINE_EVENT(uart_probe_regs, uart_probe_config,
+	TP_PROTO(const char *dev, u8 lcr, u8 fcr, u8 mcr, u8 ier, u16 dl,
+		 ktime_t t0),
+	TP_ARGS(dev, lcr, fcr, mcr, ier, dl, t0)
+);
+
+/* registers as put back at the end of the session */
+DEFINE_EVENT(uart_probe_regs, uart_probe_restore,
+	TP_PROTO(const char *dev, u8 lcr, u8 fcr, u8 mcr, u8 ier, u16 dl,
+		 ktime_t t0),
+	TP_ARGS(dev, lcr, fcr, mcr, ier, dl, t0)
+);
+
+TRACE_EVENT(uart_probe_ident,
+	TP_PROTO(const char *dev, u8 efr, u8 acr, unsigned int type,
+		 unsigned int caps),
+	TP_ARGS(dev, efr, acr, type, caps),
+
+	TP_STRUCT__entry(
+		__array(char,		dev, UART_PROBE_DEV_LEN)
+		__field(u8,		efr)
+		__field(u8,		acr)
+		__field(unsigned int,	type)
+		__field(unsigned int,	caps)
+	),
+
+	TP_fast_assign(
+		strscpy(__entry->dev, dev, UART_PROBE_DEV_LEN);
+		__entry->efr = efr;
+		__entry->acr = acr;
+		__entry->type = type;
+		__entry->caps = caps;
+	),
+
+	TP_printk("%s EFR=%02x ECB=%d ACR=%02x TLENB=%d type=%u caps=%#x",
+		  __entry->dev, __entry->efr, !!(__entry->efr & 0x10),
+		  __entry->acr, !!(__entry->acr & 0x20), __entry->type,
+		  __entry->caps)
+);
+
+/* chip is enum uart_probe_chip, id the 16C950 ID1..3 or Exar DVID/DREV */
+TRACE_EVENT(uart_probe_fingerprint,
+	TP_PROTO(const char *dev, int chip, int strategy, u8 iir, u8 efr,
+		 u32 id, bool cached, u64 ns),
+	TP_ARGS(dev, chip, strategy, iir, efr, id, cached, ns),
+
+	TP_STRUCT__entry(
+		__array(char,	dev, UART_PROBE_DEV_LEN)
+		__field(int,	chip)
+		__field(int,	strategy)
+		__field(u8,	iir)
+		__field(u8,	efr)
+		__field(u32,	id)
+		__field(bool,	cached)
+		__field(u64,	ns)
+	),
+
+	TP_fast_assign(
+		strscpy(__entry->dev, dev, UART_PROBE_DEV_LEN);
+		__entry->chip = chip;
+		__entry->strategy = strategy;
+		__entry->iir = iir;
+		__entry->efr = efr;
+		__entry->id = id;
+		__entry->cached = cached;
+		__entry->ns = ns;
+	),
+
+	TP_printk("%s chip=%d strategy=%s IIR=%02x EFR=%02x id=%06x cached=%d ns=%llu",
+		  __entry->dev, __entry->chip,
+		  show_probe_strategy(__entry->strategy), __entry->iir,
+		  __entry->efr, __entry->id, __entry->cached, __entry->ns)
+);
+
+DECLARE_EVENT_CLASS(uart_probe_xfer,
+	TP_PROTO(const char *dev, int bytes, u8 lsr, ktime_t t0),
+	TP_ARGS(dev, bytes, lsr, t0),
+
+	TP_STRUCT__entry(
+		__array(char,	dev, UART_PROBE_DEV_LEN)
+		__field(int,	bytes)
+		__field(u8,	lsr)
+		__field(s64,	delta_ns)
+	),
+
+	TP_fast_assign(
+		strscpy(__entry->dev, dev, UART_PROBE_DEV_LEN);
+		__entry->bytes = bytes;
+		__entry->lsr = lsr;
+		__entry->delta_ns = uart_probe_delta_ns(t0);
+	),
+
+	TP_printk("%s bytes=%d LSR=%02x delta_ns=%lld", __entry->dev,
+		  __entry->bytes, __entry->lsr, __entry->delta_ns)
+);
+
+/* bytes written to THR, total so far */
+DEFINE_EVENT(uart_probe_xfer, uart_probe_fill,
+	TP_PROTO(const char *dev, int bytes, u8 lsr, ktime_t t0),
+	TP_ARGS(dev, bytes, lsr, t0)
+);
+
+/* bytes read back from RBR */
+DEFINE_EVENT(uart_probe_xfer, uart_probe_drain,
+	TP_PROTO(const char *dev, int bytes, u8 lsr, ktime_t t0),
+	TP_ARGS(dev, bytes, lsr, t0)
+);
+
+/* a register the probe did not read is logged as 0 */
+TRACE_EVENT(uart_probe_irq,
+	TP_PROTO(const char *dev, int cond, u8 iir, u8 lsr, u8 msr, int bytes,
+		 ktime_t t0),
+	TP_ARGS(dev, cond, iir, lsr, msr, bytes, t0),
+
+	TP_STRUCT__entry(
+		__array(char,	dev, UART_PROBE_DEV_LEN)
+		__field(int,	cond)
+		__field(u8,	iir)
+		__field(u8,	lsr)
+		__field(u8,	msr)
+		__field(int,	bytes)
+		__field(s64,	delta_ns)
+	),
+
+	TP_fast_assign(
+		strscpy(__entry->dev, dev, UART_PROBE_DEV_LEN);
+		__entry->cond = cond;
+		__entry->iir = iir;
+		__entry->lsr = lsr;
+		__entry->msr = msr;
+		__entry->bytes = bytes;
+		__entry->delta_ns = uart_probe_delta_ns(t0);
+	),
+
+	TP_printk("%s %s IIR=%02x LSR=%02x MSR=%02x bytes=%d delta_ns=%lld",
+		  __entry->dev, show_probe_cond(__entry->cond), __entry->iir,
+		  __entry->lsr, __entry->msr, __entry->bytes, __entry->delta_ns)
+);
+
+/* one register program step that touched the UART or took a sample */
+TRACE_EVENT(uart_probe_op,
+	TP_PROTO(const char *dev, u16 pc, u8 op, u8 reg, u8 value, ktime_t t0),
+	TP_ARGS(dev, pc, op, reg, value, t0),
+
+	TP_STRUCT__entry(
+		__array(char,	dev, UART_PROBE_DEV_LEN)
+		__field(u16,	pc)
+		__field(u8,	op)
+		__field(u8,	reg)
+		__field(u8,	value)
+		__field(s64,	delta_ns)
+	),
+
+	TP_fast_assign(
+		strscpy(__entry->dev, dev, UART_PROBE_DEV_LEN);
+		__entry->pc = pc;
+		__entry->op = op;
+		__entry->reg = reg;
+		__entry->value = value;
+		__entry->delta_ns = uart_probe_delta_ns(t0);
+	),
+
+	TP_printk("%s pc=%u op=%u reg=%u value=%02x delta_ns=%lld",
+		  __entry->dev, __entry->pc, __entry->op, __entry->reg,
+		  __entry->value, __entry->delta_ns)
+);
+
+#endif /* _UART_PROBE_TRACE_H */
+
+/* This part must be outside protection */
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE uart_probe_trace
+#include <trace/define_trace.h>
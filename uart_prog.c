@@ -0,0 +1,274 @@
+// uart_prog.c
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+
+#include "uart_probe_ioctl.h"
+
+#define PROBE_MISC_DEV      "/dev/uart_probe"
+#define LABELS_MAX          64
+#define SAMPLES_DEFAULT     4096
+
+/*
+ * Assembles a register program and runs it with UART_PROBE_IOC_RUN.
+ *
+ *   # comment
+ *   name:                          label for loop
+ *   read   REG
+ *   write  REG VALUE
+ *   wait   REG MASK VALUE CHARS    until (REG & MASK) == VALUE
+ *   delay  CHARS
+ *   time
+ *   loop   name COUNT              jump back to name COUNT more times
+ *
+ * REG is a number or RX TX IER IIR FCR LCR MCR LSR MSR SCR DLL DLM.
+ */
+struct label {
+    char name[32];
+    int pc;
+};
+
+static const struct { const char *name; int reg; } regs[] = {
+    { "RX", 0 }, { "TX", 0 }, { "DLL", 0 }, { "IER", 1 }, { "DLM", 1 },
+    { "IIR", 2 }, { "FCR", 2 }, { "EFR", 2 }, { "LCR", 3 }, { "MCR", 4 },
+    { "LSR", 5 }, { "MSR", 6 }, { "SCR", 7 },
+};
+
+static const char *const op_names[UART_PROBE_OP_COUNT] = {
+    "read", "write", "wait", "delay", "time", "loop",
+};
+
+static int parse_reg(const char *s) {
+    size_t i;
+    char *end;
+    long v;
+
+    for (i = 0; i < sizeof(regs) / sizeof(regs[0]); i++)
+        if (!strcasecmp(s, regs[i].name))
+            return regs[i].reg;
+    v = strtol(s, &end, 0);
+    return (*end || v < 0 || v > 7) ? -1 : (int)v;
+}
+
+static int parse_num(const char *s, long max, long *out) {
+    char *end;
+    long v;
+
+    if (!s)
+        return -1;
+    v = strtol(s, &end, 0);
+    if (*end || v < 0 || v > max)
+        return -1;
+    *out = v;
+    return 0;
+}
+
+static int find_label(const struct label *labels, int n, const char *name) {
+    int i;
+    for (i = 0; i < n; i++)
+        if (!strcmp(labels[i].name, name))
+            return labels[i].pc;
+    return -1;
+}
+
+// One op per line, labels resolved as they are seen (loops only jump back)
+static int assemble(FILE *in, struct uart_probe_op *ops, int max) {
+    struct label labels[LABELS_MAX];
+    char buf[256];
+    int nops = 0, nlabels = 0, lineno = 0;
+
+    while (fgets(buf, sizeof(buf), in)) {
+        char *tok[6], *save = NULL, *p;
+        struct uart_probe_op *op;
+        long a, b, c;
+        int ntok = 0, reg;
+
+        lineno++;
+        if ((p = strchr(buf, '#')))
+            *p = '\0';
+        for (p = strtok_r(buf, " \t\r\n,", &save); p && ntok < 6;
+             p = strtok_r(NULL, " \t\r\n,", &save))
+            tok[ntok++] = p;
+        if (!ntok)
+            continue;
+
+        p = tok[0] + strlen(tok[0]) - 1;
+        if (ntok == 1 && *p == ':') {
+            *p = '\0';
+            if (nlabels >= LABELS_MAX)
+                goto bad;
+            snprintf(labels[nlabels].name, sizeof(labels[nlabels].name), "%s", tok[0]);
+            labels[nlabels++].pc = nops;
+            continue;
+        }
+
+        if (nops >= max) {
+            fprintf(stderr, "line %d: more than %d ops\n", lineno, max);
+            return -1;
+        }
+        op = &ops[nops];
+        memset(op, 0, sizeof(*op));
+
+        if (!strcmp(tok[0], "read") && ntok == 2) {
+            op->op = UART_PROBE_OP_READ;
+            if ((reg = parse_reg(tok[1])) < 0)
+                goto bad;
+            op->reg = reg;
+        } else if (!strcmp(tok[0], "write") && ntok == 3) {
+            op->op = UART_PROBE_OP_WRITE;
+            if ((reg = parse_reg(tok[1])) < 0 || parse_num(tok[2], 255, &a))
+                goto bad;
+            op->reg = reg;
+            op->value = a;
+        } else if (!strcmp(tok[0], "wait") && ntok == 5) {
+            op->op = UART_PROBE_OP_WAIT;
+            if ((reg = parse_reg(tok[1])) < 0 || parse_num(tok[2], 255, &a) ||
+                parse_num(tok[3], 255, &b) || parse_num(tok[4], 65535, &c))
+                goto bad;
+            op->reg = reg;
+            op->mask = a;
+            op->value = b;
+            op->arg = c;
+        } else if (!strcmp(tok[0], "delay") && ntok == 2) {
+            op->op = UART_PROBE_OP_DELAY;
+            if (parse_num(tok[1], 65535, &a))
+                goto bad;
+            op->arg = a;
+        } else if (!strcmp(tok[0], "time") && ntok == 1) {
+            op->op = UART_PROBE_OP_TIME;
+        } else if (!strcmp(tok[0], "loop") && ntok == 3) {
+            int target = find_label(labels, nlabels, tok[1]);
+            op->op = UART_PROBE_OP_LOOP;
+            if (target < 0 || parse_num(tok[2], 65535, &a))
+                goto bad;
+            op->target = target;
+            op->arg = a;
+        } else {
+            goto bad;
+        }
+        nops++;
+    }
+    return nops;
+
+bad:
+    fprintf(stderr, "line %d: cannot parse\n", lineno);
+    return -1;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+        "Usage: %s [options] <port> <program|->\n"
+        "  -l, --loopback         Start in internal loopback, 8N1\n"
+        "  -D, --divisor <n>      Loopback divisor (default 1)\n"
+        "  -F, --fcr <value>      FCR for the loopback setup (default: the port's)\n"
+        "  -S, --sampling <n>     Loopback clocks per bit, 4..16 (default 16)\n"
+        "  -n, --samples <n>      Room for samples (default %d)\n",
+        prog, SAMPLES_DEFAULT);
+}
+
+int main(int argc, char *argv[]) {
+    static const struct option long_opts[] = {
+        { "loopback", no_argument,       NULL, 'l' },
+        { "divisor",  required_argument, NULL, 'D' },
+        { "fcr",      required_argument, NULL, 'F' },
+        { "sampling", required_argument, NULL, 'S' },
+        { "samples",  required_argument, NULL, 'n' },
+        { "help",     no_argument,       NULL, 'h' },
+        { NULL, 0, NULL, 0 }
+    };
+    static struct uart_probe_op ops[UART_PROBE_PROG_OPS_MAX];
+    struct uart_probe_prog prog;
+    struct uart_probe_sample *smp;
+    const char *port;
+    FILE *in;
+    uint32_t i;
+    int opt, nops, fd, nsamples = SAMPLES_DEFAULT;
+
+    memset(&prog, 0, sizeof(prog));
+    while ((opt = getopt_long(argc, argv, "lD:F:S:n:h", long_opts, NULL)) != -1) {
+        switch (opt) {
+        case 'l': prog.flags |= UART_PROBE_F_LOOPBACK; break;
+        case 'D':
+            prog.flags |= UART_PROBE_F_DIVISOR;
+            prog.divisor = strtoul(optarg, NULL, 0);
+            break;
+        case 'F':
+            prog.flags |= UART_PROBE_F_FCR;
+            prog.fcr = strtoul(optarg, NULL, 0);
+            break;
+        case 'S':
+            prog.flags |= UART_PROBE_F_SAMPLING;
+            prog.sampling = strtoul(optarg, NULL, 0);
+            break;
+        case 'n': nsamples = atoi(optarg); break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (argc - optind != 2 || nsamples < 1 || nsamples > UART_PROBE_PROG_SAMPLES_MAX) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    port = strrchr(argv[optind], '/');
+    port = port ? port + 1 : argv[optind];
+    in = strcmp(argv[optind + 1], "-") ? fopen(argv[optind + 1], "r") : stdin;
+    if (!in) {
+        perror(argv[optind + 1]);
+        return 1;
+    }
+    nops = assemble(in, ops, UART_PROBE_PROG_OPS_MAX);
+    if (in != stdin)
+        fclose(in);
+    if (nops <= 0) {
+        if (!nops)
+            fprintf(stderr, "Empty program\n");
+        return 1;
+    }
+
+    smp = calloc(nsamples, sizeof(*smp));
+    if (!smp) {
+        perror("calloc");
+        return 1;
+    }
+    snprintf(prog.port, sizeof(prog.port), "%s", port);
+    prog.nops = nops;
+    prog.nsamples = nsamples;
+    prog.ops = (uintptr_t)ops;
+    prog.samples = (uintptr_t)smp;
+
+    fd = open(PROBE_MISC_DEV, O_RDWR | O_CLOEXEC);
+    if (fd < 0) {
+        perror(PROBE_MISC_DEV);
+        return 1;
+    }
+    if (ioctl(fd, UART_PROBE_IOC_RUN, &prog) != 0) {
+        fprintf(stderr, "%s: %s\n", prog.port, strerror(errno));
+        return 1;
+    }
+    close(fd);
+
+    printf("# %s: %u ops, %u steps, %u samples, %.1f us, status %s\n",
+           prog.port, nops, prog.steps, prog.samples_used,
+           prog.duration_ns / 1e3, prog.status ? strerror(-prog.status) : "ok");
+    printf("%12s %5s %-6s %4s %s\n", "t_us", "pc", "op", "reg", "value");
+    for (i = 0; i < prog.samples_used; i++) {
+        const struct uart_probe_op *op = &ops[smp[i].pc];
+        printf("%12.3f %5u %-6s %4u 0x%02x%s\n", smp[i].t_ns / 1e3, smp[i].pc,
+               op->op < UART_PROBE_OP_COUNT ? op_names[op->op] : "?",
+               op->reg, smp[i].value,
+               smp[i].flags & UART_PROBE_S_TIMEOUT ? " timeout" : "");
+    }
+    free(smp);
+    return prog.status ? 2 : 0;
+}
@@ -0,0 +1,308 @@
+// uart_scale.c
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <getopt.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/serial.h>
+
+#include "multiport.h"
+#include "serial_port.h"
+#include "serial_stats.h"
+
+#define PORTS_MAX           SERIAL_LINES_MAX
+#define BAUD_DEFAULT        115200
+#define FRAME_DEFAULT       64
+#define SECONDS_DEFAULT     5
+#define PERIOD_MS           250
+#define IRQ_TIMING          "/sys/kernel/debug/uart_probe/irq_timing"
+
+#ifndef TIOCM_LOOP
+#define TIOCM_LOOP          0x8000  // <asm/termios.h>, MCR loopback on 8250
+#endif
+
+/*
+ * Loopback streams on 1, 2, 4 ... N ports of one card at once. Each step
+ * reports aggregate throughput, interrupts per second on the card's
+ * lines and, with uart_probe loaded, where the interrupt time goes:
+ * the whole serial8250_interrupt() call, the port handler calls that had
+ * work, and the calls that found their port idle while the core walked
+ * the shared chain.
+ */
+struct irq_totals {
+    unsigned long long calls, handled, ns, idle_ns;
+};
+
+struct timing {
+    struct irq_totals chain;    // the card's irqN rows
+    struct irq_totals ports;    // the card's ttySN rows, busy or not
+};
+
+static char devs[PORTS_MAX][64];
+static struct mp_port mp[PORTS_MAX];
+static int irqs[PORTS_MAX], nirqs;
+// every port given with -d and its IRQ, from sysfs, whether in the step or not
+static int card_lines[PORTS_MAX], ncard_lines, card_irqs[PORTS_MAX], ncard_irqs;
+static volatile sig_atomic_t stop_requested;
+
+static void on_signal(int sig) {
+    (void)sig;
+    stop_requested = 1;
+}
+
+static int timing_write(const char *v) {
+    FILE *f = fopen(IRQ_TIMING, "w");
+    int ret;
+
+    if (!f)
+        return -1;
+    ret = fputs(v, f) < 0 ? -1 : 0;
+    if (fclose(f) != 0)
+        ret = -1;
+    return ret;
+}
+
+static int int_in(const int *v, int n, int x) {
+    int i;
+
+    for (i = 0; i < n; i++)
+        if (v[i] == x)
+            return 1;
+    return 0;
+}
+
+// Only the chains on the card's IRQ lines and the card's own ports
+static int timing_read(struct timing *t) {
+    FILE *f = fopen(IRQ_TIMING, "r");
+    char buf[256], name[32];
+    struct irq_totals r, *dst;
+    int n;
+
+    if (!f)
+        return -1;
+    memset(t, 0, sizeof(*t));
+    while (fgets(buf, sizeof(buf), f)) {
+        if (buf[0] == '#' ||
+            sscanf(buf, "%31s %llu %llu %llu %llu", name, &r.calls, &r.handled,
+                   &r.ns, &r.idle_ns) != 5)
+            continue;
+        if (sscanf(name, "irq%d", &n) == 1 && int_in(card_irqs, ncard_irqs, n))
+            dst = &t->chain;
+        else if (sscanf(name, "ttyS%d", &n) == 1 && int_in(card_lines, ncard_lines, n))
+            dst = &t->ports;
+        else
+            continue;
+        dst->calls += r.calls;
+        dst->handled += r.handled;
+        dst->ns += r.ns;
+        dst->idle_ns += r.idle_ns;
+    }
+    fclose(f);
+    return 0;
+}
+
+static void add_irq(int fd) {
+    struct serial_struct ss;
+    int i;
+
+    if (ioctl(fd, TIOCGSERIAL, &ss) != 0 || ss.irq <= 0 || ss.irq >= IRQ_MAX)
+        return;
+    for (i = 0; i < nirqs; i++)
+        if (irqs[i] == ss.irq)
+            return;
+    irqs[nirqs++] = ss.irq;
+}
+
+static uint64_t irq_total(const uint64_t *counts) {
+    uint64_t sum = 0;
+    int i;
+
+    for (i = 0; i < nirqs; i++)
+        sum += counts[irqs[i]];
+    return sum;
+}
+
+static void set_loop(int fd, int on) {
+    int bits = TIOCM_LOOP;
+    ioctl(fd, on ? TIOCMBIS : TIOCMBIC, &bits);
+}
+
+// One step on the first n ports, one line of output
+static int run_step(int n, long baud, int frame, int seconds, int loop, int timing) {
+    static uint64_t irq0[IRQ_MAX], irq1[IRQ_MAX];
+    struct mp_stats a[PORTS_MAX], b[PORTS_MAX];
+    struct timing t;
+    unsigned long long bytes = 0, lost = 0;
+    double t0, t1, secs;
+    int i, have_timing = 0;
+
+    for (i = 0; i < n; i++) {
+        if (mp_open(&mp[i], devs[i], baud, frame, 0, PERIOD_MS) != 0) {
+            fprintf(stderr, "%s: %s\n", devs[i], strerror(errno));
+            goto fail;
+        }
+        if (loop)
+            set_loop(mp[i].fd, 1);
+        add_irq(mp[i].fd);
+        if (mp_start(&mp[i]) != 0) {
+            fprintf(stderr, "%s: cannot start thread\n", devs[i]);
+            mp_close(&mp[i]);
+            goto fail;
+        }
+    }
+
+    // two publish periods to settle, then count from the last summary
+    usleep(2 * PERIOD_MS * 1000);
+    if (timing)
+        have_timing = timing_write("1") == 0;
+    irq_counts_read(irq0, IRQ_MAX);
+    for (i = 0; i < n; i++)
+        mp_snapshot(&mp[i], &a[i]);
+    t0 = now_us();
+
+    for (i = 0; i < seconds * 10 && !stop_requested; i++)
+        usleep(100000);
+
+    for (i = 0; i < n; i++)
+        mp_snapshot(&mp[i], &b[i]);
+    t1 = now_us();
+    irq_counts_read(irq1, IRQ_MAX);
+    if (have_timing)
+        have_timing = timing_read(&t) == 0;
+
+    for (i = 0; i < n; i++) {
+        bytes += b[i].total_bytes - a[i].total_bytes;
+        lost += b[i].total_lost - a[i].total_lost;
+        if (loop)
+            set_loop(mp[i].fd, 0);
+        mp_stop(&mp[i]);
+    }
+
+    secs = (t1 - t0) / 1e6;
+    double rate = bytes / secs;
+    double ints = (irq_total(irq1) - irq_total(irq0)) / secs;
+    printf("%5d %12.0f %10.0f %5.1f %10.0f %8.1f %6llu", n, rate, rate / n,
+           100.0 * rate / n / (baud / 10.0), ints, ints > 0 ? rate / ints : 0, lost);
+    if (have_timing && t.chain.calls) {
+        double calls = t.chain.calls;
+        // chain time outside any port handler, plus handlers that found nothing
+        double outside = t.chain.ns > t.ports.ns ? t.chain.ns - t.ports.ns : 0;
+        printf(" %9.0f %9.0f %7.2f %9.0f %5.1f\n",
+               t.chain.ns / calls,
+               t.ports.handled ? (t.ports.ns - t.ports.idle_ns) / (double)t.ports.handled : 0,
+               (t.ports.calls - t.ports.handled) / calls,
+               (outside + t.ports.idle_ns) / calls,
+               t.chain.ns ? 100.0 * (outside + t.ports.idle_ns) / t.chain.ns : 0);
+    } else {
+        printf(" %9s %9s %7s %9s %5s\n", "-", "-", "-", "-", "-");
+    }
+    fflush(stdout);
+    return 0;
+
+fail:
+    while (--i >= 0) {
+        if (loop)
+            set_loop(mp[i].fd, 0);
+        mp_stop(&mp[i]);
+    }
+    return -1;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+        "Usage: %s [options] -d <list>\n"
+        "  -d, --device <list>    Comma separated ports of one card\n"
+        "  -b, --baud <rate>      Line rate (default %d)\n"
+        "  -f, --frame <bytes>    Bytes per round trip (default %d)\n"
+        "  -s, --seconds <n>      Per step (default %d)\n"
+        "  -l, --loop             Internal loopback (TIOCM_LOOP) instead of plugs\n"
+        "  -n, --no-timing        Do not arm uart_probe irq_timing\n",
+        prog, BAUD_DEFAULT, FRAME_DEFAULT, SECONDS_DEFAULT);
+}
+
+int main(int argc, char *argv[]) {
+    static const struct option long_opts[] = {
+        { "device",    required_argument, NULL, 'd' },
+        { "baud",      required_argument, NULL, 'b' },
+        { "frame",     required_argument, NULL, 'f' },
+        { "seconds",   required_argument, NULL, 's' },
+        { "loop",      no_argument,       NULL, 'l' },
+        { "no-timing", no_argument,       NULL, 'n' },
+        { "help",      no_argument,       NULL, 'h' },
+        { NULL, 0, NULL, 0 }
+    };
+    const char *devices = NULL;
+    int frame = FRAME_DEFAULT, seconds = SECONDS_DEFAULT, loop = 0, timing = 1;
+    int nports = 0, opt, n, armed;
+    long baud = BAUD_DEFAULT;
+
+    while ((opt = getopt_long(argc, argv, "d:b:f:s:lnh", long_opts, NULL)) != -1) {
+        switch (opt) {
+        case 'd': devices = optarg; break;
+        case 'b': baud = strtol(optarg, NULL, 10); break;
+        case 'f': frame = atoi(optarg); break;
+        case 's': seconds = atoi(optarg); break;
+        case 'l': loop = 1; break;
+        case 'n': timing = 0; break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (!devices || baud <= 0 || frame < 1 || seconds < 1) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    char *copy = strdup(devices), *save = NULL, *tok;
+    for (tok = strtok_r(copy, ",", &save); tok && nports < PORTS_MAX;
+         tok = strtok_r(NULL, ",", &save)) {
+        if (strchr(tok, '/'))
+            snprintf(devs[nports++], sizeof(devs[0]), "%s", tok);
+        else
+            snprintf(devs[nports++], sizeof(devs[0]), "/dev/%.58s", tok);
+    }
+    free(copy);
+    if (!nports) {
+        fprintf(stderr, "No ports\n");
+        return 1;
+    }
+    for (n = 0; n < nports; n++) {
+        char path[128];
+        int irq;
+
+        tty_sysfs_path(devs[n], "line", path, sizeof(path));
+        card_lines[ncard_lines++] = sysfs_read_int(path);
+        tty_sysfs_path(devs[n], "irq", path, sizeof(path));
+        irq = sysfs_read_int(path);
+        if (irq > 0 && !int_in(card_irqs, ncard_irqs, irq))
+            card_irqs[ncard_irqs++] = irq;
+    }
+
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+
+    armed = timing && timing_write("1") == 0;
+    if (timing && !armed)
+        fprintf(stderr, "%s: %s, no interrupt timing\n", IRQ_TIMING, strerror(errno));
+    printf("# %d ports, %ld baud, %d byte frames, %d s per step%s\n", nports, baud,
+           frame, seconds, loop ? ", internal loopback" : "");
+    printf("%5s %12s %10s %5s %10s %8s %6s %9s %9s %7s %9s %5s\n",
+           "ports", "bytes/s", "per_port", "line%", "irqs/s", "B/irq", "lost",
+           "ns/irq", "ns/work", "idle/i", "share_ns", "shr%");
+
+    for (n = 1; !stop_requested; n = n * 2 < nports ? n * 2 : nports) {
+        if (run_step(n, baud, frame, seconds, loop, armed) != 0)
+            break;
+        if (n == nports)
+            break;
+    }
+
+    if (armed)
+        timing_write("0");
+    return 0;
+}
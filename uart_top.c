@@ -0,0 +1,294 @@
+// uart_top.c
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <getopt.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "multiport.h"
+#include "serial_port.h"
+#include "serial_stats.h"
+
+#define PORTS_MAX           SERIAL_LINES_MAX
+#define REFRESH_MS_DEFAULT  1000
+#define BAUD_DEFAULT        115200
+#define SCREEN_SIZE         (64 * 1024)
+
+struct top_port {
+    char name[32];              // ttyS<N>
+    char dev[64];               // /dev path
+    int line;
+    int have_line;              // found in /proc/tty/driver/serial
+    struct serial_line prev;
+    struct serial_line cur;
+    int shared;                 // other handlers on the same IRQ
+    struct mp_port *bench;      // NULL in passive mode
+};
+
+static struct top_port ports[PORTS_MAX];
+static struct mp_port bench[PORTS_MAX];
+static int nports;
+static int bench_mode;
+static uint64_t irq_prev[IRQ_MAX], irq_cur[IRQ_MAX];
+static volatile sig_atomic_t stop_requested;
+
+static char screen[SCREEN_SIZE];
+static size_t screen_len;
+
+static void on_signal(int sig) {
+    (void)sig;
+    stop_requested = 1;
+}
+
+static void out(const char *fmt, ...) {
+    va_list ap;
+    int n;
+
+    if (screen_len >= sizeof(screen))
+        return;
+    va_start(ap, fmt);
+    n = vsnprintf(screen + screen_len, sizeof(screen) - screen_len, fmt, ap);
+    va_end(ap);
+    if (n > 0)
+        screen_len += n;
+    if (screen_len > sizeof(screen))
+        screen_len = sizeof(screen);
+}
+
+static int add_port(const char *name) {
+    struct top_port *tp;
+    const char *base = strrchr(name, '/');
+
+    if (nports >= PORTS_MAX)
+        return -1;
+    tp = &ports[nports++];
+    memset(tp, 0, sizeof(*tp));
+    snprintf(tp->name, sizeof(tp->name), "%s", base ? base + 1 : name);
+    if (base)
+        snprintf(tp->dev, sizeof(tp->dev), "%s", name);
+    else
+        snprintf(tp->dev, sizeof(tp->dev), "/dev/%.58s", name);
+    if (sscanf(tp->name, "ttyS%d", &tp->line) != 1)
+        tp->line = -1;
+    return 0;
+}
+
+static void sample(void) {
+    static struct serial_line lines[SERIAL_LINES_MAX];
+    int n = serial_lines_read_all(lines, SERIAL_LINES_MAX);
+    int i, j;
+
+    memcpy(irq_prev, irq_cur, sizeof(irq_cur));
+    irq_counts_read(irq_cur, IRQ_MAX);
+
+    for (i = 0; i < nports; i++) {
+        struct top_port *tp = &ports[i];
+        tp->prev = tp->cur;
+        for (j = 0; j < n; j++) {
+            if (lines[j].line == tp->line) {
+                tp->cur = lines[j];
+                if (!tp->have_line)
+                    tp->prev = tp->cur;
+                tp->have_line = 1;
+                break;
+            }
+        }
+    }
+}
+
+static void fmt_int(char *buf, size_t len, int v) {
+    if (v < 0)
+        snprintf(buf, len, "-");
+    else
+        snprintf(buf, len, "%d", v);
+}
+
+/*
+ * Build the whole frame in memory and hand it to the terminal with a single
+ * write(), cursor home first and clear-to-end last, so there is no flicker
+ * and no per-cell syscalls.
+ */
+static void draw(double secs, int plain) {
+    char stamp[32], path[256], rxt[12], txt[12], p50[16], p99[16];
+    time_t t = time(NULL);
+    struct tm tm;
+    int i;
+
+    screen_len = 0;
+    localtime_r(&t, &tm);
+    strftime(stamp, sizeof(stamp), "%H:%M:%S", &tm);
+    if (!plain)
+        out("\033[H");
+    out("uart_top %s  %d ports  %s  interval %.1fs\n", stamp, nports,
+        bench_mode ? "benchmark" : "passive", secs);
+    out("%-8s %-10s %5s %4s %4s %10s %10s %8s %6s %8s %6s %9s %9s\n",
+        "PORT", "UART", "IRQ", "RXT", "TXT", "RX_B/s", "TX_B/s", "INT/s",
+        "B/INT", "OE", "OE/s", "P50_us", "P99_us");
+
+    for (i = 0; i < nports; i++) {
+        struct top_port *tp = &ports[i];
+        struct serial_line *c = &tp->cur, *p = &tp->prev;
+        double rx = 0, tx = 0, ints = 0, oe = 0;
+        char irq[12];
+
+        tty_sysfs_path(tp->name, "rx_trig_bytes", path, sizeof(path));
+        fmt_int(rxt, sizeof(rxt), sysfs_read_int(path));
+        tty_sysfs_path(tp->name, "tx_trig_bytes", path, sizeof(path));
+        fmt_int(txt, sizeof(txt), sysfs_read_int(path));
+
+        if (tp->have_line && secs > 0) {
+            rx = (c->rx - p->rx) / secs;
+            tx = (c->tx - p->tx) / secs;
+            oe = (c->oe - p->oe) / secs;
+            if (c->irq > 0 && c->irq < IRQ_MAX)
+                ints = (irq_cur[c->irq] - irq_prev[c->irq]) / secs;
+        }
+        snprintf(irq, sizeof(irq), "%d%s", c->irq, tp->shared > 1 ? "*" : "");
+
+        snprintf(p50, sizeof(p50), "-");
+        snprintf(p99, sizeof(p99), "-");
+        if (tp->bench) {
+            struct mp_stats s;
+            mp_snapshot(tp->bench, &s);
+            if (s.frames) {
+                snprintf(p50, sizeof(p50), "%.0f", s.rtt_p50_us);
+                snprintf(p99, sizeof(p99), "%.0f", s.rtt_p99_us);
+            }
+        }
+
+        // overrunning ports stand out in reverse video
+        if (oe > 0 && !plain)
+            out("\033[7m");
+        out("%-8s %-10s %5s %4s %4s %10.0f %10.0f %8.0f %6.1f %8llu %6.0f %9s %9s",
+            tp->name, tp->have_line ? c->uart : "?", irq, rxt, txt, rx, tx,
+            ints, ints > 0 ? (rx + tx) / ints : 0.0,
+            (unsigned long long)c->oe, oe, p50, p99);
+        if (oe > 0 && !plain)
+            out("\033[0m");
+        out(plain ? "\n" : "\033[K\n");
+    }
+    if (!plain)
+        out("\033[J");
+
+    if (write(STDOUT_FILENO, screen, screen_len) < 0)
+        stop_requested = 1;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+        "Usage: %s [options]\n"
+        "  -d, --device <list>    Comma separated ports (default: all initialized ttyS)\n"
+        "  -b, --bench            Run loopback round trips on every port for RTT columns\n"
+        "  -B, --baud <rate>      Benchmark line rate (default %d)\n"
+        "  -f, --frame <bytes>    Benchmark bytes per round trip (default 1)\n"
+        "  -i, --interval <ms>    Refresh interval (default %d)\n"
+        "  -n, --count <n>        Exit after n refreshes\n"
+        "  -p, --plain            No terminal control, append each frame (for logs)\n",
+        prog, BAUD_DEFAULT, REFRESH_MS_DEFAULT);
+}
+
+int main(int argc, char *argv[]) {
+    static const struct option long_opts[] = {
+        { "device",   required_argument, NULL, 'd' },
+        { "bench",    no_argument,       NULL, 'b' },
+        { "baud",     required_argument, NULL, 'B' },
+        { "frame",    required_argument, NULL, 'f' },
+        { "interval", required_argument, NULL, 'i' },
+        { "count",    required_argument, NULL, 'n' },
+        { "plain",    no_argument,       NULL, 'p' },
+        { "help",     no_argument,       NULL, 'h' },
+        { NULL, 0, NULL, 0 }
+    };
+    const char *devices = NULL;
+    int do_bench = 0, frame = 1, interval = REFRESH_MS_DEFAULT, count = 0;
+    int plain = 0, opt, i, iter;
+    long baud = BAUD_DEFAULT;
+    double t_prev;
+
+    while ((opt = getopt_long(argc, argv, "d:bB:f:i:n:ph", long_opts, NULL)) != -1) {
+        switch (opt) {
+        case 'd': devices = optarg; break;
+        case 'b': do_bench = 1; break;
+        case 'B': baud = strtol(optarg, NULL, 10); break;
+        case 'f': frame = atoi(optarg); break;
+        case 'i': interval = atoi(optarg); break;
+        case 'n': count = atoi(optarg); break;
+        case 'p': plain = 1; break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (interval < 100) {
+        fprintf(stderr, "Interval must be at least 100 ms\n");
+        return 1;
+    }
+
+    if (devices) {
+        char *copy = strdup(devices), *save = NULL, *tok;
+        for (tok = strtok_r(copy, ",", &save); tok; tok = strtok_r(NULL, ",", &save))
+            add_port(tok);
+        free(copy);
+    } else {
+        static struct serial_line lines[SERIAL_LINES_MAX];
+        int n = serial_lines_read(lines, SERIAL_LINES_MAX);
+        if (n < 0) {
+            fprintf(stderr, "Cannot read /proc/tty/driver/serial (needs root), use -d\n");
+            return 1;
+        }
+        for (i = 0; i < n; i++) {
+            char name[32];
+            snprintf(name, sizeof(name), "ttyS%d", lines[i].line);
+            add_port(name);
+        }
+    }
+    if (!nports) {
+        fprintf(stderr, "No ports to watch\n");
+        return 1;
+    }
+
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+
+    if (do_bench) {
+        bench_mode = 1;
+        for (i = 0; i < nports; i++) {
+            const char *dev = ports[i].dev;
+            if (mp_open(&bench[i], dev, baud, frame, 0, interval) != 0 ||
+                mp_start(&bench[i]) != 0) {
+                fprintf(stderr, "%s: %s\n", dev, strerror(errno));
+                while (--i >= 0)
+                    mp_stop(&bench[i]);
+                return 1;
+            }
+            ports[i].bench = &bench[i];
+        }
+    }
+
+    sample();
+    for (i = 0; i < nports; i++)
+        if (ports[i].have_line)
+            ports[i].shared = irq_share_count(ports[i].cur.irq);
+    // straight to the terminal, draw() does not go through stdio either
+    if (!plain && write(STDOUT_FILENO, "\033[2J", 4) < 0)
+        stop_requested = 1;
+
+    t_prev = now_us();
+    for (iter = 0; !stop_requested && (!count || iter < count); iter++) {
+        usleep(interval * 1000);
+        double now = now_us();
+        sample();
+        draw((now - t_prev) / 1e6, plain);
+        t_prev = now;
+    }
+
+    if (do_bench)
+        for (i = 0; i < nports; i++)
+            mp_stop(&bench[i]);
+    return 0;
+}